@@ -1,5 +1,6 @@
 #include "GLFW_wnd.h"
 #include "log.h"
+#include "trace.h"
 #include <stdexcept>
 
 namespace window {
@@ -51,8 +52,12 @@ namespace window {
 
     void GLFW::draw() {
 
+        TRACE_SCOPE("render", "frame")
         this->run();
-        glfwSwapBuffers(window);
+        {
+            TRACE_SCOPE("render", "swap buffers")
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
     }
 
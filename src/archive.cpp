@@ -0,0 +1,295 @@
+#include "archive.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <zlib.h>
+#include "movegen.h"
+#include "log.h"
+
+namespace archive {
+
+    namespace {
+
+        void put_varint(std::string& out, uint64_t v) {
+
+            while (v >= 0x80) { out += static_cast<char>((v & 0x7F) | 0x80); v >>= 7; }
+            out += static_cast<char>(v);
+        }
+
+        uint64_t get_varint(const std::string& in, size_t& pos) {
+
+            uint64_t v = 0;
+            for (int shift = 0; pos < in.size(); shift += 7) {
+                uint8_t b = static_cast<uint8_t>(in[pos++]);
+                v |= static_cast<uint64_t>(b & 0x7F) << shift;
+                if (!(b & 0x80)) break;
+            }
+            return v;
+        }
+
+        template<typename T> void write_pod(std::ostream& out, const T* data, size_t count) {
+            out.write(reinterpret_cast<const char*>(data), sizeof(T)*count);
+        }
+    }
+
+    EncodedGame encode(std::string_view fen, const std::vector<engine::Move>& moves, pgn::Result result) {
+
+        if (fen.size() > 255) throw std::invalid_argument("FEN too long for archive");
+
+        EncodedGame game;
+        engine::Position pos = fen.empty()? engine::Position(): engine::Position(fen);
+        game.bytes.reserve(moves.size()+8);
+        put_varint(game.bytes, moves.size());
+        game.bytes += static_cast<char>(result | (fen.empty()? 0: 4));
+        if (!fen.empty()) { game.bytes += static_cast<char>(fen.size()); game.bytes += fen; }
+
+        game.keys.reserve(moves.size()+1);
+        game.keys.push_back(pos.key());
+        for (engine::Move m: moves) {
+
+            engine::MoveList list;
+            engine::generate<engine::LEGAL>(pos, list);
+            const engine::Move* it = std::find(list.begin(), list.end(), m);
+            if (it == list.end()) throw std::invalid_argument("Illegal move in archived game");
+            game.bytes += static_cast<char>(it-list.begin());
+            pos.do_move(m);
+            game.keys.push_back(pos.key());
+        }
+        std::sort(game.keys.begin(), game.keys.end());
+        game.keys.erase(std::unique(game.keys.begin(), game.keys.end()), game.keys.end());
+        return game;
+    }
+
+    void Writer::flush_block() {
+
+        if (current.empty()) return;
+        uLongf size = compressBound(current.size());
+        std::string compressed(size, '\0');
+        if (compress2(reinterpret_cast<Bytef*>(compressed.data()), &size,
+                      reinterpret_cast<const Bytef*>(current.data()), current.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+            throw std::runtime_error("Could not compress archive block");
+        compressed.resize(size);
+        blocks.push_back(std::move(compressed));
+        raw_sizes.push_back(current.size());
+        current.clear();
+    }
+
+    void Writer::add(EncodedGame&& game) {
+
+        if (!current.empty() && current.size()+game.bytes.size() > BLOCK_SIZE) flush_block();
+        uint32_t id = games.size();
+        games.push_back({static_cast<uint32_t>(blocks.size()), static_cast<uint32_t>(current.size())});
+        current += game.bytes;
+        for (engine::Key key: game.keys) index.emplace_back(key, id);
+    }
+
+    void Writer::append(const Archive& from) {
+
+        flush_block();
+        for (const Archive::Segment& s: from.segments) {
+
+            uint32_t first_block = blocks.size(), first_game = games.size();
+            for (uint32_t b=0; b<s.header->block_count; ++b) {
+                const BlockEntry& e = s.blocks[b];
+                blocks.emplace_back(s.base+e.offset, e.compressed_size);
+                raw_sizes.push_back(e.raw_size);
+            }
+            for (uint64_t g=0; g<s.header->game_count; ++g)
+                games.push_back({s.games[g].block+first_block, s.games[g].offset});
+            for (uint64_t i=0; i<s.header->index_count; ++i)
+                index.emplace_back(s.keys[i], s.key_games[i]+first_game);
+        }
+    }
+
+    void Writer::write(std::ostream& out) {
+
+        flush_block();
+        std::sort(index.begin(), index.end());
+
+        Header header {};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.block_count = blocks.size();
+        header.game_count = games.size();
+        header.index_count = index.size();
+
+        std::vector<BlockEntry> block_table;
+        uint64_t offset = sizeof(Header);
+        for (size_t b=0; b<blocks.size(); ++b) {
+            block_table.push_back({offset, static_cast<uint32_t>(blocks[b].size()), raw_sizes[b]});
+            offset += blocks[b].size();
+        }
+        uint64_t blocks_end = offset;
+        header.block_table = (offset+7) & ~7ULL;
+        header.game_table = header.block_table + block_table.size()*sizeof(BlockEntry);
+        header.index_keys = header.game_table + games.size()*sizeof(GameEntry);
+        header.index_games = header.index_keys + index.size()*sizeof(engine::Key);
+
+        write_pod(out, &header, 1);
+        for (const std::string& block: blocks) out.write(block.data(), block.size());
+        static const char padding[8] = {};
+        out.write(padding, header.block_table-blocks_end);
+        write_pod(out, block_table.data(), block_table.size());
+        write_pod(out, games.data(), games.size());
+        for (const auto& entry: index) write_pod(out, &entry.first, 1);
+        for (const auto& entry: index) write_pod(out, &entry.second, 1);
+    }
+
+    void Writer::write(const std::string& path) {
+
+        std::string tmp = path + ".tmp";
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) throw std::runtime_error("Could not create archive " + tmp);
+        write(out);
+        out.close();
+        if (!out) throw std::runtime_error("Could not write archive " + tmp);
+
+        if (std::rename(tmp.c_str(), path.c_str()) != 0)
+            throw std::runtime_error("Could not replace archive " + path + ": " + strerror(errno));
+        LOGD("Archive %s: %lu games, %lu index entries, %lu blocks", path.c_str(), games.size(), index.size(), blocks.size())
+    }
+
+    void Writer::append_to(const std::string& path) {
+
+        if (!std::filesystem::exists(path)) { write(path); return; }
+
+        size_t end, segments;
+        {
+            Archive archive(path);
+            end = archive.end, segments = archive.segments.size();
+        }
+        // an interrupted append left a partial segment behind
+        if (std::filesystem::file_size(path) != end) std::filesystem::resize_file(path, end);
+
+        std::ofstream out(path, std::ios::binary | std::ios::app);
+        if (!out) throw std::runtime_error("Could not open archive " + path);
+        static const char padding[8] = {};
+        out.write(padding, ((end+7) & ~size_t(7)) - end);
+        write(out);
+        out.close();
+        if (!out) throw std::runtime_error("Could not append to archive " + path);
+        LOGD("Archive %s: %lu games appended as segment %lu", path.c_str(), games.size(), segments+1)
+
+        if (segments+1 >= MAX_SEGMENTS) {
+            Writer merged;
+            merged.append(Archive(path));
+            merged.write(path);
+        }
+    }
+
+    Archive::Archive(const std::string& path): file(path, io::MappedFile::RANDOM) {
+
+        for (size_t at = 0; at + sizeof(Header) <= file.size(); at = (end+7) & ~size_t(7)) {
+
+            Segment s;
+            s.base = file.data()+at;
+            s.header = reinterpret_cast<const Header*>(s.base);
+            if (std::memcmp(s.header->magic, MAGIC, sizeof(MAGIC)) != 0 || s.header->version != VERSION) {
+                if (!at) throw std::runtime_error("Not a game archive or unsupported version: " + path);
+                LOGE("Ignoring data after segment %lu of %s", segments.size(), path.c_str())
+                break;
+            }
+            size_t size = s.header->index_games + s.header->index_count*sizeof(uint32_t);
+            if (at + size > file.size()) {
+                if (!at) throw std::runtime_error("Truncated game archive: " + path);
+                LOGE("Ignoring the incomplete segment at the end of %s", path.c_str())
+                break;
+            }
+
+            s.blocks = reinterpret_cast<const BlockEntry*>(s.base+s.header->block_table);
+            s.games = reinterpret_cast<const GameEntry*>(s.base+s.header->game_table);
+            s.keys = reinterpret_cast<const engine::Key*>(s.base+s.header->index_keys);
+            s.key_games = reinterpret_cast<const uint32_t*>(s.base+s.header->index_games);
+            s.first_game = game_count;
+            game_count += s.header->game_count;
+            segments.push_back(s);
+            end = at + size;
+        }
+        if (segments.empty()) throw std::runtime_error("Not a game archive: " + path);
+    }
+
+    StoredGame Archive::game(uint32_t id) const {
+
+        if (id >= game_count) throw std::out_of_range("Game id out of range");
+        const Segment& s = *std::prev(std::upper_bound(segments.begin(), segments.end(), id,
+                                                       [] (uint64_t id, const Segment& s) { return id < s.first_game; }));
+        const GameEntry& entry = s.games[id-s.first_game];
+        const BlockEntry& block = s.blocks[entry.block];
+
+        std::string raw(block.raw_size, '\0');
+        uLongf size = block.raw_size;
+        if (uncompress(reinterpret_cast<Bytef*>(raw.data()), &size,
+                       reinterpret_cast<const Bytef*>(s.base+block.offset), block.compressed_size) != Z_OK)
+            throw std::runtime_error("Corrupted archive block");
+
+        StoredGame game;
+        size_t pos = entry.offset;
+        uint64_t plies = get_varint(raw, pos);
+        uint8_t flags = static_cast<uint8_t>(raw[pos++]);
+        game.result = pgn::Result(flags & 3);
+        if (flags & 4) {
+            size_t len = static_cast<uint8_t>(raw[pos++]);
+            game.fen = raw.substr(pos, len);
+            pos += len;
+        }
+
+        engine::Position board = game.fen.empty()? engine::Position(): engine::Position(game.fen);
+        game.moves.reserve(plies);
+        for (uint64_t i=0; i<plies && pos < raw.size(); ++i) {
+            engine::MoveList list;
+            engine::generate<engine::LEGAL>(board, list);
+            uint8_t idx = static_cast<uint8_t>(raw[pos++]);
+            if (idx >= list.size()) throw std::runtime_error("Corrupted archived game");
+            game.moves.push_back(list.moves[idx]);
+            board.do_move(list.moves[idx]);
+        }
+        return game;
+    }
+
+    std::vector<uint32_t> Archive::find(engine::Key key, size_t limit) const {
+
+        std::vector<uint32_t> ids;
+        for (const Segment& s: segments) {
+            const engine::Key* end = s.keys+s.header->index_count;
+            for (const engine::Key* it = std::lower_bound(s.keys, end, key); it != end && *it == key && ids.size() < limit; ++it)
+                ids.push_back(s.key_games[it-s.keys]+s.first_game);
+        }
+        return ids;
+    }
+
+    pgn::Stats import(const std::string& pgn_path, const std::string& archive_path, unsigned int threads) {
+
+        constexpr size_t BATCH = 256;
+        pgn::Reader reader(pgn_path);
+        Writer writer;
+        std::mutex mutex;
+        std::vector<std::vector<EncodedGame>> pending(pgn::thread_count(threads));
+        std::vector<uint64_t> rejected(pending.size());
+
+        auto flush = [&] (std::vector<EncodedGame>& batch) {
+
+            std::lock_guard<std::mutex> lock(mutex);
+            for (EncodedGame& g: batch) writer.add(std::move(g));
+            batch.clear();
+        };
+
+        pgn::Stats stats = reader.read([&] (const pgn::Game& game, unsigned int thread) {
+
+            if (!game.valid) return;
+            // a game the archive can not hold (long FEN, move illegal from its FEN) is skipped
+            try { pending[thread].push_back(encode(game.fen, game.moves, game.result)); }
+            catch (std::invalid_argument&) { ++rejected[thread]; return; }
+            if (pending[thread].size() >= BATCH) flush(pending[thread]);
+        }, threads);
+
+        for (auto& batch: pending) flush(batch);
+        for (uint64_t r: rejected) stats.errors += r;
+        writer.write(archive_path);
+        return stats;
+    }
+}
@@ -0,0 +1,146 @@
+#pragma once
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "position.h"
+#include "mapped_file.h"
+#include "pgn.h"
+
+namespace archive {
+
+    /**
+     * File layout, all integers little endian:
+     *   Header
+     *   zlib compressed blocks of games, each game is
+     *       varint ply count, flags byte (bits 0-1 result, bit 2 FEN follows),
+     *       [u8 FEN length, FEN], one byte per move - its index in generate<LEGAL> order
+     *   BlockEntry[block_count]
+     *   GameEntry[game_count]
+     *   Key[index_count] sorted, followed by u32 game id[index_count]
+     * Offsets are relative to the header. Games saved one at a time are appended as further
+     * segments of this layout, each starting at the next multiple of 8 after the previous one,
+     * ids continue from one segment to the next
+    */
+    constexpr char MAGIC[8] = {'C', 'H', 'S', 'A', 'R', 'C', 'H', 'V'};
+    constexpr uint32_t VERSION = 1;
+    constexpr size_t BLOCK_SIZE = 64*1024;     // uncompressed bytes per block
+    constexpr size_t MAX_SEGMENTS = 64;         // appending beyond it merges the archive into one segment
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t block_count;
+        uint64_t game_count;
+        uint64_t index_count;
+        uint64_t block_table;
+        uint64_t game_table;
+        uint64_t index_keys;
+        uint64_t index_games;
+    };
+
+    struct BlockEntry {
+        uint64_t offset;
+        uint32_t compressed_size;
+        uint32_t raw_size;
+    };
+
+    struct GameEntry {
+        uint32_t block;
+        uint32_t offset;    // inside the uncompressed block
+    };
+
+    struct StoredGame {
+        std::string fen;    // empty for the standard start position
+        std::vector<engine::Move> moves;
+        pgn::Result result = pgn::UNKNOWN;
+    };
+
+    /**
+     * A game converted to archive bytes together with the keys of every position it reaches
+    */
+    struct EncodedGame {
+        std::string bytes;
+        std::vector<engine::Key> keys;
+    };
+
+    /**
+     * Throws std::invalid_argument when a move is illegal in the replayed position
+    */
+    EncodedGame encode(std::string_view fen, const std::vector<engine::Move>& moves, pgn::Result result);
+
+    class Archive;
+
+    class Writer {
+    private:
+        std::vector<std::string> blocks;    // compressed
+        std::vector<uint32_t> raw_sizes;
+        std::string current;
+        std::vector<GameEntry> games;
+        std::vector<std::pair<engine::Key, uint32_t>> index;
+
+        void flush_block();
+        void write(std::ostream& out);
+    public:
+        void add(EncodedGame&& game);
+        void add(std::string_view fen, const std::vector<engine::Move>& moves, pgn::Result result) {
+            add(encode(fen, moves, result));
+        }
+        size_t size() const { return games.size(); }
+
+        /**
+         * Takes over every game of an existing archive without recompressing it, used to append
+        */
+        void append(const Archive& from);
+
+        /**
+         * Writes the archive to a temporary file next to path and renames it into place
+        */
+        void write(const std::string& path);
+
+        /**
+         * Adds the games as a new segment at the end of the archive at path, or creates it.
+         * Only the new games are written until MAX_SEGMENTS is reached
+        */
+        void append_to(const std::string& path);
+    };
+
+    class Archive {
+        friend class Writer;
+    private:
+        struct Segment {
+            const char* base;
+            const Header* header;
+            const BlockEntry* blocks;
+            const GameEntry* games;
+            const engine::Key* keys;
+            const uint32_t* key_games;
+            uint64_t first_game;
+        };
+
+        io::MappedFile file;
+        std::vector<Segment> segments;
+        uint64_t game_count = 0;
+        size_t end = 0;             // of the last complete segment
+    public:
+        /**
+         * Throws std::runtime_error when the file is missing or not an archive.
+         * An incomplete segment at the end, left by an interrupted append, is ignored
+        */
+        explicit Archive(const std::string& path);
+
+        size_t size() const { return game_count; }
+        StoredGame game(uint32_t id) const;
+
+        /**
+         * Ids of games that reached the position, in ascending order
+        */
+        std::vector<uint32_t> find(engine::Key key, size_t limit = SIZE_MAX) const;
+    };
+
+    /**
+     * Parses the PGN file in parallel and writes all valid games to the archive
+    */
+    pgn::Stats import(const std::string& pgn_path, const std::string& archive_path, unsigned int threads);
+}
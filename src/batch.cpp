@@ -0,0 +1,369 @@
+#include "batch.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "movegen.h"
+#include "notation.h"
+#include "pgn.h"
+#include "search.h"
+
+namespace batch {
+
+    using namespace engine;
+
+    namespace {
+
+        constexpr unsigned int JOBS_PER_THREAD = 4;     // read ahead of the searchers
+        constexpr size_t LINE_WIDTH = 80;
+
+        struct Job {
+            uint64_t index = 0;
+            std::string header;             // PGN tag pairs or EPD operations
+            std::string fen;
+            std::vector<Move> moves;
+            pgn::Result result = pgn::UNKNOWN;
+            bool epd = false;
+        };
+
+        /**
+         * Search result of one position, side to move point of view
+        */
+        struct Analysis {
+            Move best = MOVE_NONE;
+            int score = 0;
+            int depth = 0;
+            uint64_t nodes = 0;
+            std::vector<Move> pv;
+            bool terminal = false;          // no legal moves, score is 0 or mated
+        };
+
+        std::string json_string(std::string_view s) {
+
+            std::string out = "\"";
+            for (char c: s) {
+                if (c == '"' || c == '\\') out += '\\';
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char code[8];
+                    std::snprintf(code, sizeof(code), "\\u%04x", c);
+                    out += code;
+                }
+                else out += c;
+            }
+            return out + '"';
+        }
+
+        int mate_moves(int score) {
+            return score > 0? (search::VALUE_MATE - score + 1)/2: -(search::VALUE_MATE + score)/2;
+        }
+
+        // [%eval] value of a side to move score, white point of view
+        std::string eval_comment(int score, Color us) {
+
+            if (us == BLACK) score = -score;
+            char text[32];
+            if (search::is_mate_score(score)) std::snprintf(text, sizeof(text), "[%%eval #%d]", mate_moves(score));
+            else std::snprintf(text, sizeof(text), "[%%eval %.2f]", score/100.0);
+            return text;
+        }
+
+        std::string result_token(pgn::Result r) {
+            return r == pgn::WHITE_WINS? "1-0": r == pgn::BLACK_WINS? "0-1": r == pgn::DRAW? "1/2-1/2": "*";
+        }
+
+        // SAN with move numbers, a line starting with black gets "N..."
+        std::string numbered(Position pos, const std::vector<Move>& moves) {
+
+            std::string line;
+            for (size_t i=0; i<moves.size(); ++i) {
+                if (i) line += ' ';
+                if (pos.side_to_move() == WHITE || !i) line += std::to_string(pos.game_ply()/2 + 1) + (pos.side_to_move() == WHITE? ". ": "... ");
+                line += to_san(pos, moves[i]);
+                pos.do_move(moves[i]);
+            }
+            return line;
+        }
+
+        std::string san_line(Position pos, const std::vector<Move>& moves) {
+
+            std::string line;
+            for (Move m: moves) {
+                if (!line.empty()) line += ' ';
+                line += to_san(pos, m);
+                pos.do_move(m);
+            }
+            return line;
+        }
+
+        /**
+         * Movetext tokens joined into lines of at most LINE_WIDTH characters
+        */
+        class Movetext {
+        private:
+            std::string text, line;
+        public:
+            void add(const std::string& token) {
+
+                if (!line.empty() && line.size() + 1 + token.size() > LINE_WIDTH) { text += line + '\n'; line.clear(); }
+                line += (line.empty()? "": " ") + token;
+            }
+            std::string str() const { return text + line + '\n'; }
+        };
+
+        /**
+         * Every move gets the evaluation of the position it leads to, a move other than the engine's choice
+         * gets the engine line as a variation
+        */
+        std::string annotate_pgn(const Job& job, const std::vector<Analysis>& analysis) {
+
+            Position pos(job.fen);
+            Movetext text;
+            bool interrupted = true;        // a black move first or after a comment repeats its number
+            for (size_t i=0; i<job.moves.size(); ++i) {
+
+                Move m = job.moves[i];
+                const Analysis& before = analysis[i];
+                const Analysis& after = analysis[i+1];
+                Color us = pos.side_to_move();
+                std::string variation;
+                if (before.best != MOVE_NONE && before.best != m) {
+                    std::vector<Move> line = before.pv.empty()? std::vector<Move> {before.best}: before.pv;
+                    variation = '(' + numbered(pos, line) + " {" + eval_comment(before.score, us) + "})";
+                }
+                text.add(us == WHITE || interrupted? numbered(pos, {m}): to_san(pos, m));
+                pos.do_move(m);
+                interrupted = false;
+
+                // a mate speaks for itself
+                if (!after.terminal || !pos.in_check()) {
+                    text.add('{' + eval_comment(after.terminal? 0: after.score, ~us) + '}');
+                    interrupted = true;
+                }
+                if (!variation.empty()) {
+                    text.add(variation);
+                    interrupted = true;
+                }
+            }
+            text.add(result_token(job.result));
+            return job.header + '\n' + text.str() + '\n';
+        }
+
+        std::string annotate_epd(const Job& job, const Analysis& a) {
+
+            // engine operations of an earlier run are replaced
+            std::string ops;
+            std::istringstream ss(job.header);
+            for (std::string op; std::getline(ss, op, ';'); ) {
+                size_t first = op.find_first_not_of(' ');
+                if (first == std::string::npos) continue;
+                op = op.substr(first);
+                std::string code = op.substr(0, op.find(' '));
+                if (code != "acd" && code != "acn" && code != "ce" && code != "pv") ops += op + "; ";
+            }
+            std::istringstream fen(job.fen);
+            std::string fields[4];
+            fen>>fields[0]>>fields[1]>>fields[2]>>fields[3];
+            std::string line = fields[0] + ' ' + fields[1] + ' ' + fields[2] + ' ' + fields[3] + ' ' + ops
+                + "acd " + std::to_string(a.depth) + "; acn " + std::to_string(a.nodes) + "; ce " + std::to_string(a.score) + ';';
+            if (!a.pv.empty()) line += " pv " + san_line(Position(job.fen), a.pv) + ';';
+            return line + '\n';
+        }
+
+        std::string to_json(const Job& job, const std::vector<Analysis>& analysis) {
+
+            std::string out;
+            Position pos(job.fen);
+            for (size_t i=0; i<analysis.size(); ++i) {
+
+                const Analysis& a = analysis[i];
+                out += "{\"index\":" + std::to_string(job.index) + ",\"ply\":" + std::to_string(i) + ",\"fen\":" + json_string(pos.fen());
+                if (i < job.moves.size()) out += ",\"played\":\"" + to_uci(job.moves[i]) + '"';
+                if (!a.terminal) {
+                    out += ",\"best\":\"" + to_uci(a.best) + '"';
+                    out += search::is_mate_score(a.score)? ",\"mate\":" + std::to_string(mate_moves(a.score)): ",\"cp\":" + std::to_string(a.score);
+                    out += ",\"depth\":" + std::to_string(a.depth) + ",\"nodes\":" + std::to_string(a.nodes) + ",\"pv\":[";
+                    for (size_t j=0; j<a.pv.size(); ++j) out += (j? ",\"": "\"") + to_uci(a.pv[j]) + '"';
+                    out += ']';
+                }
+                else out += pos.in_check()? ",\"mate\":0": ",\"cp\":0";
+                if (job.epd && !job.header.empty()) out += ",\"operations\":" + json_string(job.header);
+                out += "}\n";
+                if (i < job.moves.size()) pos.do_move(job.moves[i]);
+            }
+            return out;
+        }
+
+        std::string header(const pgn::Game& game) {
+
+            std::string tags;
+            for (const pgn::Tag& t: game.tags) tags += '[' + std::string(t.name) + " \"" + std::string(t.value) + "\"]\n";
+            return tags;
+        }
+    }
+
+    Stats run(const Config& config, const on_progress& progress) {
+
+        if (!config.nodes && !config.movetime && !config.depth) throw std::invalid_argument("Batch analysis needs a node, time or depth limit");
+        auto start = std::chrono::steady_clock::now();
+        std::ofstream out(config.output, std::ios::binary);
+        if (!out) throw std::runtime_error("Can not open " + config.output);
+
+        // one generation for the whole batch, the workers search at the same time
+        search::TranspositionTable tt(config.hash);
+        tt.new_search();
+        search::Limits limits;
+        limits.nodes = config.nodes;
+        limits.movetime = config.movetime;
+        if (config.depth) limits.depth = config.depth;
+        unsigned int threads = pgn::thread_count(config.threads);
+
+        Stats stats;
+        std::mutex mutex;
+        std::condition_variable queue_changed, written_changed;
+        std::deque<Job> queue;
+        std::map<uint64_t, std::string> finished;       // results waiting for the ones before them
+        uint64_t produced = 0, written = 0;
+        bool input_done = false, failed = false;
+        std::exception_ptr error;
+
+        auto worker = [&] {
+
+            try {
+                auto searcher = std::make_unique<search::Searcher>(tt, true);
+                while (true) {
+
+                    Job job;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        queue_changed.wait(lock, [&] { return !queue.empty() || input_done || failed; });
+                        if (queue.empty() || failed) return;
+                        job = std::move(queue.front());
+                        queue.pop_front();
+                    }
+
+                    // positions of the game, searched from the last one back
+                    std::vector<Position> positions {Position(job.fen)};
+                    for (Move m: job.moves) {
+                        positions.push_back(positions.back());
+                        positions.back().do_move(m);
+                    }
+                    std::vector<Analysis> analysis(positions.size());
+                    uint64_t nodes = 0;
+                    for (size_t i = positions.size(); i-- > 0; ) {
+
+                        Analysis& a = analysis[i];
+                        a.terminal = !legal_moves(positions[i]).size();
+                        if (a.terminal) continue;
+                        search::Result r = searcher->think(positions[i], limits);
+                        a.best = r.best, a.score = r.score, a.depth = r.depth;
+                        a.nodes = searcher->node_count();
+                        if (!r.lines.empty()) a.pv = r.lines[0].pv;
+                        nodes += a.nodes;
+                    }
+
+                    std::string text = config.format == JSON_LINES? to_json(job, analysis)
+                                       : job.epd? annotate_epd(job, analysis[0]): annotate_pgn(job, analysis);
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    finished.emplace(job.index, std::move(text));
+                    stats.positions += positions.size();
+                    stats.nodes += nodes;
+                    for (auto it = finished.begin(); it != finished.end() && it->first == written; it = finished.erase(it)) {
+                        out<<it->second;
+                        ++written, ++stats.games;
+                    }
+                    out.flush();
+                    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+                    if (progress) progress(stats);
+                    written_changed.notify_all();
+                }
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) error = std::current_exception();
+                failed = true;
+                queue_changed.notify_all();
+                written_changed.notify_all();
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (unsigned int t=0; t<threads; ++t) pool.emplace_back(worker);
+
+        // the reader waits while the searchers are far enough behind, memory stays bounded on any input size
+        auto submit = [&] (Job&& job) {
+
+            std::unique_lock<std::mutex> lock(mutex);
+            written_changed.wait(lock, [&] { return produced - written < JOBS_PER_THREAD*threads || failed; });
+            if (failed) return;
+            job.index = produced++;
+            queue.push_back(std::move(job));
+            queue_changed.notify_one();
+        };
+
+        try {
+            if (config.input.ends_with(".epd")) {
+                std::ifstream in(config.input);
+                if (!in) throw std::runtime_error("Can not open " + config.input);
+                for (std::string line; std::getline(in, line); ) {
+
+                    std::istringstream ss(line);
+                    std::string fields[4];
+                    if (!(ss>>fields[0]>>fields[1]>>fields[2]>>fields[3])) continue;
+                    Job job;
+                    job.epd = true;
+                    job.fen = fields[0] + ' ' + fields[1] + ' ' + fields[2] + ' ' + fields[3] + " 0 1";
+                    std::getline(ss>>std::ws, job.header);
+                    try { Position check(job.fen); }
+                    catch (std::invalid_argument&) {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        ++stats.errors;
+                        continue;
+                    }
+                    submit(std::move(job));
+                }
+            }
+            else {
+                pgn::Reader reader(config.input);
+                pgn::parse(reader.text(), [&] (const pgn::Game& game, unsigned int) {
+
+                    if (!game.valid) {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        ++stats.errors;
+                        return;
+                    }
+                    Job job;
+                    job.header = header(game);
+                    job.fen = game.fen.empty()? Position::START_FEN: std::string(game.fen);
+                    job.moves = game.moves;
+                    job.result = game.result;
+                    submit(std::move(job));
+                });
+            }
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) error = std::current_exception();
+            failed = true;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            input_done = true;
+        }
+        queue_changed.notify_all();
+        for (std::thread& t: pool) t.join();
+
+        if (error) std::rethrow_exception(error);
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        return stats;
+    }
+}
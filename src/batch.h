@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/**
+ * Engine analysis of every position of a PGN or EPD file. Games and EPD lines go to a pool of
+ * searchers sharing one transposition table, a game is analysed by one searcher from its last
+ * position back so the later positions fill the table for the earlier ones
+*/
+namespace batch {
+
+    enum Format {
+        ANNOTATED,      // the input with evaluations: PGN comments and variations or EPD ce, acd, acn, pv operations
+        JSON_LINES      // one object per position
+    };
+
+    struct Config {
+        std::string input;                  // .epd, anything else is read as PGN
+        std::string output;
+        Format format = ANNOTATED;
+        uint64_t nodes = 1000000;           // per position, 0 - unlimited
+        int64_t movetime = 0;               // ms per position, 0 - unlimited
+        int depth = 0;                      // 0 - unlimited
+        unsigned int threads = 0;           // 0 - every hardware thread
+        size_t hash = 256;                  // MB, shared
+    };
+
+    struct Stats {
+        uint64_t games = 0;                 // games or EPD lines written
+        uint64_t positions = 0;
+        uint64_t nodes = 0;
+        uint64_t errors = 0;                // games with an illegal move and unreadable EPD lines, skipped
+        double seconds = 0;
+    };
+
+    using on_progress = std::function<void (const Stats& stats)>;
+
+    /**
+     * Results are written in input order as soon as the games before them are done, progress is called
+     * after every written game. Throws std::runtime_error when a file can not be opened
+    */
+    Stats run(const Config& config, const on_progress& progress = nullptr);
+}
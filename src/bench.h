@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/**
+ * Fixed workload: a list of positions searched one after another to a fixed depth on one thread
+ * with a cleared hash. The node count is the same on every machine for the same build and evaluation,
+ * a change of it means the search or the evaluation changed
+*/
+namespace bench {
+
+    constexpr int DEFAULT_DEPTH = 9;
+
+    struct Result {
+        uint64_t nodes = 0;
+        double seconds = 0;
+
+        uint64_t nps() const { return seconds > 0? static_cast<uint64_t>(nodes/seconds): 0; }
+    };
+
+    using on_position = std::function<void (int index, int total, const std::string& fen, uint64_t nodes)>;
+
+    Result run(int depth = DEFAULT_DEPTH, const on_position& progress = nullptr);
+}
@@ -0,0 +1,165 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cstdint>
+
+namespace engine {
+
+    using Bitboard = uint64_t;
+    using Key = uint64_t;
+    // a1=0, b1=1 ... h8=63
+    using Square = int;
+
+    constexpr Square NO_SQUARE = 64;
+
+    enum Color { WHITE, BLACK, COLOR_NB };
+    enum PieceType { NO_PIECE_TYPE, PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING, PIECE_TYPE_NB };
+    enum Piece { NO_PIECE,
+                 W_PAWN=1, W_KNIGHT, W_BISHOP, W_ROOK, W_QUEEN, W_KING,
+                 B_PAWN=9, B_KNIGHT, B_BISHOP, B_ROOK, B_QUEEN, B_KING, PIECE_NB=16 };
+
+    enum CastlingRights { NO_CASTLING=0, WHITE_OO=1, WHITE_OOO=2, BLACK_OO=4, BLACK_OOO=8, ANY_CASTLING=15 };
+
+    constexpr Color operator ~ (Color c) { return Color(c^1); }
+    constexpr Piece make_piece(Color c, PieceType pt) { return Piece((c<<3)|pt); }
+    constexpr PieceType type_of(Piece p) { return PieceType(p&7); }
+    constexpr Color color_of(Piece p) { return Color(p>>3); }
+
+    constexpr int file_of(Square s) { return s&7; }
+    constexpr int rank_of(Square s) { return s>>3; }
+    constexpr Square make_square(int file, int rank) { return (rank<<3)|file; }
+    constexpr int relative_rank(Color c, int rank) { return c==WHITE? rank: 7-rank; }
+    constexpr Square relative_square(Color c, Square s) { return c==WHITE? s: s^56; }
+    constexpr int pawn_push(Color c) { return c==WHITE? 8: -8; }
+
+    constexpr Bitboard FILE_A_BB = 0x0101010101010101ULL;
+    constexpr Bitboard FILE_H_BB = FILE_A_BB << 7;
+    constexpr Bitboard RANK_1_BB = 0xFFULL;
+    constexpr Bitboard RANK_8_BB = RANK_1_BB << 56;
+
+    constexpr Bitboard square_bb(Square s) { return 1ULL<<s; }
+    constexpr Bitboard file_bb(int file) { return FILE_A_BB<<file; }
+    constexpr Bitboard rank_bb(int rank) { return RANK_1_BB<<(8*rank); }
+
+    inline int popcount(Bitboard b) { return std::popcount(b); }
+    inline Square lsb(Bitboard b) { return std::countr_zero(b); }
+    inline Square msb(Bitboard b) { return 63-std::countl_zero(b); }
+    inline bool more_than_one(Bitboard b) { return b & (b-1); }
+    inline Square pop_lsb(Bitboard& b) { Square s = lsb(b); b &= b-1; return s; }
+
+    template<Color c> constexpr Bitboard pawn_attacks_bb(Bitboard b) {
+        return c==WHITE? ((b & ~FILE_A_BB) << 7) | ((b & ~FILE_H_BB) << 9)
+                       : ((b & ~FILE_A_BB) >> 9) | ((b & ~FILE_H_BB) >> 7);
+    }
+
+    namespace detail {
+        // Directions ordered so that 0..3 grow the square index and 4..7 shrink it
+        constexpr int DX[8] = { 0, 1, 1, -1,   0, -1, -1,  1};
+        constexpr int DY[8] = { 1, 0, 1,  1,  -1,  0, -1, -1};
+
+        constexpr bool on_board(int x, int y) { return x>=0 && x<8 && y>=0 && y<8; }
+
+        constexpr Bitboard step(Square s, const int (&dx)[8], const int (&dy)[8]) {
+
+            Bitboard b = 0;
+            for (int i=0; i<8; ++i) {
+                int x = file_of(s)+dx[i], y = rank_of(s)+dy[i];
+                if (on_board(x, y)) b |= square_bb(make_square(x, y));
+            }
+            return b;
+        }
+
+        constexpr auto make_rays() {
+
+            std::array<std::array<Bitboard, 64>, 8> rays {};
+            for (int d=0; d<8; ++d)
+                for (Square s=0; s<64; ++s)
+                    for (int x=file_of(s)+DX[d], y=rank_of(s)+DY[d]; on_board(x, y); x+=DX[d], y+=DY[d])
+                        rays[d][s] |= square_bb(make_square(x, y));
+            return rays;
+        }
+    }
+
+    inline constexpr auto rays = detail::make_rays();
+
+    inline constexpr auto knight_attacks = [] {
+
+        constexpr int dx[8] = {1, 2, 2, 1, -1, -2, -2, -1};
+        constexpr int dy[8] = {2, 1, -1, -2, -2, -1, 1, 2};
+        std::array<Bitboard, 64> t {};
+        for (Square s=0; s<64; ++s) t[s] = detail::step(s, dx, dy);
+        return t;
+    }();
+
+    inline constexpr auto king_attacks = [] {
+
+        std::array<Bitboard, 64> t {};
+        for (Square s=0; s<64; ++s) t[s] = detail::step(s, detail::DX, detail::DY);
+        return t;
+    }();
+
+    inline constexpr auto pawn_attacks = [] {
+
+        std::array<std::array<Bitboard, 64>, 2> t {};
+        for (Square s=0; s<64; ++s) {
+            t[WHITE][s] = pawn_attacks_bb<WHITE>(square_bb(s));
+            t[BLACK][s] = pawn_attacks_bb<BLACK>(square_bb(s));
+        }
+        return t;
+    }();
+
+    // between_bb[a][b] - squares strictly between a and b when aligned, line_bb[a][b] - the whole line through them
+    inline constexpr auto between_bb = [] {
+
+        std::array<std::array<Bitboard, 64>, 64> t {};
+        for (Square a=0; a<64; ++a)
+            for (int d=0; d<8; ++d)
+                for (Bitboard r = rays[d][a]; r; ) {
+                    Square b = std::countr_zero(r); r &= r-1;
+                    t[a][b] = rays[d][a] & rays[(d+4)%8][b];
+                }
+        return t;
+    }();
+
+    inline constexpr auto line_bb = [] {
+
+        std::array<std::array<Bitboard, 64>, 64> t {};
+        for (Square a=0; a<64; ++a)
+            for (int d=0; d<8; ++d)
+                for (Bitboard r = rays[d][a]; r; ) {
+                    Square b = std::countr_zero(r); r &= r-1;
+                    t[a][b] = rays[d][a] | rays[(d+4)%8][a] | square_bb(a);
+                }
+        return t;
+    }();
+
+    inline bool aligned(Square a, Square b, Square c) { return line_bb[a][b] & square_bb(c); }
+
+    template<int d> inline Bitboard ray_attacks(Square s, Bitboard occupied) {
+
+        Bitboard attacks = rays[d][s];
+        Bitboard blockers = attacks & occupied;
+        if (blockers) attacks ^= rays[d][d<4? lsb(blockers): msb(blockers)];
+        return attacks;
+    }
+
+    inline Bitboard bishop_attacks(Square s, Bitboard occupied) {
+        return ray_attacks<2>(s, occupied) | ray_attacks<3>(s, occupied) | ray_attacks<6>(s, occupied) | ray_attacks<7>(s, occupied);
+    }
+
+    inline Bitboard rook_attacks(Square s, Bitboard occupied) {
+        return ray_attacks<0>(s, occupied) | ray_attacks<1>(s, occupied) | ray_attacks<4>(s, occupied) | ray_attacks<5>(s, occupied);
+    }
+
+    inline Bitboard attacks_bb(PieceType pt, Square s, Bitboard occupied) {
+
+        switch (pt) {
+            case KNIGHT: return knight_attacks[s];
+            case BISHOP: return bishop_attacks(s, occupied);
+            case ROOK:   return rook_attacks(s, occupied);
+            case QUEEN:  return bishop_attacks(s, occupied) | rook_attacks(s, occupied);
+            case KING:   return king_attacks[s];
+            default:     return 0;
+        }
+    }
+}
@@ -1,5 +1,6 @@
 #include "board.h"
 #include "log.h"
+#include "trace.h"
 #include <array>
 #include <sstream>
 #include <algorithm>
@@ -144,6 +145,7 @@ namespace filter {
 
     void Board::apply () {
         
+        TRACE_SCOPE("render", "Board::apply")
         CALLGL(glUseProgram(PR))
         CALLGL(glUniform1uiv(position_location, cells, position))
 
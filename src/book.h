@@ -0,0 +1,70 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "position.h"
+#include "mapped_file.h"
+#include "pgn.h"
+
+namespace book {
+
+    /**
+     * Polyglot book entry, stored big endian, 16 bytes, entries sorted by key
+    */
+    struct Entry {
+        uint64_t key;
+        uint16_t move;
+        uint16_t weight;
+        uint32_t learn;
+    };
+
+    struct BookMove {
+        engine::Move move;
+        uint16_t weight;
+    };
+
+    /**
+     * Key of the position with the Random64 table of the polyglot sources, books made by other
+     * tools can be read
+    */
+    engine::Key polyglot_key(const engine::Position& pos);
+
+    engine::Move from_polyglot(const engine::Position& pos, uint16_t move);
+    uint16_t to_polyglot(engine::Move m);
+
+    class Book {
+    private:
+        io::MappedFile file;
+        size_t count = 0;
+        int max_ply;
+
+        Entry entry(size_t i) const;
+    public:
+        /**
+         * Throws std::runtime_error when the file is missing or its size is not a multiple of 16
+        */
+        explicit Book(const std::string& path, int max_ply = 40);
+
+        void set_max_ply(int ply) { max_ply = ply; }
+        size_t size() const { return count; }
+
+        /**
+         * Legal book moves of the position, best weight first
+        */
+        std::vector<BookMove> probe(const engine::Position& pos) const;
+
+        /**
+         * Random book move, chance proportional to weight. MOVE_NONE out of book or past max_ply.
+         * Safe to call from several threads
+        */
+        engine::Move pick(const engine::Position& pos) const;
+    };
+
+    /**
+     * Creates a book from the first max_ply plies of the games, weight = 2*wins + draws of the
+     * side to move, moves seen in fewer than min_games games are dropped
+    */
+    pgn::Stats build(const std::string& pgn_path, const std::string& book_path,
+                     unsigned int threads, int max_ply = 40, uint32_t min_games = 2);
+}
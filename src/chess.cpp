@@ -9,6 +9,8 @@
 #include <cassert>
 #include <utility>
 #include "log.h"
+#include "notation.h"
+#include "trace.h"
 
 namespace chess {
 
@@ -189,6 +191,7 @@ namespace chess {
         king_pos            = whites_? 60: 59;
         enemy_king          = whites_? 4: 3;
         availables.reserve(64);
+        moves.clear();
         if (whites_) std::copy(init_position.begin(), init_position.end(), position.begin());
         else std::copy(init_position.rbegin(), init_position.rend(), position.begin());
         
@@ -412,6 +415,7 @@ namespace chess {
 
     bool on_choose_begin (States state, int x, int y, int pos) {
 
+        TRACE_SCOPE("ui", "move generation")
         switch (state&0xFF) {
 
             case B_ROOK:    return whites_? false           : rook(x, y);
@@ -506,15 +510,10 @@ namespace chess {
         position[where] += move_bit;
     }
 
-    void on_choose_end(unsigned int where, unsigned int from, char rank) {
-
-        std::for_each(availables.begin(), availables.end(), 
-                        [] (unsigned int v) { position[v] &= ~availabe_bit; });
-
-        if (std::find(availables.begin(), availables.end(), where) == availables.end()) return;
-
-        Choose choose = do_move (where, start_pos);
-        write_move (choose, start_pos, where, rank);
+    /**
+     * Check marks, last move highlight and the listener, shared by moves from the board and from play_move
+    */
+    void own_move_done (unsigned int where, unsigned int from) {
 
         if (king_pos==from) { king_pos = where; castling_enabled=false; }
 
@@ -527,7 +526,19 @@ namespace chess {
         wait = !wait;       // wait for opponent
 
         LOGD("\t%s:\t%s", state_to_str(moves.rbegin()->state).c_str(), moves.rbegin()->move.c_str()) 
-    }    
+    }
+
+    void on_choose_end(unsigned int where, unsigned int from, char rank) {
+
+        std::for_each(availables.begin(), availables.end(), 
+                        [] (unsigned int v) { position[v] &= ~availabe_bit; });
+
+        if (std::find(availables.begin(), availables.end(), where) == availables.end()) return;
+
+        Choose choose = do_move (where, start_pos);
+        write_move (choose, start_pos, where, rank);
+        own_move_done (where, from);
+    }
 
     /**
      * 
@@ -536,6 +547,7 @@ namespace chess {
     */
     void on_select_cell (int x, int y) {
         
+        TRACE_SCOPE("ui", "on_select_cell")
         if (wait) return;
         position[last_selected] &= ~selected_bit;
         routine.next(y*BOARD_SIZE+x);
@@ -547,6 +559,7 @@ namespace chess {
 */
     void opponent_move (std::string_view move) {
 
+        TRACE_SCOPE("ui", "opponent_move")
         unsigned int from=0, where=0;
         bool old_castling;
         int old_king_pos;
@@ -601,7 +614,81 @@ namespace chess {
         LOGD("Opponent: \t%s:\t%s", state_to_str(moves.rbegin()->state).c_str(), moves.rbegin()->move.c_str()) 
     }
 
+    /**
+     * Own move in network notation, made without the mouse
+    */
+    void play_move (std::string_view move) {
+
+        unsigned int from=0, where=0;
+        bool castling = move.starts_with("0-0");
+
+        if (castling) {
+            bool long_castling = move.compare("0-0-0") == 0;
+            from = whites_? 60: 59;
+            where = whites_? (long_castling? 58: 62): (long_castling? 61: 57);
+        } else {
+            if (whites_) {
+                from  = ('8'-move[1]) * BOARD_SIZE + (move[0]-'a');
+                where = ('8'-move[3]) * BOARD_SIZE + (move[2]-'a');
+            } else {
+                from  = (move[1]-'1') * BOARD_SIZE + ('h'-move[0]);
+                where = (move[3]-'1') * BOARD_SIZE + ('h'-move[2]);
+            }
+            if (move.size()>4) {
+                switch(move[4]) {
+                    case 'Q': position[from]=whites_? W_QUEEN: B_QUEEN; break;
+                    case 'R': position[from]=whites_? W_ROOK: B_ROOK; break;
+                    case 'B': position[from]=whites_? W_BISHOP: B_BISHOP; break;
+                    case 'K': position[from]=whites_? W_KNIGHT: B_KNIGHT; break;
+                    default: break;
+                }
+            }
+        }
+        do_move (where, from);
+        moves.emplace_back (States(position[where]&0xFF), std::string(move));
+        own_move_done (where, from);
+    }
+
+    /**
+     * Moves of the current game in the same notation they are sent over the network
+    */
+    std::vector<std::string> history() {
+
+        std::vector<std::string> result;
+        for (const Move& m: moves) result.emplace_back(m.move.c_str());
+        return result;
+    }
+
     void clear() {
 
     }
+
+    engine::Move to_engine_move (const engine::Position& pos, std::string_view move) {
+
+        if (move.starts_with("0-0-0")) return engine::from_san(pos, "O-O-O");
+        if (move.starts_with("0-0")) return engine::from_san(pos, "O-O");
+        if (move.size() < 4) return engine::MOVE_NONE;
+
+        std::string uci(move.substr(0, 4));
+        if (move.size() > 4) {
+            switch (move[4]) {
+                case 'Q': uci += 'q'; break;
+                case 'R': uci += 'r'; break;
+                case 'B': uci += 'b'; break;
+                case 'K': uci += 'n'; break;
+                default: break;
+            }
+        }
+        return engine::from_uci(pos, uci);
+    }
+
+    std::string to_network_move (engine::Move m) {
+
+        if (engine::type_of(m) == engine::CASTLING)
+            return engine::to_sq(m) > engine::from_sq(m)? "0-0": "0-0-0";
+
+        std::string move = engine::to_uci(m).substr(0, 4);
+        if (engine::type_of(m) == engine::PROMOTION) move += "KBRQ"[engine::promotion_type(m)-engine::KNIGHT];
+        return move;
+    }
 }
\ No newline at end of file
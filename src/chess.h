@@ -1,7 +1,9 @@
 #pragma once
 #include <array>
 #include <string>
+#include <vector>
 #include <functional>
+#include "position.h"
 
 namespace chess {
     
@@ -14,5 +16,17 @@ namespace chess {
     void init(bool whites, on_move listener, on_move_coord opponent_move_listener);
     void on_select_cell (int x, int y);
     void opponent_move (std::string_view move);
+    void play_move (std::string_view move);
+    std::vector<std::string> history();
     void clear();
+
+    /**
+     * Convert move from network notation (e2e4, e7e8Q, 0-0) into engine move
+    */
+    engine::Move to_engine_move (const engine::Position& pos, std::string_view move);
+
+    /**
+     * Engine move in network notation, the reverse of to_engine_move
+    */
+    std::string to_network_move (engine::Move m);
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <functional>
 #include <boost/asio.hpp>
 #include "log.h"
+#include "trace.h"
 
 namespace net {
 
@@ -45,9 +46,11 @@ namespace net {
         
         void send_message(std::string_view message) {
             
+            TRACE_SCOPE("net", "send")
             boost::asio::async_write(client_sock, boost::asio::buffer(message), 
                 [this] (const boost::system::error_code& er, size_t write) {
                  
+                    TRACE_SCOPE("net", "send done")
                     if (er) {
                         if (er.value() == boost::asio::error::operation_aborted) return;
                         else { error_callback(er); return; }
@@ -63,6 +66,7 @@ namespace net {
             boost::asio::async_read_until(client_sock, buffer, "\0", 
                 [this] (const boost::system::error_code& er, size_t) {
 
+                    TRACE_SCOPE("net", "receive")
                     if (er) {
                         if (er.value() == boost::asio::error::operation_aborted) return;
                         else { error_callback(er); return; }
@@ -0,0 +1,285 @@
+#include "datagen.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include "movegen.h"
+#include "pgn.h"
+#include "search.h"
+#include "tb.h"
+
+namespace datagen {
+
+    using namespace engine;
+
+    namespace {
+
+        using Clock = std::chrono::steady_clock;
+
+        constexpr size_t WRITE_BATCH = 4096;        // records a game thread collects before writing
+
+        bool insufficient_material(const Position& pos) {
+
+            return !pos.pieces(PAWN) && !pos.pieces(ROOK, QUEEN) && popcount(pos.pieces()) <= 3;
+        }
+    }
+
+    PackedPosition PackedPosition::pack(const Position& pos, int score, int result) {
+
+        PackedPosition p {};
+        p.occupied = pos.pieces();
+        int i = 0;
+        for (Bitboard b = p.occupied; b; ++i) p.pieces[i/2] |= pos.piece_on(pop_lsb(b)) << (i%2*4);
+        p.score = static_cast<int16_t>(std::clamp(score, -32767, 32767));
+        p.ply = static_cast<uint16_t>(std::min(pos.game_ply(), 65535));
+        p.flags = static_cast<uint8_t>(pos.side_to_move() | pos.castling_rights() << 1);
+        p.ep = static_cast<uint8_t>(pos.ep_square());
+        p.rule50 = static_cast<uint8_t>(std::min(pos.rule50(), 255));
+        p.result = static_cast<int8_t>(result);
+        return p;
+    }
+
+    std::string PackedPosition::fen() const {
+
+        constexpr const char* PIECE_CHARS = " PNBRQK  pnbrqk";
+        Piece board[64] {};
+        int i = 0;
+        for (Bitboard b = occupied; b; ++i) board[pop_lsb(b)] = Piece(pieces[i/2] >> (i%2*4) & 15);
+
+        std::string fen;
+        for (int rank=7; rank>=0; --rank) {
+            int empty = 0;
+            for (int file=0; file<8; ++file) {
+                Piece pc = board[make_square(file, rank)];
+                if (pc == NO_PIECE) { ++empty; continue; }
+                if (empty) fen += static_cast<char>('0'+empty), empty = 0;
+                fen += PIECE_CHARS[pc];
+            }
+            if (empty) fen += static_cast<char>('0'+empty);
+            if (rank) fen += '/';
+        }
+        fen += side_to_move() == WHITE? " w ": " b ";
+        int castling = flags >> 1 & ANY_CASTLING;
+        if (!castling) fen += '-';
+        for (int c=0; c<4; ++c) if (castling & 1 << c) fen += "KQkq"[c];
+        if (ep == NO_SQUARE) fen += " -";
+        else fen += {' ', static_cast<char>('a'+file_of(ep)), static_cast<char>('1'+rank_of(ep))};
+        return fen + ' ' + std::to_string(rule50) + ' ' + std::to_string(ply/2 + 1);
+    }
+
+    Writer::Writer(const std::string& path) {
+
+        bool fresh = !std::filesystem::exists(path) || std::filesystem::file_size(path) == 0;
+        if (!fresh) {
+            Header header;
+            std::ifstream in(path, std::ios::binary);
+            if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0
+                || header.version != VERSION || header.record_size != sizeof(PackedPosition))
+                throw std::runtime_error("Not a training data file or unsupported version: " + path);
+        }
+        out.open(path, std::ios::binary | std::ios::app);
+        if (!out) throw std::runtime_error("Can not open " + path);
+        if (fresh) {
+            Header header {};
+            std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+            header.version = VERSION;
+            header.record_size = sizeof(PackedPosition);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        }
+    }
+
+    void Writer::write(const std::vector<PackedPosition>& records) {
+
+        std::lock_guard<std::mutex> lock(mutex);
+        out.write(reinterpret_cast<const char*>(records.data()), records.size()*sizeof(PackedPosition));
+        out.flush();
+        if (!out) throw std::runtime_error("Could not write training data");
+        written += records.size();
+    }
+
+    Reader::Reader(const std::string& path, size_t batch_size, size_t window, uint64_t seed):
+            file(path, io::MappedFile::RANDOM), batch_size{std::max<size_t>(batch_size, 1)}, window{std::max(window, CHUNK)}, rng{seed} {
+
+        const Header* header = reinterpret_cast<const Header*>(file.data());
+        if (file.size() < sizeof(Header) || std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0
+            || header->version != VERSION || header->record_size != sizeof(PackedPosition))
+            throw std::runtime_error("Not a training data file or unsupported version: " + path);
+
+        // a record cut short by an interrupted run is ignored
+        records = reinterpret_cast<const PackedPosition*>(file.data() + sizeof(Header));
+        count = (file.size() - sizeof(Header))/sizeof(PackedPosition);
+        for (size_t first = 0; first < count; first += CHUNK) chunks.push_back(first);
+        rewind();
+    }
+
+    void Reader::rewind() {
+
+        std::shuffle(chunks.begin(), chunks.end(), rng);
+        next_chunk = 0;
+        buffer.clear();
+        buffer_pos = 0;
+    }
+
+    void Reader::refill() {
+
+        buffer.clear();
+        buffer_pos = 0;
+        for (; next_chunk < chunks.size() && buffer.size() < window; ++next_chunk) {
+            size_t first = chunks[next_chunk];
+            buffer.insert(buffer.end(), records + first, records + std::min(first + CHUNK, count));
+        }
+        std::shuffle(buffer.begin(), buffer.end(), rng);
+    }
+
+    bool Reader::next(std::vector<PackedPosition>& batch) {
+
+        if (buffer_pos == buffer.size()) refill();
+        if (buffer.empty()) return false;
+        size_t n = std::min(batch_size, buffer.size() - buffer_pos);
+        batch.assign(buffer.begin() + buffer_pos, buffer.begin() + buffer_pos + n);
+        buffer_pos += n;
+        return true;
+    }
+
+    namespace {
+
+        struct Game {
+            std::vector<PackedPosition> positions;      // result not set yet
+            pgn::Result result = pgn::DRAW;
+        };
+
+        /**
+         * Random moves from the start position until the search finds the position playable
+        */
+        Position random_opening(search::Searcher& searcher, const Config& config, std::mt19937_64& rng) {
+
+            search::Limits limits;
+            limits.depth = std::min(config.depth, 6);
+            while (true) {
+                Position pos;
+                int ply = 0;
+                for (; ply < config.random_plies; ++ply) {
+                    MoveList list = legal_moves(pos);
+                    if (!list.size()) break;
+                    pos.do_move(list.moves[rng() % list.size()]);
+                }
+                if (ply < config.random_plies || !legal_moves(pos).size()) continue;
+                if (std::abs(searcher.think(pos, limits).score) <= config.opening_score) return pos;
+            }
+        }
+
+        Game play_game(search::Searcher& searcher, search::TranspositionTable& tt, const Config& config, std::mt19937_64& rng) {
+
+            Game game;
+            tt.clear();
+            Position pos = random_opening(searcher, config, rng);
+            std::unordered_map<Key, int> seen {{pos.key(), 1}};
+            int win_plies = 0, win_sign = 0, draw_plies = 0;
+            auto loss = [] (Color c) { return c == WHITE? pgn::BLACK_WINS: pgn::WHITE_WINS; };
+
+            search::Limits limits;
+            if (config.nodes) limits.nodes = config.nodes;
+            else limits.depth = config.depth;
+
+            while (true) {
+
+                Color us = pos.side_to_move();
+                if (!legal_moves(pos).size()) { game.result = pos.in_check()? loss(us): pgn::DRAW; return game; }
+                if (pos.rule50() >= 100 || seen[pos.key()] >= 3 || insufficient_material(pos) || pos.game_ply() >= config.max_ply)
+                    return game;
+                if (!pos.castling_rights() && popcount(pos.pieces()) <= tb::max_pieces()) {
+                    tb::WDL wdl;
+                    if (tb::probe_wdl(pos, wdl)) {
+                        game.result = wdl == tb::WDL_DRAW? pgn::DRAW: wdl == tb::WDL_LOSS? loss(us): loss(~us);
+                        return game;
+                    }
+                }
+
+                search::Result r = searcher.think(pos, limits);
+                if (r.best == MOVE_NONE) return game;
+
+                // quiet positions only, the score of a tactical one is not what its evaluation sees
+                bool tactical = pos.in_check() || pos.capture(r.best) || type_of(r.best) == PROMOTION;
+                if (!tactical && std::abs(r.score) < search::VALUE_TB_WIN_IN_MAX_PLY)
+                    game.positions.push_back(PackedPosition::pack(pos, r.score, 0));
+
+                int white = us == WHITE? r.score: -r.score;
+                int sign = white > 0? 1: -1;
+                win_plies = std::abs(white) >= config.adjudicate_score? (sign == win_sign? win_plies+1: 1): 0;
+                win_sign = sign;
+                draw_plies = pos.game_ply() >= config.draw_ply && std::abs(white) <= 10? draw_plies+1: 0;
+                if (win_plies >= config.adjudicate_plies) {
+                    game.result = white > 0? pgn::WHITE_WINS: pgn::BLACK_WINS;
+                    return game;
+                }
+                if (draw_plies >= config.adjudicate_plies) return game;
+
+                pos.do_move(r.best);
+                ++seen[pos.key()];
+            }
+        }
+    }
+
+    Stats generate(const Config& config, const on_progress& progress) {
+
+        auto start = Clock::now();
+        Writer writer(config.output);
+        Stats stats;
+        std::mutex mutex;
+        std::atomic<uint64_t> next {0};
+        std::atomic<bool> failed {false};
+        std::exception_ptr error;
+
+        auto worker = [&] (unsigned int index) {
+
+            try {
+                std::mt19937_64 rng(config.seed? config.seed + index: std::random_device{}() ^ (uint64_t(index) << 32));
+                search::TranspositionTable tt(config.hash);
+                auto searcher = std::make_unique<search::Searcher>(tt);
+                std::vector<PackedPosition> pending;
+
+                while (!failed && next++ < config.games) {
+
+                    Game game = play_game(*searcher, tt, config, rng);
+                    int white = game.result == pgn::WHITE_WINS? 1: game.result == pgn::BLACK_WINS? -1: 0;
+                    for (PackedPosition& p: game.positions) {
+                        p.result = static_cast<int8_t>(p.side_to_move() == WHITE? white: -white);
+                        pending.push_back(p);
+                    }
+                    if (pending.size() >= WRITE_BATCH) {
+                        writer.write(pending);
+                        pending.clear();
+                    }
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ++stats.games;
+                    stats.positions += game.positions.size();
+                    (white > 0? stats.white_wins: white < 0? stats.black_wins: stats.draws)++;
+                    stats.seconds = std::chrono::duration<double>(Clock::now()-start).count();
+                    if (progress) progress(stats);
+                }
+                if (!pending.empty()) writer.write(pending);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) error = std::current_exception();
+                failed = true;
+            }
+        };
+
+        unsigned int threads = static_cast<unsigned int>(std::min<uint64_t>(pgn::thread_count(config.threads), std::max<uint64_t>(config.games, 1)));
+        std::vector<std::thread> pool;
+        for (unsigned int t=1; t<threads; ++t) pool.emplace_back(worker, t);
+        worker(0);
+        for (std::thread& t: pool) t.join();
+
+        if (error) std::rethrow_exception(error);
+        stats.seconds = std::chrono::duration<double>(Clock::now()-start).count();
+        return stats;
+    }
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#include "mapped_file.h"
+#include "position.h"
+
+/**
+ * Self-play training data. Games start with random moves, every quiet position of a game is labelled
+ * with the search score and the game result
+*/
+namespace datagen {
+
+    /**
+     * File layout, all integers little endian: Header, then PackedPosition records back to back
+     * in the order they were written. Runs append to an existing file
+    */
+    constexpr char MAGIC[8] = {'C', 'H', 'S', 'D', 'A', 'T', 'A', '1'};
+    constexpr uint32_t VERSION = 1;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t record_size;
+    };
+
+    /**
+     * 32 byte position with its labels. Pieces are 4 bit codes in square order, one per bit of occupied,
+     * the low nibble first
+    */
+    struct PackedPosition {
+        uint64_t occupied;
+        uint8_t pieces[16];
+        int16_t score;          // cp, side to move point of view
+        uint16_t ply;
+        uint8_t flags;          // bit 0 side to move, bits 1-4 castling rights
+        uint8_t ep;             // 64 - none
+        uint8_t rule50;
+        int8_t result;          // side to move point of view: 1 win, 0 draw, -1 loss
+
+        static PackedPosition pack(const engine::Position& pos, int score, int result);
+        engine::Color side_to_move() const { return engine::Color(flags & 1); }
+        std::string fen() const;
+        engine::Position position() const { return engine::Position(fen()); }
+    };
+    static_assert(sizeof(PackedPosition) == 32);
+
+    /**
+     * Appends records to a data file from any thread
+    */
+    class Writer {
+    private:
+        std::ofstream out;
+        std::mutex mutex;
+        std::atomic<uint64_t> written {0};
+    public:
+        /**
+         * Throws std::runtime_error when the file can not be opened or is not a data file
+        */
+        explicit Writer(const std::string& path);
+
+        void write(const std::vector<PackedPosition>& records);
+        uint64_t size() const { return written; }
+    };
+
+    /**
+     * Batches of records for training. The file is visited in chunks of consecutive records taken in random
+     * order, a window of several chunks is shuffled before it is split into batches
+    */
+    class Reader {
+    private:
+        io::MappedFile file;
+        const PackedPosition* records {nullptr};
+        size_t count = 0;
+        size_t batch_size, window;
+        std::mt19937_64 rng;
+        std::vector<size_t> chunks;         // first record of every chunk, in visiting order
+        size_t next_chunk = 0;
+        std::vector<PackedPosition> buffer;
+        size_t buffer_pos = 0;
+
+        void refill();
+    public:
+        static constexpr size_t CHUNK = 4096;      // records read together
+
+        /**
+         * Throws std::runtime_error when the file is missing or not a data file
+        */
+        explicit Reader(const std::string& path, size_t batch_size = 16384, size_t window = 1 << 20, uint64_t seed = 0);
+
+        size_t size() const { return count; }
+
+        /**
+         * Fills the next batch, the last one of a pass may be smaller. False when the pass is over
+        */
+        bool next(std::vector<PackedPosition>& batch);
+
+        /**
+         * Starts another pass in a new order
+        */
+        void rewind();
+    };
+
+    struct Config {
+        std::string output;
+        uint64_t games = 1000;
+        unsigned int threads = 0;           // 0 - every hardware thread
+        int depth = 8;
+        uint64_t nodes = 0;                 // per move instead of depth when set
+        int random_plies = 8;               // uniformly random opening moves
+        int opening_score = 300;            // cp, openings searched outside the window are replaced
+        int adjudicate_score = 2500;        // cp, held for adjudicate_plies plies wins the game
+        int adjudicate_plies = 8;
+        int draw_ply = 80;                  // draw when the score stays within 10cp for adjudicate_plies plies after it
+        int max_ply = 400;
+        size_t hash = 16;                   // MB per thread
+        uint64_t seed = 0;
+    };
+
+    struct Stats {
+        uint64_t games = 0;
+        uint64_t positions = 0;
+        uint64_t white_wins = 0, draws = 0, black_wins = 0;
+        double seconds = 0;
+    };
+
+    using on_progress = std::function<void (const Stats& stats)>;
+
+    /**
+     * Plays config.games games on the worker threads and appends their positions to config.output.
+     * Progress is called after every game from the game threads one at a time
+    */
+    Stats generate(const Config& config, const on_progress& progress = nullptr);
+}
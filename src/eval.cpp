@@ -0,0 +1,194 @@
+#include "eval.h"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include "nnue.h"
+#include "pawns.h"
+
+namespace eval {
+
+    using namespace engine;
+
+    namespace {
+
+        constexpr const char* PARAMS_MAGIC = "chess-eval-params-v1";
+
+        constexpr int absolute(int v) { return v < 0? -v: v; }
+
+        // distance from the board center in half squares, 2 on d4-e5 up to 14 in the corners
+        constexpr int center_distance(Square s) { return absolute(2*file_of(s)-7) + absolute(2*rank_of(s)-7); }
+
+        constexpr Params DEFAULTS = [] {
+
+            Params p {};
+            p.material[PAWN]   = {100, 120};
+            p.material[KNIGHT] = {320, 300};
+            p.material[BISHOP] = {330, 310};
+            p.material[ROOK]   = {500, 540};
+            p.material[QUEEN]  = {960, 1010};
+
+            for (Square s=0; s<64; ++s) {
+                int f = file_of(s), r = rank_of(s), d = center_distance(s);
+                bool central_file = f == 3 || f == 4;
+                if (r > 0 && r < 7) p.psqt[PAWN][s] = {(r-1)*4 + (central_file && (r == 3 || r == 4)? 15: 0), (r-1)*10};
+                p.psqt[KNIGHT][s] = {30 - 5*d, 20 - 4*d};
+                p.psqt[BISHOP][s] = {12 - 2*d, 10 - 2*d};
+                p.psqt[ROOK][s]   = {(r == 6? 20: 0) + (central_file? 5: 0), r == 6? 10: 0};
+                p.psqt[QUEEN][s]  = {6 - d, 25 - 3*d};
+                p.psqt[KING][s]   = {(r == 0? 10: -15*r) + (f <= 2 || f >= 6? 15: -10), 30 - 6*d};
+            }
+
+            constexpr int average[PIECE_TYPE_NB] = {0, 0, 4, 6, 7, 13, 0};
+            constexpr Score weight[PIECE_TYPE_NB] = {{}, {}, {4, 4}, {5, 5}, {2, 4}, {1, 2}, {}};
+            for (PieceType pt: {KNIGHT, BISHOP, ROOK, QUEEN})
+                for (int n=0; n<MOBILITY_MAX; ++n) p.mobility[pt][n] = weight[pt] * (n-average[pt]);
+
+            p.king_zone_attack[KNIGHT] = {-8, 0};
+            p.king_zone_attack[BISHOP] = {-8, 0};
+            p.king_zone_attack[ROOK]   = {-12, 0};
+            p.king_zone_attack[QUEEN]  = {-20, 0};
+            p.pawn_shield = {12, 0};
+
+            constexpr Score passed[8] = {{0, 0}, {5, 10}, {10, 20}, {15, 35}, {25, 60}, {40, 90}, {60, 130}, {0, 0}};
+            for (int r=0; r<8; ++r) p.passed_pawn[r] = passed[r];
+            p.passed_blocked = {-5, -20};
+            p.doubled_pawn = {-10, -20};
+            p.isolated_pawn = {-10, -15};
+            p.backward_pawn = {-8, -10};
+            p.bishop_pair = {30, 50};
+            p.tempo = {15, 5};
+            return p;
+        }();
+
+        constexpr auto make_psq(const Params& p) {
+
+            std::array<std::array<Score, 64>, PIECE_NB> t {};
+            for (PieceType pt: {PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING})
+                for (Square s=0; s<64; ++s) {
+                    t[make_piece(WHITE, pt)][s] = p.material[pt] + p.psqt[pt][s];
+                    t[make_piece(BLACK, pt)][s ^ 56] = -(p.material[pt] + p.psqt[pt][s]);
+                }
+            return t;
+        }
+
+        Score pieces_score(const Position& pos, Color c, Trace* trace) {
+
+            Score score;
+            int sign = c == WHITE? 1: -1;
+            Bitboard occupied = pos.pieces();
+            Bitboard enemy_pawn_attacks = c == WHITE? pawn_attacks_bb<BLACK>(pos.pieces(BLACK, PAWN)): pawn_attacks_bb<WHITE>(pos.pieces(WHITE, PAWN));
+            Bitboard area = ~pos.pieces(c) & ~enemy_pawn_attacks;
+            Square enemy_king = pos.king_square(~c);
+            Bitboard king_zone = king_attacks[enemy_king] | square_bb(enemy_king);
+
+            for (PieceType pt: {KNIGHT, BISHOP, ROOK, QUEEN})
+                for (Bitboard b = pos.pieces(c, pt); b; ) {
+                    Bitboard attacks = attacks_bb(pt, pop_lsb(b), occupied);
+                    int mobility = popcount(attacks & area), zone = popcount(attacks & king_zone);
+                    score += params.mobility[pt][mobility];
+                    score -= params.king_zone_attack[pt] * zone;
+                    if (trace) {
+                        trace->add(params.mobility[pt][mobility], sign);
+                        trace->add(params.king_zone_attack[pt], -sign*zone);
+                    }
+                }
+
+            if (more_than_one(pos.pieces(c, BISHOP))) {
+                score += params.bishop_pair;
+                if (trace) trace->add(params.bishop_pair, sign);
+            }
+            return score;
+        }
+
+        // the classical evaluation, with a trace every term is counted on the way
+        int evaluate_classical(const Position& pos, PawnTable* pawns, Trace* trace) {
+
+            PawnEntry local;
+            PawnEntry* pe = &local;
+            if (pawns) pe = &pawns->probe(pos);
+            else evaluate_pawns(pos, local, trace);
+
+            Score score = pos.psq_score() + pe->score;
+            score += pe->king_shelter(pos, WHITE, trace) - pe->king_shelter(pos, BLACK, trace);
+            for (Color c: {WHITE, BLACK})
+                for (Bitboard b = pe->passed[c]; b; )
+                    if (!pos.empty(pop_lsb(b) + pawn_push(c))) {
+                        score += c == WHITE? params.passed_blocked: -params.passed_blocked;
+                        if (trace) trace->add(params.passed_blocked, c == WHITE? 1: -1);
+                    }
+            score += pieces_score(pos, WHITE, trace) - pieces_score(pos, BLACK, trace);
+            score += pos.side_to_move() == WHITE? params.tempo: -params.tempo;
+
+            int phase = popcount(pos.pieces(KNIGHT, BISHOP)) + 2*popcount(pos.pieces(ROOK)) + 4*popcount(pos.pieces(QUEEN));
+            phase = std::min(phase, PHASE_MAX);
+            if (trace) {
+                for (Bitboard b = pos.pieces(); b; ) {
+                    Square s = pop_lsb(b);
+                    Piece pc = pos.piece_on(s);
+                    int sign = color_of(pc) == WHITE? 1: -1;
+                    trace->add(params.material[type_of(pc)], sign);
+                    trace->add(params.psqt[type_of(pc)][relative_square(color_of(pc), s)], sign);
+                }
+                trace->add(params.tempo, pos.side_to_move() == WHITE? 1: -1);
+                trace->phase = phase;
+            }
+            int value = (score.mg*phase + score.eg*(PHASE_MAX-phase)) / PHASE_MAX;
+            return pos.side_to_move() == WHITE? value: -value;
+        }
+    }
+
+    Params params = DEFAULTS;
+    std::array<std::array<Score, 64>, PIECE_NB> psq = make_psq(DEFAULTS);
+
+    Params default_params() {
+
+        return DEFAULTS;
+    }
+
+    void update_psq() {
+
+        psq = make_psq(params);
+    }
+
+    void load_params(const std::string& path) {
+
+        std::ifstream in(path);
+        if (!in) throw std::runtime_error("Could not open evaluation weights " + path);
+        std::string magic;
+        int count = 0;
+        Params p;
+        int* values = reinterpret_cast<int*>(&p);
+        in>>magic>>count;
+        if (magic != PARAMS_MAGIC || count != PARAM_COUNT) throw std::runtime_error("Not a compatible weights file: " + path);
+        for (int i=0; i<PARAM_COUNT; ++i)
+            if (!(in>>values[i])) throw std::runtime_error("Weights file is truncated: " + path);
+        params = p;
+        update_psq();
+    }
+
+    void save_params(const std::string& path, const Params& p) {
+
+        std::ofstream out(path);
+        const int* values = reinterpret_cast<const int*>(&p);
+        out<<PARAMS_MAGIC<<' '<<PARAM_COUNT<<'\n';
+        for (int i=0; i<PARAM_COUNT; i+=2) out<<values[i]<<' '<<values[i+1]<<'\n';
+        if (!out) throw std::runtime_error("Could not write evaluation weights " + path);
+    }
+
+    Trace trace(const Position& pos) {
+
+        Trace t;
+        evaluate_classical(pos, nullptr, &t);
+        return t;
+    }
+
+    int classical(const Position& pos, PawnTable* pawns) {
+
+        return evaluate_classical(pos, pawns, nullptr);
+    }
+
+    int evaluate(const Position& pos, PawnTable* pawns) {
+
+        return nnue::loaded()? nnue::evaluate(pos): classical(pos, pawns);
+    }
+}
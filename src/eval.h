@@ -0,0 +1,94 @@
+#pragma once
+#include <string>
+#include "bitboard.h"
+
+namespace engine { class Position; }
+
+namespace eval {
+
+    class PawnTable;
+
+    constexpr int PIECE_VALUE[engine::PIECE_TYPE_NB] = {0, 100, 320, 330, 500, 900, 0};
+
+    /**
+     * Middlegame and endgame part of a term, blended by the game phase
+    */
+    struct Score {
+        int mg = 0, eg = 0;
+
+        constexpr Score operator + (Score o) const { return {mg+o.mg, eg+o.eg}; }
+        constexpr Score operator - (Score o) const { return {mg-o.mg, eg-o.eg}; }
+        constexpr Score operator - () const { return {-mg, -eg}; }
+        constexpr Score operator * (int n) const { return {mg*n, eg*n}; }
+        constexpr Score& operator += (Score o) { mg += o.mg, eg += o.eg; return *this; }
+        constexpr Score& operator -= (Score o) { mg -= o.mg, eg -= o.eg; return *this; }
+    };
+
+    constexpr int PHASE_MAX = 24;               // knight, bishop 1, rook 2, queen 4
+    constexpr int MOBILITY_MAX = 28;
+
+    /**
+     * Every weight of the classical evaluation from white's point of view, squares of white pieces.
+     * Made of Score values only so a tuner can walk it as a flat array of ints
+    */
+    struct Params {
+        Score material[engine::PIECE_TYPE_NB];
+        Score psqt[engine::PIECE_TYPE_NB][64];
+        Score mobility[engine::PIECE_TYPE_NB][MOBILITY_MAX];   // by reachable squares, knight to queen
+        Score king_zone_attack[engine::PIECE_TYPE_NB];         // per square attacked next to the king, for its side
+        Score pawn_shield;                                     // per own pawn in front of the king
+        Score passed_pawn[8];                                  // by relative rank
+        Score passed_blocked;                                  // stop square occupied
+        Score doubled_pawn;
+        Score isolated_pawn;
+        Score backward_pawn;
+        Score bishop_pair;
+        Score tempo;
+    };
+
+    constexpr int PARAM_COUNT = sizeof(Params)/sizeof(int);
+    constexpr int SCORE_COUNT = sizeof(Params)/sizeof(Score);
+
+    Params default_params();
+
+    /**
+     * Weights in use. After changing them call update_psq(), positions set up afterwards
+     * carry the new material and piece-square sums
+    */
+    extern Params params;
+    void update_psq();
+
+    /**
+     * Text file with a "mg eg" line per Score of Params in declaration order after a header line.
+     * load_params() replaces the weights in use, both throw std::runtime_error on failure
+    */
+    void load_params(const std::string& path);
+    void save_params(const std::string& path, const Params& p);
+
+    /**
+     * How many times every term of Params entered an evaluation, white count minus black count.
+     * The classical evaluation is the sum of the terms times their counts blended by phase
+    */
+    struct Trace {
+        int count[SCORE_COUNT] {};
+        int phase = 0;
+
+        void add(const Score& term, int n) { count[&term - reinterpret_cast<const Score*>(&params)] += n; }
+    };
+
+    Trace trace(const engine::Position& pos);
+
+    /**
+     * Material plus piece-square score of a piece, black pieces negated and mirrored.
+     * Position keeps the sum up to date on every piece change
+    */
+    extern std::array<std::array<Score, 64>, engine::PIECE_NB> psq;
+
+    /**
+     * Static evaluation in centipawns from the side to move point of view,
+     * the network when one is loaded, the classical evaluation otherwise.
+     * Without a pawn table the pawn structure is evaluated every time
+    */
+    int evaluate(const engine::Position& pos, PawnTable* pawns = nullptr);
+    int classical(const engine::Position& pos, PawnTable* pawns = nullptr);
+}
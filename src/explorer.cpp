@@ -0,0 +1,142 @@
+#include "explorer.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include "log.h"
+
+namespace explorer {
+
+    namespace {
+
+        struct Stat {
+            uint64_t games = 0, white_wins = 0, draws = 0, black_wins = 0;
+            uint64_t rated_games = 0, rating_sum = 0;
+        };
+
+        struct MoveKey {
+            engine::Key key;
+            uint16_t move;
+            bool operator == (const MoveKey& other) const { return key == other.key && move == other.move; }
+        };
+
+        struct MoveKeyHash {
+            size_t operator () (const MoveKey& k) const { return k.key ^ (k.move * 0x9E3779B97F4A7C15ULL); }
+        };
+
+        using StatMap = std::unordered_map<MoveKey, Stat, MoveKeyHash>;
+
+        int rating(std::string_view value) {
+
+            int r = 0;
+            std::from_chars(value.data(), value.data()+value.size(), r);
+            return r;
+        }
+    }
+
+    Table::Table(const std::string& path): file(path, io::MappedFile::RANDOM) {
+
+        if (file.size() < sizeof(Header)) throw std::runtime_error("Not an explorer table: " + path);
+        header = reinterpret_cast<const Header*>(file.data());
+        if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION)
+            throw std::runtime_error("Not an explorer table or unsupported version: " + path);
+        if (sizeof(Header) + header->count*sizeof(Entry) > file.size())
+            throw std::runtime_error("Truncated explorer table: " + path);
+        entries = reinterpret_cast<const Entry*>(file.data()+sizeof(Header));
+    }
+
+    std::span<const Entry> Table::probe(engine::Key key) const {
+
+        size_t bucket = key >> (64-BUCKET_BITS);
+        const Entry* first = entries+header->buckets[bucket];
+        const Entry* last = entries+header->buckets[bucket+1];
+        first = std::lower_bound(first, last, key, [] (const Entry& e, engine::Key k) { return e.key < k; });
+        last = std::upper_bound(first, last, key, [] (engine::Key k, const Entry& e) { return k < e.key; });
+        return {first, last};
+    }
+
+    pgn::Stats build(const std::string& pgn_path, const std::string& table_path,
+                     unsigned int threads, int max_ply, uint32_t min_games) {
+
+        pgn::Reader reader(pgn_path);
+        threads = pgn::thread_count(threads);
+        std::vector<StatMap> maps(threads);
+        std::vector<engine::Position> boards(threads);
+        const engine::Position startpos;
+
+        pgn::Stats stats = reader.read([&] (const pgn::Game& game, unsigned int thread) {
+
+            if (game.moves.empty()) return;
+            engine::Position& pos = boards[thread];
+            if (game.fen.empty()) pos = startpos;
+            else pos.set(game.fen);
+
+            int white = rating(game.tag("WhiteElo")), black = rating(game.tag("BlackElo"));
+            StatMap& map = maps[thread];
+            for (size_t ply = 0; ply < game.moves.size() && ply < static_cast<size_t>(max_ply); ++ply) {
+
+                Stat& s = map[{pos.key(), game.moves[ply]}];
+                ++s.games;
+                if (game.result == pgn::WHITE_WINS) ++s.white_wins;
+                else if (game.result == pgn::BLACK_WINS) ++s.black_wins;
+                else if (game.result == pgn::DRAW) ++s.draws;
+                if (white > 0 && black > 0) { ++s.rated_games; s.rating_sum += white+black; }
+                pos.do_move(game.moves[ply]);
+            }
+        }, threads);
+
+        for (unsigned int t=1; t<threads; ++t) {
+            for (const auto& [k, s]: maps[t]) {
+                Stat& total = maps[0][k];
+                total.games += s.games, total.white_wins += s.white_wins, total.draws += s.draws;
+                total.black_wins += s.black_wins, total.rated_games += s.rated_games, total.rating_sum += s.rating_sum;
+            }
+            StatMap().swap(maps[t]);
+        }
+
+        std::vector<Entry> entries;
+        entries.reserve(maps[0].size());
+        for (const auto& [k, s]: maps[0]) {
+            if (s.games < min_games) continue;
+            entries.push_back({k.key, k.move,
+                               static_cast<uint16_t>(s.rated_games? s.rating_sum/(2*s.rated_games): 0),
+                               static_cast<uint32_t>(s.games), static_cast<uint32_t>(s.white_wins),
+                               static_cast<uint32_t>(s.draws), static_cast<uint32_t>(s.black_wins),
+                               static_cast<uint32_t>(s.rated_games)});
+        }
+        StatMap().swap(maps[0]);
+        std::sort(entries.begin(), entries.end(), [] (const Entry& a, const Entry& b) {
+            return a.key != b.key? a.key < b.key: a.games > b.games;
+        });
+
+        auto header = std::make_unique<Header>();
+        std::memcpy(header->magic, MAGIC, sizeof(MAGIC));
+        header->version = VERSION;
+        header->max_ply = max_ply;
+        header->count = entries.size();
+        size_t e = 0;
+        for (size_t b=0; b<=(1<<BUCKET_BITS); ++b) {
+            while (e < entries.size() && (entries[e].key >> (64-BUCKET_BITS)) < b) ++e;
+            header->buckets[b] = e;
+        }
+
+        std::string tmp = table_path + ".tmp";
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) throw std::runtime_error("Could not create explorer table " + tmp);
+        out.write(reinterpret_cast<const char*>(header.get()), sizeof(Header));
+        out.write(reinterpret_cast<const char*>(entries.data()), entries.size()*sizeof(Entry));
+        out.close();
+        if (!out) throw std::runtime_error("Could not write explorer table " + tmp);
+        if (std::rename(tmp.c_str(), table_path.c_str()) != 0)
+            throw std::runtime_error("Could not replace explorer table " + table_path + ": " + strerror(errno));
+
+        LOGD("Explorer table %s: %lu entries", table_path.c_str(), entries.size())
+        return stats;
+    }
+}
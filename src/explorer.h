@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <string>
+#include "position.h"
+#include "mapped_file.h"
+#include "pgn.h"
+
+namespace explorer {
+
+    /**
+     * File layout: Header, then Entry[count] sorted by key and, inside a key, by games descending.
+     * Header::buckets[i] is the index of the first entry whose key has top 16 bits >= i,
+     * so a probe is a bucket lookup plus a short binary search
+    */
+    constexpr char MAGIC[8] = {'C', 'H', 'S', 'E', 'X', 'P', 'L', 'R'};
+    constexpr uint32_t VERSION = 1;
+    constexpr int BUCKET_BITS = 16;
+
+    struct Entry {
+        engine::Key key;
+        uint16_t move;
+        uint16_t avg_rating;    // of both players over rated games, 0 when unknown
+        uint32_t games;
+        uint32_t white_wins;
+        uint32_t draws;
+        uint32_t black_wins;
+        uint32_t rated_games;
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t max_ply;
+        uint64_t count;
+        uint32_t buckets[(1<<BUCKET_BITS)+1];
+    };
+
+    class Table {
+    private:
+        io::MappedFile file;
+        const Header* header {nullptr};
+        const Entry* entries {nullptr};
+    public:
+        /**
+         * Throws std::runtime_error when the file is missing or not an explorer table
+        */
+        explicit Table(const std::string& path);
+
+        /**
+         * Moves played in the position, most popular first. Empty when the position is unknown
+        */
+        std::span<const Entry> probe(engine::Key key) const;
+        size_t size() const { return header->count; }
+    };
+
+    /**
+     * Aggregates the first max_ply plies of every game in the PGN file, moves seen in
+     * fewer than min_games games are dropped
+    */
+    pgn::Stats build(const std::string& pgn_path, const std::string& table_path,
+                     unsigned int threads, int max_ply = 40, uint32_t min_games = 1);
+}
@@ -1,11 +1,19 @@
 #include "game.h"
+#include <chrono>
 #include <iostream>
 #include <thread>
+#include <unordered_map>
 #include "chess.h"
+#include "archive.h"
+#include "explorer.h"
+#include "movegen.h"
+#include "notation.h"
+#include "search.h"
 #include "server.h"
 #include "client.h"
 #include "GLFW_wnd.h"
 #include "board.h"
+#include "trace.h"
 
 namespace game {
     
@@ -24,6 +32,86 @@ namespace game {
     const char* WHITES = "whites";
     const char* BLACKS = "blacks";
     const char* self_color;
+    std::string archive_path;
+    std::unique_ptr<explorer::Table> opening_table {nullptr};
+    engine::Position live;          // engine side copy of the game on the board
+    std::vector<engine::Move> live_moves;
+    std::unordered_map<engine::Key, int> live_seen;       // repetitions of the positions of the game
+    bool game_saved = false;
+
+    std::unique_ptr<search::TranspositionTable> bot_tt {nullptr};
+    std::unique_ptr<search::Searcher> bot {nullptr};       // engine playing our side, none - the mouse does
+    std::thread bot_thread;
+    int64_t bot_clock = 0, bot_increment = 0;             // ms
+    std::chrono::steady_clock::time_point bot_turn;       // our clock runs since
+    bool pondering = false;
+    engine::Key ponder_key = 0;                           // position after the expected reply
+
+/**
+ * Print what is played in the current position according to the opening explorer
+*/
+    void show_explorer () {
+
+        if (!opening_table) return;
+
+        auto entries = opening_table->probe(live.key());
+        if (entries.empty()) { LOGI("Explorer: out of book") return; }
+
+        for (size_t i=0; i<entries.size() && i<5; ++i) {
+
+            const explorer::Entry& e = entries[i];
+            engine::Move m = engine::Move(e.move);
+            if (!engine::legal_moves(live).contains(m)) continue;     // key collision
+            LOGI("Explorer: %-7s %u games, white %u%% draw %u%% black %u%%, rating %u",
+                engine::to_san(live, m).c_str(), e.games, 100*e.white_wins/e.games,
+                100*e.draws/e.games, 100*e.black_wins/e.games, e.avg_rating)
+        }
+    }
+
+/**
+ * Result of the game on the board, UNKNOWN while it goes on
+*/
+    pgn::Result game_result () {
+
+        if (!engine::legal_moves(live).size())
+            return !live.in_check()? pgn::DRAW: live.side_to_move() == engine::WHITE? pgn::BLACK_WINS: pgn::WHITE_WINS;
+        bool insufficient = !live.pieces(engine::PAWN) && !live.pieces(engine::ROOK, engine::QUEEN) && engine::popcount(live.pieces()) <= 3;
+        if (live.rule50() >= 100 || live_seen[live.key()] >= 3 || insufficient) return pgn::DRAW;
+        return pgn::UNKNOWN;
+    }
+
+/**
+ * Append the game played to the archive once, server side only
+*/
+    void save_game (pgn::Result result) {
+
+        if (archive_path.empty() || server==nullptr || game_saved || live_moves.empty()) return;
+        game_saved = true;
+
+        try {
+            archive::Writer writer;
+            writer.add({}, live_moves, result);
+            writer.append_to(archive_path);
+            LOGI("Game saved to %s", archive_path.c_str())
+        }
+        catch (const std::exception& e) { LOGE("%s", e.what()) }
+    }
+
+/**
+ * Follow the game on the engine side, move is in network notation. A finished game is archived right away
+*/
+    void track_move (std::string_view move) {
+
+        engine::Move m = chess::to_engine_move(live, move);
+        if (m == engine::MOVE_NONE) { LOGE("Unknown move %s", std::string(move).c_str()) return; }
+        live.do_move(m);
+        live_moves.push_back(m);
+        ++live_seen[live.key()];
+        show_explorer();
+
+        pgn::Result result = game_result();
+        if (result != pgn::UNKNOWN) save_game(result);
+    }
 
     /**
      * Callback from chess engine to convert board coord into gl coord,
@@ -42,6 +130,90 @@ namespace game {
         line[5] = 0.0f;
     }
 
+    void on_message(std::string_view message);
+
+    void bot_ponder (engine::Move expected);
+
+/**
+ * Search on a worker thread, the move is played on the network thread when the game is still in the
+ * searched position. A ponder search gets the position after the expected reply
+*/
+    void bot_search (const engine::Position& pos, bool ponder) {
+
+        if (bot_thread.joinable()) bot_thread.join();
+        search::Limits limits;
+        limits.time[pos.side_to_move()] = bot_clock;
+        limits.inc[pos.side_to_move()] = bot_increment;
+        limits.ponder = ponder;
+        // before the thread starts, a ponderhit or stop from bot_move may come before think() does
+        bot->prepare(limits);
+        bot_thread = std::thread([pos, limits] {
+
+            trace::thread_name("engine");
+            search::Result result = bot->think(pos, limits);
+            if (result.best == engine::MOVE_NONE) return;
+
+            std::string move = chess::to_network_move(result.best);
+            engine::Key key = pos.key();
+            engine::Move expected = result.ponder;
+            int depth = result.depth;
+            service.post([move, key, expected, depth] {
+
+                if (live.key() != key) return;      // ponder miss
+                int64_t spent = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-bot_turn).count();
+                bot_clock += bot_increment - spent;
+                LOGI("Engine plays %s, depth %d, %lld ms left", move.c_str(), depth, static_cast<long long>(bot_clock))
+                chess::play_move(move);
+                bot_ponder(expected);
+            });
+        });
+    }
+
+/**
+ * Think on the opponent's time about the reply the last search expects
+*/
+    void bot_ponder (engine::Move expected) {
+
+        if (expected == engine::MOVE_NONE || !engine::legal_moves(live).contains(expected)) return;
+        engine::Position pos = live;
+        pos.do_move(expected);
+        if (!engine::legal_moves(pos).size()) return;
+
+        LOGD("Pondering on %s", engine::to_san(live, expected).c_str())
+        ponder_key = pos.key();
+        pondering = true;
+        bot_search(pos, true);
+    }
+
+/**
+ * Our turn: a ponder hit turns the running search into the real one, a miss stops it
+ * and searches again with the warm transposition table
+*/
+    void bot_move () {
+
+        if (!bot || !connection) return;
+        if (live.side_to_move() != (self_color == WHITES? engine::WHITE: engine::BLACK)) return;
+        bot_turn = std::chrono::steady_clock::now();
+
+        if (pondering) {
+            pondering = false;
+            if (live.key() == ponder_key) { LOGD("Ponder hit") bot->ponderhit(); return; }
+            bot->stop();
+        }
+        if (!engine::legal_moves(live).size()) return;
+        bot_search(live, false);
+    }
+
+    void new_game (bool whites) {
+
+        chess::init(whites, on_message, on_opponent_move);
+        live = engine::Position();
+        live_moves.clear();
+        live_seen = {{live.key(), 1}};
+        game_saved = false;
+        show_explorer();
+    }
+
 /**
  * 
  * The callback function for exchanging messages 
@@ -62,11 +234,14 @@ namespace game {
             size_t colon = message.find(":");
             str<<"move:"<<message.substr(colon+1);
             if (connection) connection->send_message(str.str());    
+            track_move(message.substr(colon+1));
         }
         else if (message.find("move") != std::string::npos) {
             
             size_t colon = message.find(":");
             chess::opponent_move(message.substr(colon+1));
+            track_move(message.substr(colon+1));
+            bot_move();
         }
         else if (message.compare("color") == 0) {
             
@@ -74,29 +249,32 @@ namespace game {
             str<<"color:"<<self_color;
             connection->send_message(str.str());
             LOGD("Color request, send %s", str.str().c_str())
+            bot_move();
         }
         else if (message.compare("color:whites") == 0) {
             
             LOGD("set color %s", BLACKS)
-            chess::init(false, on_message, on_opponent_move);
+            new_game(false);
             self_color = BLACKS;
         }
         else if (message.compare("color:blacks") == 0) {
             
             LOGD("set color %s", WHITES)
-            chess::init(true, on_message, on_opponent_move);
+            new_game(true);
             self_color = WHITES;
+            bot_move();
         }
         connection->read_message();
     }
 
     void init_internal (bool whites) {
 
-        chess::init(whites, on_message, on_opponent_move);        
+        new_game(whites);
         
         window = new window::GLFW(dims{WIDTH, HEIGHT}, "Chess");
         window->set_mouse_key_listener([] (double X, double Y) {
             
+                if (bot) return;
                 int x = static_cast<int>(X/WIDTH*chess::BOARD_SIZE);
                 int y = static_cast<int>(Y/HEIGHT*chess::BOARD_SIZE);
                 chess::on_select_cell(x,y);
@@ -149,7 +327,7 @@ namespace game {
         server = new net::TCPServer(port, service, {on_error, on_timeout, on_connection, on_message});
         server->accept_timeout(600); 
         
-        std::thread thread = std::thread([] { service.run(); });
+        std::thread thread = std::thread([] { trace::thread_name("network"); service.run(); });
         if (thread.joinable()) thread.detach();
         init_internal(whites); 
     }
@@ -165,12 +343,29 @@ namespace game {
 
         client = new net::TCPClient(ip, port, service, {on_error, on_timeout, on_connect_server, on_message});
         client->connect_timeout(600);
-        std::thread thread = std::thread([] { service.run(); });
+        std::thread thread = std::thread([] { trace::thread_name("network"); service.run(); });
         if (thread.joinable()) thread.detach();
     }
 
+    void record (const std::string& path) { archive_path = path; }
+
+    void play_engine (int64_t time_ms, int64_t increment_ms) {
+
+        bot_tt = std::make_unique<search::TranspositionTable>();
+        bot = std::make_unique<search::Searcher>(*bot_tt);
+        bot_clock = time_ms, bot_increment = increment_ms;
+        LOGI("Engine plays with %lld+%lld ms", static_cast<long long>(time_ms), static_cast<long long>(increment_ms))
+    }
+
+    void explore (const std::string& table_path) {
+
+        opening_table = std::make_unique<explorer::Table>(table_path);
+        LOGI("Opening explorer %s, %lu entries", table_path.c_str(), opening_table->size())
+    }
+
     void loop() {
 
+        trace::thread_name("render");
         while (!window->should_close()) {
 
             window->draw();
@@ -179,6 +374,9 @@ namespace game {
 
     void clear () {
 // TODO: send EOF when exit
+        if (bot) bot->stop();
+        if (bot_thread.joinable()) bot_thread.join();
+        save_game(pgn::UNKNOWN);       // unfinished
         chess::clear();
         delete arrow; arrow = nullptr;
         delete board; board = nullptr;
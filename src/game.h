@@ -1,10 +1,17 @@
 #pragma once
+#include <cstdint>
 #include <string>
 
 namespace game {
     
     void as_server (bool whites, unsigned short port);
     void as_client (const std::string& ip, const std::string& port, bool whites);
+    void record (const std::string& archive_path);
+    void explore (const std::string& table_path);
+    /**
+     * The engine plays our side instead of the mouse, on its own clock
+    */
+    void play_engine (int64_t time_ms, int64_t increment_ms);
     void loop();
     void clear ();
 }
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "bench.h"
+#include "log.h"
+#include "movegen.h"
+#include "trace.h"
+#include "uci.h"
+#ifdef CHESS_TOOLS
+    #include "tools.h"
+#endif
+
+#ifdef CHESS_TOOLS
+namespace {
+
+    namespace po=boost::program_options;
+
+    /**
+     * The options of the GUI program without the game ones: a tool when one is given,
+     * otherwise the UCI loop with the book, tablebases and network of the options
+    */
+    void run_tools(const std::vector<std::string>& args) {
+
+        po::options_description options("Engine and tools");
+        options.add_options()
+            ("help", "This text")
+            ("uci", "run the engine on stdin/stdout with the UCI protocol, the default without a tool")
+            ("log-level", po::value<std::string>(), "error, info or debug, default info (debug in debug builds)");
+        tools::add_options(options);
+
+        po::variables_map vm;
+        po::store(po::command_line_parser(std::vector<std::string>(args.begin()+1, args.end())).options(options).run(), vm);
+        po::notify(vm);
+
+        if (vm.count("help")) { std::cout<<options<<'\n'; return; }
+        if (vm.count("log-level")) logger::set_level(logger::parse_level(vm["log-level"].as<std::string>().c_str()));
+        tools::load(vm);
+        if (!tools::run(vm)) uci::loop(vm.count("book")? vm["book"].as<std::string>(): "");
+    }
+}
+#endif
+
+/**
+ * Engine without the GUI: the UCI loop by default, bench and perft for checking a build.
+ * Built with boost, options starting with -- run the tools of the GUI program.
+ * --trace <file> records the session as with the GUI binary
+*/
+int main(int argc, char*argv[]) {
+
+    std::vector<std::string> args(argv, argv+argc);
+    try {
+        auto trace_at = std::find(args.begin(), args.end(), "--trace");
+        if (trace_at != args.end()) {
+            if (trace_at+1 == args.end()) throw std::invalid_argument("--trace needs a file name");
+            trace::start(*(trace_at+1));
+            args.erase(trace_at, trace_at+2);
+        }
+        std::string command = args.size() > 1? args[1]: "uci";
+
+        if (command == "uci") uci::loop();
+        else if (command == "bench") {
+            int depth = args.size() > 2? std::atoi(args[2].c_str()): bench::DEFAULT_DEPTH;
+            bench::Result result = bench::run(depth > 0? depth: bench::DEFAULT_DEPTH, [] (int index, int total, const std::string& fen, uint64_t nodes) {
+                std::cerr<<"Position "<<index<<'/'<<total<<": "<<fen<<", "<<nodes<<" nodes\n";
+            });
+            std::cout<<"Total time (ms) : "<<static_cast<int64_t>(result.seconds*1000)<<"\nNodes searched  : "<<result.nodes
+                     <<"\nNodes/second    : "<<result.nps()<<'\n';
+        }
+        else if (command == "perft" && args.size() > 2) {
+            engine::Position pos(args.size() > 3? args[3]: engine::Position::START_FEN);
+            auto start = std::chrono::steady_clock::now();
+            uint64_t nodes = engine::perft(pos, std::atoi(args[2].c_str()));
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+            std::cout<<"Nodes: "<<nodes<<", "<<static_cast<uint64_t>(nodes/std::max(seconds, 1e-9))<<" nodes/s\n";
+        }
+#ifdef CHESS_TOOLS
+        else if (command.starts_with("--")) run_tools(args);
+#endif
+        else {
+            std::cerr<<"Usage: "<<argv[0]<<" [--trace <file>] [uci | bench [depth] | perft <depth> [\"<FEN>\"]";
+#ifdef CHESS_TOOLS
+            std::cerr<<" | --help for the tools";
+#endif
+            std::cerr<<"]\n";
+            trace::stop();
+            return 1;
+        }
+        trace::stop();
+    }
+    catch (std::exception& e) {
+        std::cerr<<e.what()<<'\n';
+        return 1;
+    }
+    return 0;
+}
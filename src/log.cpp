@@ -0,0 +1,273 @@
+#include "log.h"
+#ifndef ANDROID
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace logger {
+
+    Level parse_level(const char* name) {
+
+        std::string s = name;
+        if (s == "error") return LEVEL_ERROR;
+        if (s == "info") return LEVEL_INFO;
+        if (s == "debug") return LEVEL_DEBUG;
+        throw std::invalid_argument("Unknown log level " + s + ", expected error, info or debug");
+    }
+
+    namespace {
+
+        using detail::Header;
+        using detail::Record;
+
+        constexpr uint8_t PADDING = 0xFF;           // level of the filler at the end of a ring
+        constexpr auto IDLE = std::chrono::milliseconds(5);
+
+        // records start at multiples of 8 in a ring
+        size_t stride(size_t size) { return (size + 7) & ~size_t(7); }
+
+        /**
+         * Single producer - the owning thread, single consumer - the writer thread.
+         * Records are contiguous, the space left at the end is skipped with a padding record
+        */
+        class Ring {
+        public:
+            static constexpr size_t CAPACITY = 1<<16;
+
+            alignas(64) std::atomic<size_t> head {0};   // written by the producer
+            alignas(64) std::atomic<size_t> tail {0};   // written by the consumer
+            std::atomic<uint64_t> dropped {0};
+            std::unique_ptr<char[]> data {new char[CAPACITY]};
+
+            bool push(const char* record, size_t size) {
+
+                size_t h = head.load(std::memory_order_relaxed), t = tail.load(std::memory_order_acquire);
+                size_t at = h & (CAPACITY-1), pad = CAPACITY - at < size? CAPACITY - at: 0;
+                if (h + pad + size - t > CAPACITY) { dropped.fetch_add(1, std::memory_order_relaxed); return false; }
+                if (pad) {
+                    Header filler {};
+                    filler.size = static_cast<uint32_t>(pad);
+                    filler.level = PADDING;
+                    std::memcpy(data.get()+at, &filler, offsetof(Header, line));
+                    at = 0;
+                }
+                std::memcpy(data.get()+at, record, size);
+                head.store(h + pad + size, std::memory_order_release);
+                return true;
+            }
+        };
+
+        struct Line {
+            uint64_t sequence;
+            uint8_t level;
+            std::string text;
+        };
+
+        template<typename T> T read(const char*& p) { T v; std::memcpy(&v, p, sizeof(v)); p += sizeof(v); return v; }
+
+        template<typename T> void append(std::string& out, const std::string& spec, T value) {
+
+            char buffer[256];
+            int n = std::snprintf(buffer, sizeof(buffer), spec.c_str(), value);
+            if (n < 0) return;
+            if (static_cast<size_t>(n) < sizeof(buffer)) { out.append(buffer, n); return; }
+            size_t at = out.size();
+            out.resize(at + n + 1);
+            std::snprintf(out.data()+at, n+1, spec.c_str(), value);
+            out.resize(at + n);
+        }
+
+        /**
+         * printf of the recorded arguments, a conversion gets the length modifier of the recorded type
+        */
+        std::string format(const char* record) {
+
+            Header h;
+            std::memcpy(&h, record, sizeof(h));
+            const char* arg = record + sizeof(Header), *end = record + h.size;
+            std::string out;
+            for (const char* f = h.format; *f; ) {
+
+                if (*f != '%') { out += *f++; continue; }
+                if (f[1] == '%') { out += '%'; f += 2; continue; }
+                const char* spec = f++;
+                while (*f && std::strchr("-+ #0123456789.", *f)) ++f;
+                const char* length = f;
+                while (*f && std::strchr("hljztL", *f)) ++f;
+                char conversion = *f;
+                if (*f) ++f;
+                // no argument left, * width or unknown conversion: the spec as is
+                if (arg >= end || !conversion || !std::strchr("diuoxXcfFeEgGaAsp", conversion)) { out.append(spec, f); continue; }
+
+                std::string s(spec, length);
+                uint8_t tag = static_cast<uint8_t>(*arg++);
+                int64_t integer = 0;
+                double real = 0;
+                const char* text = "";
+                const void* pointer = nullptr;
+                switch (tag) {
+                    case detail::SIGNED: integer = read<int64_t>(arg), real = static_cast<double>(integer); break;
+                    case detail::UNSIGNED: integer = static_cast<int64_t>(read<uint64_t>(arg)), real = static_cast<double>(static_cast<uint64_t>(integer)); break;
+                    case detail::DOUBLE: real = read<double>(arg), integer = static_cast<int64_t>(real); break;
+                    case detail::STRING: arg += sizeof(uint16_t), text = arg, arg += std::strlen(arg)+1; break;
+                    default: pointer = read<const void*>(arg), integer = reinterpret_cast<intptr_t>(pointer);
+                }
+
+                if (conversion == 's') append(out, s + 's', text);
+                else if (conversion == 'p') append(out, s + 'p', pointer? pointer: reinterpret_cast<const void*>(integer));
+                else if (conversion == 'c') append(out, s + 'c', static_cast<int>(integer));
+                else if (conversion == 'd' || conversion == 'i') append(out, s + "lld", static_cast<long long>(integer));
+                else if (std::strchr("uoxX", conversion)) append(out, s + "ll" + conversion, static_cast<unsigned long long>(integer));
+                else append(out, s + conversion, real);
+            }
+
+            // the prefixes of the former printf macros
+            std::string prefix;
+            if (h.level == LEVEL_ERROR) prefix = "[ERR] [" + std::string(h.file) + ':' + h.function + ':' + std::to_string(h.line) + "] ";
+            else if (h.level == LEVEL_INFO) prefix = std::string(h.file) + ": ";
+            else prefix = std::string(h.file) + ':' + std::to_string(h.line) + ": ";
+            return prefix + out + '\n';
+        }
+
+        void output(uint8_t level, const std::string& text) {
+
+            std::FILE* stream = level == LEVEL_ERROR? stderr: stdout;
+            std::fwrite(text.data(), 1, text.size(), stream);
+        }
+
+        class Writer {
+        private:
+            std::mutex mutex;
+            std::condition_variable wake;
+            std::vector<std::shared_ptr<Ring>> rings;
+            std::thread thread;
+            bool stop = false;
+
+            /**
+             * Writes everything the rings hold, in sequence order
+            */
+            bool drain() {
+
+                std::vector<std::shared_ptr<Ring>> current;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    // rings of finished threads go once empty
+                    std::erase_if(rings, [] (const std::shared_ptr<Ring>& r) {
+                        return r.use_count() == 1 && r->tail.load() == r->head.load() && !r->dropped.load();
+                    });
+                    current = rings;
+                }
+
+                std::vector<Line> lines;
+                uint64_t dropped = 0;
+                for (const std::shared_ptr<Ring>& r: current) {
+
+                    size_t t = r->tail.load(std::memory_order_relaxed), h = r->head.load(std::memory_order_acquire);
+                    while (t != h) {
+                        const char* record = r->data.get() + (t & (Ring::CAPACITY-1));
+                        Header header;
+                        std::memcpy(&header, record, offsetof(Header, line));
+                        if (header.level != PADDING) {
+                            std::memcpy(&header, record, sizeof(header));
+                            lines.push_back({header.sequence, header.level, format(record)});
+                        }
+                        t += stride(header.size);
+                    }
+                    r->tail.store(t, std::memory_order_release);
+                    dropped += r->dropped.exchange(0, std::memory_order_relaxed);
+                }
+
+                std::sort(lines.begin(), lines.end(), [] (const Line& a, const Line& b) { return a.sequence < b.sequence; });
+                for (const Line& line: lines) output(line.level, line.text);
+                if (dropped) std::fprintf(stderr, "[ERR] log ring full, %llu messages dropped\n", static_cast<unsigned long long>(dropped));
+                if (!lines.empty() || dropped) std::fflush(stdout), std::fflush(stderr);
+                return !lines.empty();
+            }
+
+            void run() {
+
+                std::unique_lock<std::mutex> lock(mutex);
+                while (!stop) {
+                    lock.unlock();
+                    bool busy = drain();
+                    lock.lock();
+                    if (!busy) wake.wait_for(lock, IDLE, [this] { return stop; });
+                }
+                lock.unlock();
+                drain();
+            }
+
+        public:
+            std::atomic<bool> stopped {false};
+            std::atomic<uint64_t> sequence {0};
+
+            Writer() { thread = std::thread(&Writer::run, this); }
+
+            std::shared_ptr<Ring> add_ring() {
+
+                auto ring = std::make_shared<Ring>();
+                std::lock_guard<std::mutex> lock(mutex);
+                rings.push_back(ring);
+                return ring;
+            }
+
+            /**
+             * Writes what is left, records after it are written by the calling thread
+            */
+            void shutdown() {
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stop = true;
+                }
+                wake.notify_one();
+                if (thread.joinable()) thread.join();
+                stopped = true;
+            }
+        };
+
+        // never destroyed, objects with static storage log from their destructors after the exit handler
+        Writer& writer() {
+
+            static Writer* instance = [] {
+                Writer* w = new Writer;
+                std::atexit([] { writer().shutdown(); });
+                return w;
+            }();
+            return *instance;
+        }
+    }
+
+    namespace detail {
+
+        void submit(Record& record, Level level, const char* format, const char* file, const char* function, int line) {
+
+            Writer& w = writer();
+            Header h;
+            h.size = static_cast<uint32_t>(record.size);
+            h.line = static_cast<uint32_t>(line);
+            h.level = static_cast<uint8_t>(level);
+            h.sequence = w.sequence.fetch_add(1, std::memory_order_relaxed);
+            h.format = format, h.file = file, h.function = function;
+            std::memcpy(record.data, &h, sizeof(h));
+
+            if (w.stopped.load(std::memory_order_acquire)) {
+                std::string text = logger::format(record.data);
+                output(h.level, text);
+                std::fflush(level == LEVEL_ERROR? stderr: stdout);
+                return;
+            }
+            thread_local std::shared_ptr<Ring> ring = w.add_ring();
+            ring->push(record.data, stride(h.size));
+        }
+    }
+}
+#endif
@@ -1,3 +1,4 @@
+#pragma once
 #include <cstdio>
 
 #ifdef ANDROID
@@ -6,17 +7,113 @@
     #define TAG "anpr: "
     #define LOGI(...) (__android_log_print(ANDROID_LOG_INFO, TAG __FILE__, __VA_ARGS__));
     #define LOGE(...) (__android_log_print(ANDROID_LOG_ERROR, TAG __FILE__, __VA_ARGS__));
-#else    
-    #define LOGI(str, ...) (std::printf( "%s: " str "\n", __FILE__, ##__VA_ARGS__));
+#else
+    #include <atomic>
+    #include <cstdint>
+    #include <cstring>
+    #include <type_traits>
+
+/**
+ * Asynchronous log. A call copies the format pointer and the arguments into a binary record
+ * in a lock free ring buffer of the calling thread, strings are copied, pointers to them may die
+ * right after the call. A background thread formats the records with printf rules and writes them,
+ * when a ring is full the record is dropped and counted, a producer never waits.
+ * Formats must be string literals. After exit() started, records are written synchronously
+*/
+namespace logger {
+
+    enum Level { LEVEL_ERROR, LEVEL_INFO, LEVEL_DEBUG };
+
+    #ifdef NDEBUG
+        inline std::atomic<int> level {LEVEL_INFO};
+    #else
+        inline std::atomic<int> level {LEVEL_DEBUG};
+    #endif
+
+    inline void set_level(Level l) { level.store(l, std::memory_order_relaxed); }
+    inline bool enabled(Level l) { return l <= level.load(std::memory_order_relaxed); }
+
+    /**
+     * "error", "info" or "debug", throws std::invalid_argument for anything else
+    */
+    Level parse_level(const char* name);
+
+    namespace detail {
+
+        enum Tag : uint8_t { SIGNED, UNSIGNED, DOUBLE, STRING, POINTER };
+
+        struct Header {
+            uint32_t size;              // with the arguments
+            uint8_t level;
+            uint32_t line;
+            uint64_t sequence;          // order between threads
+            const char* format;
+            const char* file;
+            const char* function;
+        };
+
+        // longer strings are cut
+        constexpr size_t MAX_RECORD = 1024;
+
+        struct Record {
+            alignas(Header) char data[MAX_RECORD];
+            size_t size = sizeof(Header);
+
+            void raw(const void* value, size_t n) { std::memcpy(data+size, value, n); size += n; }
+            bool room(size_t n) const { return size + n <= MAX_RECORD; }
+
+            template<typename T> void put(T value) {
+
+                if constexpr (std::is_floating_point_v<T>) {
+                    if (!room(1+sizeof(double))) return;
+                    double v = value;
+                    data[size++] = DOUBLE, raw(&v, sizeof(v));
+                }
+                else if constexpr (std::is_enum_v<T>) put(static_cast<std::underlying_type_t<T>>(value));
+                else if constexpr (std::is_integral_v<T>) {
+                    if (!room(1+sizeof(uint64_t))) return;
+                    if constexpr (std::is_signed_v<T>) {
+                        int64_t v = static_cast<int64_t>(value);
+                        data[size++] = SIGNED, raw(&v, sizeof(v));
+                    }
+                    else {
+                        uint64_t v = static_cast<uint64_t>(value);
+                        data[size++] = UNSIGNED, raw(&v, sizeof(v));
+                    }
+                }
+                else if constexpr (std::is_same_v<std::remove_cv_t<std::remove_pointer_t<T>>, char>
+                                || std::is_same_v<std::remove_cv_t<std::remove_pointer_t<T>>, unsigned char>) {
+                    const char* s = value? reinterpret_cast<const char*>(value): "(null)";
+                    if (!room(1+sizeof(uint16_t)+1)) return;
+                    uint16_t n = static_cast<uint16_t>(strnlen(s, MAX_RECORD - size - 1-sizeof(uint16_t)-1));
+                    data[size++] = STRING, raw(&n, sizeof(n)), raw(s, n);
+                    data[size++] = '\0';
+                }
+                else {
+                    static_assert(std::is_pointer_v<T>, "log arguments are numbers, strings and pointers");
+                    if (!room(1+sizeof(void*))) return;
+                    const void* v = value;
+                    data[size++] = POINTER, raw(&v, sizeof(v));
+                }
+            }
+        };
+
+        void submit(Record& record, Level level, const char* format, const char* file, const char* function, int line);
+    }
+
+    template<typename... Args> void write(Level level, const char* format, const char* file, const char* function, int line, Args... args) {
+
+        detail::Record record;
+        (record.put(args), ...);
+        detail::submit(record, level, format, file, function, line);
+    }
+}
+
+    #define LOGI(str, ...) (logger::enabled(logger::LEVEL_INFO) && (logger::write(logger::LEVEL_INFO, str, __FILE__, __FUNCTION__, __LINE__, ##__VA_ARGS__), true));
     #define LOGE(format, ...)  	\
     {								\
-    	std::fprintf(stderr, "[ERR] [%s:%s:%d] " format "\n", \
-    	__FILE__, __FUNCTION__ , __LINE__, ##__VA_ARGS__);     \
+    	if (logger::enabled(logger::LEVEL_ERROR))	\
+    	logger::write(logger::LEVEL_ERROR, format, __FILE__, __FUNCTION__, __LINE__, ##__VA_ARGS__);     \
     }
-    #ifdef NDEBUG//DEBUG_INFO   
-        #define LOGD(str, ...) ;    
-    #else   
-        #define LOGD(str, ...) (std::printf( "%s:%d: " str "\n", __FILE__, __LINE__, ##__VA_ARGS__));                                                           
-    #endif             
+    #define LOGD(str, ...) (logger::enabled(logger::LEVEL_DEBUG) && (logger::write(logger::LEVEL_DEBUG, str, __FILE__, __FUNCTION__, __LINE__, ##__VA_ARGS__), true));
 #endif
-
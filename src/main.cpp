@@ -1,9 +1,14 @@
+#include <cctype>
 #include <iostream>
 #include <boost/program_options.hpp>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include "log.h"
 #include "game.h"
+#include "tools.h"
+#include "trace.h"
+#include "uci.h"
 
 namespace {
 
@@ -13,7 +18,10 @@ namespace {
     bool server = false;
     unsigned short port  = 3000;
     bool whites;
+    bool headless = false;
+    bool uci_mode = false;
     std::string ip_port;
+    std::string book_path;
 
     void print_help() {
 
@@ -28,7 +36,12 @@ namespace {
             ("create", po::bool_switch(&server), "create a new game, Server mode on")
             ("port", po::value<unsigned short>(), "server port, used when create option used")
             ("whites", po::bool_switch(&whites), "play whites")
-            ("connect", po::value<std::string>(&ip_port), "connect a game \"<IP>:<Port>\"");
+            ("connect", po::value<std::string>(&ip_port), "connect a game \"<IP>:<Port>\"")
+            ("log-level", po::value<std::string>(), "error, info or debug, default info (debug in debug builds)")
+            ("trace", po::value<std::string>(), "write spans of the session as Chrome trace JSON, needs a -DCHESS_TRACE=ON build")
+            ("bot", po::value<std::string>(), "the engine plays our side of a networked game with the clock \"<minutes>+<increment seconds>\"")
+            ("uci", po::bool_switch(&uci_mode), "run the engine on stdin/stdout with the UCI protocol");
+        tools::add_options(general);
         
         if (argc==1) print_help();                
         
@@ -37,8 +50,26 @@ namespace {
         po::notify(vm);
 
         if (vm.count("help")) print_help();
+        if (vm.count("log-level")) logger::set_level(logger::parse_level(vm["log-level"].as<std::string>().c_str()));
+        if (vm.count("trace")) trace::start(vm["trace"].as<std::string>());
 
-        if (server) {
+        if (vm.count("archive")) game::record(vm["archive"].as<std::string>());
+        if (vm.count("bot")) {
+            std::istringstream clock(vm["bot"].as<std::string>());
+            double minutes = 0, increment = 0;
+            char plus = '+';
+            bool valid = std::isdigit(clock.peek()) && clock>>minutes && minutes > 0
+                         && (clock>>plus? plus == '+' && clock>>increment && increment >= 0 && clock.peek() == EOF: true);
+            if (!valid) throw std::invalid_argument("--bot needs \"<minutes>+<increment seconds>\", e.g. \"5+3\"");
+            game::play_engine(static_cast<int64_t>(minutes*60000), static_cast<int64_t>(increment*1000));
+        }
+        if (vm.count("explorer") && !vm.count("explorer-build")) game::explore(vm["explorer"].as<std::string>());
+        tools::load(vm);
+        if (vm.count("book")) book_path = vm["book"].as<std::string>();
+
+        if (tools::run(vm)) headless = true;
+        else if (uci_mode) headless = true;
+        else if (server) {
 
             port = vm.count("port")? vm["port"].as<unsigned short>(): 3000;
             game::as_server (whites, port);
@@ -58,12 +89,14 @@ namespace {
 
     void loop() {
     
-        game::loop();
+        if (uci_mode) uci::loop(book_path);
+        else if (!headless) game::loop();
     }
 
     void clear() {
 
         game::clear();
+        trace::stop();
     }
 }
 
@@ -0,0 +1,70 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace io {
+
+    /**
+     * Read only memory mapping of a whole file, unmapped on destruction
+    */
+    class MappedFile {
+    private:
+        const char* data_ {nullptr};
+        size_t size_ = 0;
+
+    public:
+        enum Access { SEQUENTIAL, RANDOM };
+
+        MappedFile() = default;
+        explicit MappedFile(const std::string& path, Access access = SEQUENTIAL) {
+
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) throw std::runtime_error("Could not open file " + path + ": " + strerror(errno));
+
+            struct stat st;
+            if (::fstat(fd, &st) != 0) {
+                ::close(fd);
+                throw std::runtime_error("Could not stat file " + path + ": " + strerror(errno));
+            }
+            size_ = static_cast<size_t>(st.st_size);
+            if (size_ > 0) {
+                void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr == MAP_FAILED) {
+                    ::close(fd);
+                    throw std::runtime_error("Could not map file " + path + ": " + strerror(errno));
+                }
+                ::madvise(addr, size_, access == SEQUENTIAL? MADV_SEQUENTIAL: MADV_RANDOM);
+                data_ = static_cast<const char*>(addr);
+            }
+            ::close(fd);
+        }
+
+        MappedFile(const MappedFile& other) = delete;
+        MappedFile& operator = (const MappedFile& other) = delete;
+        MappedFile(MappedFile&& other): data_{std::exchange(other.data_, nullptr)}, size_{std::exchange(other.size_, 0)} {}
+        MappedFile& operator = (MappedFile&& other) {
+
+            if (this != &other) {
+                if (data_) ::munmap(const_cast<char*>(data_), size_);
+                data_ = std::exchange(other.data_, nullptr);
+                size_ = std::exchange(other.size_, 0);
+            }
+            return *this;
+        }
+
+        ~MappedFile() { if (data_) ::munmap(const_cast<char*>(data_), size_); }
+
+        const char* data() const { return data_; }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+        std::string_view view() const { return {data_, size_}; }
+    };
+}
@@ -0,0 +1,383 @@
+#include "match.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "movegen.h"
+#include "notation.h"
+#include "pgn.h"
+#include "tb.h"
+
+namespace match {
+
+    using namespace engine;
+
+    namespace {
+
+        using Clock = std::chrono::steady_clock;
+
+        constexpr int64_t TIME_MARGIN = 50;         // ms an engine may overstep its clock
+        constexpr int64_t START_TIMEOUT = 10000;    // ms for uciok and readyok
+
+        int64_t since(Clock::time_point t) {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now()-t).count();
+        }
+
+        /**
+         * UCI engine in a child process, talked to over pipes
+        */
+        class Engine {
+        private:
+            std::string command;
+            std::vector<std::pair<std::string, std::string>> options;
+            pid_t pid = -1;
+            int to_engine = -1, from_engine = -1;
+            std::string buffer;
+
+            void start();
+            void close_process();
+        public:
+            explicit Engine(const std::string& spec);
+            ~Engine() { close_process(); }
+
+            Engine(const Engine& other) = delete;
+            Engine& operator = (const Engine& other) = delete;
+
+            void send(const std::string& line);
+
+            /**
+             * False on timeout or when the engine has gone
+            */
+            bool read_line(std::string& line, int64_t timeout);
+            bool wait_for(const std::string& token, int64_t timeout);
+            void restart() { close_process(); start(); }
+        };
+
+        Engine::Engine(const std::string& spec) {
+
+            std::istringstream ss(spec);
+            std::string part;
+            std::getline(ss, command, '|');
+            if (command == "self") command = std::filesystem::read_symlink("/proc/self/exe").string() + " --uci";
+            while (std::getline(ss, part, '|')) {
+                size_t eq = part.find('=');
+                if (eq == std::string::npos) throw std::invalid_argument("Engine option " + part + " is not Name=value");
+                options.emplace_back(part.substr(0, eq), part.substr(eq+1));
+            }
+            start();
+        }
+
+        void Engine::start() {
+
+            int in[2], out[2];
+            if (pipe2(in, O_CLOEXEC) || pipe2(out, O_CLOEXEC)) throw std::runtime_error("Can not create pipes for " + command);
+
+            pid = fork();
+            if (pid < 0) throw std::runtime_error("Can not start " + command);
+            if (pid == 0) {
+                dup2(in[0], STDIN_FILENO);
+                dup2(out[1], STDOUT_FILENO);
+                execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char*>(nullptr));
+                _exit(127);
+            }
+            close(in[0]);
+            close(out[1]);
+            to_engine = in[1], from_engine = out[0];
+            buffer.clear();
+
+            send("uci");
+            if (!wait_for("uciok", START_TIMEOUT)) throw std::runtime_error(command + " does not answer uci");
+            for (const auto& [name, value]: options) send("setoption name " + name + " value " + value);
+            send("isready");
+            if (!wait_for("readyok", START_TIMEOUT)) throw std::runtime_error(command + " does not answer isready");
+        }
+
+        void Engine::close_process() {
+
+            if (pid <= 0) return;
+            send("quit");
+            close(to_engine);
+            close(from_engine);
+            for (int i=0; i<50 && waitpid(pid, nullptr, WNOHANG) == 0; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            if (kill(pid, SIGKILL) == 0) waitpid(pid, nullptr, 0);
+            pid = -1;
+        }
+
+        void Engine::send(const std::string& line) {
+
+            std::string data = line + '\n';
+            for (size_t done = 0; done < data.size(); ) {
+                ssize_t n = write(to_engine, data.data()+done, data.size()-done);
+                if (n <= 0) return;         // the engine has gone, the next read tells
+                done += n;
+            }
+        }
+
+        bool Engine::read_line(std::string& line, int64_t timeout) {
+
+            auto start = Clock::now();
+            while (true) {
+
+                size_t nl = buffer.find('\n');
+                if (nl != std::string::npos) {
+                    line.assign(buffer, 0, nl);
+                    buffer.erase(0, nl+1);
+                    if (!line.empty() && line.back() == '\r') line.pop_back();
+                    return true;
+                }
+                int64_t left = timeout - since(start);
+                if (left <= 0) return false;
+
+                pollfd p {from_engine, POLLIN, 0};
+                if (poll(&p, 1, static_cast<int>(std::min<int64_t>(left, 1 << 30))) <= 0) continue;
+                char chunk[4096];
+                ssize_t n = read(from_engine, chunk, sizeof(chunk));
+                if (n <= 0) return false;
+                buffer.append(chunk, n);
+            }
+        }
+
+        bool Engine::wait_for(const std::string& token, int64_t timeout) {
+
+            auto start = Clock::now();
+            std::string line;
+            while (read_line(line, timeout - since(start)))
+                if (line.starts_with(token)) return true;
+            return false;
+        }
+
+        bool insufficient_material(const Position& pos) {
+
+            return !pos.pieces(PAWN) && !pos.pieces(ROOK, QUEEN) && popcount(pos.pieces()) <= 3;
+        }
+
+        // score of an info line, side to move point of view
+        bool parse_score(const std::string& line, int& score) {
+
+            std::istringstream ss(line);
+            std::string token;
+            while (ss>>token)
+                if (token == "score") {
+                    ss>>token;
+                    int value;
+                    if (!(ss>>value)) return false;
+                    if (token == "cp") score = value;
+                    else if (token == "mate") score = value > 0? 30000-value: -30000-value;
+                    else return false;
+                    return true;
+                }
+            return false;
+        }
+
+        struct GameResult {
+            pgn::Result result = pgn::DRAW;
+            bool adjudicated = false;
+            bool time_loss = false;
+        };
+
+        GameResult play_game(Engine* players[COLOR_NB], const std::string& fen, const Config& config) {
+
+            Position pos(fen);
+            std::string moves;
+            int64_t clocks[COLOR_NB] = {config.time, config.time};
+            std::unordered_map<Key, int> seen {{pos.key(), 1}};
+            int win_plies = 0, win_sign = 0, draw_plies = 0;
+            auto loss = [] (Color c) { return c == WHITE? pgn::BLACK_WINS: pgn::WHITE_WINS; };
+
+            for (Engine* e: {players[WHITE], players[BLACK]}) {
+                e->send("ucinewgame");
+                e->send("isready");
+                if (!e->wait_for("readyok", START_TIMEOUT)) e->restart();
+            }
+
+            while (true) {
+
+                Color us = pos.side_to_move();
+                if (!legal_moves(pos).size()) return {pos.in_check()? loss(us): pgn::DRAW};
+                if (pos.rule50() >= 100 || seen[pos.key()] >= 3 || insufficient_material(pos)) return {pgn::DRAW};
+
+                if (!pos.castling_rights() && popcount(pos.pieces()) <= tb::max_pieces()) {
+                    tb::WDL wdl;
+                    if (tb::probe_wdl(pos, wdl))
+                        return {wdl == tb::WDL_DRAW? pgn::DRAW: wdl == tb::WDL_LOSS? loss(us): loss(~us), true};
+                }
+
+                Engine& e = *players[us];
+                e.send("position fen " + fen + (moves.empty()? "": " moves" + moves));
+                e.send("go wtime " + std::to_string(clocks[WHITE]) + " btime " + std::to_string(clocks[BLACK])
+                       + " winc " + std::to_string(config.increment) + " binc " + std::to_string(config.increment));
+
+                auto start = Clock::now();
+                std::string line, best;
+                int score = 0;
+                bool scored = false;
+                while (e.read_line(line, clocks[us] + TIME_MARGIN - since(start))) {
+                    if (line.starts_with("bestmove")) {
+                        std::istringstream ss(line);
+                        ss>>best>>best;
+                        if (best == "bestmove") best = "(none)";
+                        break;
+                    }
+                    if (line.starts_with("info")) scored |= parse_score(line, score);
+                }
+                if (best.empty()) {
+                    e.restart();        // hung or crashed, a fresh process plays the next game
+                    return {loss(us), false, true};
+                }
+                clocks[us] -= since(start);
+                if (clocks[us] < -TIME_MARGIN) return {loss(us), false, true};
+                clocks[us] += config.increment;
+
+                Move m = from_uci(pos, best);
+                if (m == MOVE_NONE) return {loss(us)};
+                pos.do_move(m);
+                moves += ' ' + best;
+                ++seen[pos.key()];
+
+                // both engines have to agree over several moves, white point of view
+                int white = us == WHITE? score: -score;
+                int sign = white > 0? 1: -1;
+                win_plies = scored && std::abs(white) >= config.adjudicate_score? (sign == win_sign? win_plies+1: 1): 0;
+                win_sign = sign;
+                draw_plies = scored && pos.game_ply() >= config.draw_ply && std::abs(white) <= 10? draw_plies+1: 0;
+                if (win_plies >= 2*config.adjudicate_moves) return {white > 0? pgn::WHITE_WINS: pgn::BLACK_WINS, true};
+                if (draw_plies >= 2*config.adjudicate_moves) return {pgn::DRAW, true};
+            }
+        }
+
+        std::vector<std::string> load_openings(const Config& config) {
+
+            std::vector<std::string> fens;
+            if (config.openings.empty()) return {Position::START_FEN};
+
+            if (config.openings.ends_with(".pgn")) {
+                pgn::Reader reader(config.openings);
+                std::mutex mutex;
+                reader.read([&] (const pgn::Game& game, unsigned int) {
+
+                    if (!game.valid || static_cast<int>(game.moves.size()) < config.opening_plies) return;
+                    Position pos = game.start();
+                    for (int i=0; i<config.opening_plies; ++i) pos.do_move(game.moves[i]);
+                    std::lock_guard<std::mutex> lock(mutex);
+                    fens.push_back(pos.fen());
+                }, 1);
+            }
+            else {
+                std::ifstream file(config.openings);
+                if (!file) throw std::runtime_error("Can not open " + config.openings);
+                for (std::string line; std::getline(file, line); ) {
+                    std::istringstream ss(line);
+                    std::string fields[4];
+                    if (!(ss>>fields[0]>>fields[1]>>fields[2]>>fields[3])) continue;
+                    fens.push_back(fields[0] + ' ' + fields[1] + ' ' + fields[2] + ' ' + fields[3] + " 0 1");
+                }
+            }
+            if (fens.empty()) throw std::runtime_error("No openings in " + config.openings);
+            return fens;
+        }
+
+        double to_elo(double score) {
+
+            score = std::clamp(score, 1e-6, 1-1e-6);
+            return -400*std::log10(1/score - 1);
+        }
+
+        double to_score(double elo) { return 1/(1 + std::pow(10, -elo/400)); }
+    }
+
+    void update_estimates(Stats& s, const Config& config) {
+
+        s.lower = std::log(config.beta/(1-config.alpha));
+        s.upper = std::log((1-config.beta)/config.alpha);
+
+        int n = s.games();
+        double mean = (s.wins + s.draws/2.0)/n;
+        double var = (s.wins*(1-mean)*(1-mean) + s.draws*(0.5-mean)*(0.5-mean) + s.losses*mean*mean)/n;
+        double margin = 1.96*std::sqrt(var/n);
+        s.elo = to_elo(mean);
+        s.elo_error = (to_elo(mean+margin) - to_elo(mean-margin))/2;
+
+        // generalized SPRT over opening pairs, paired games share the opening and are not independent.
+        // Half a pair of prior in every outcome keeps the first few pairs from deciding with no variance
+        int pairs = 0;
+        double weight = 0, pair_mean = 0, pair_var = 0;
+        for (int i=0; i<5; ++i) pairs += s.pairs[i], weight += s.pairs[i]+0.5, pair_mean += (s.pairs[i]+0.5)*i/4.0;
+        if (!pairs) return;
+        pair_mean /= weight;
+        for (int i=0; i<5; ++i) pair_var += (s.pairs[i]+0.5)*(i/4.0-pair_mean)*(i/4.0-pair_mean);
+        pair_var /= weight;
+        double s0 = to_score(config.elo0), s1 = to_score(config.elo1);
+        s.llr = pairs*(s1-s0)*(2*pair_mean-s0-s1)/(2*pair_var);
+    }
+
+    Stats run(const Config& config, const on_progress& progress) {
+
+        std::signal(SIGPIPE, SIG_IGN);      // writes to a crashed engine fail instead
+        auto start = Clock::now();
+        std::vector<std::string> openings = load_openings(config);
+
+        Stats stats;
+        std::mutex mutex;
+        std::unordered_map<int, int> pending;           // opening pair -> half points of its first game
+        std::atomic<int> next {0};
+        std::atomic<bool> done {false};
+        std::exception_ptr error;
+
+        auto worker = [&] {
+
+            try {
+                Engine first(config.engines[0]), second(config.engines[1]);
+                for (int g; !done && (g = next++) < config.games; ) {
+
+                    bool first_white = g % 2 == 0;
+                    Engine* players[COLOR_NB] = {first_white? &first: &second, first_white? &second: &first};
+                    GameResult r = play_game(players, openings[g/2 % openings.size()], config);
+                    int points = r.result == pgn::DRAW? 1: (r.result == pgn::WHITE_WINS) == first_white? 2: 0;
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    (points == 2? stats.wins: points == 1? stats.draws: stats.losses)++;
+                    stats.adjudicated += r.adjudicated;
+                    stats.time_losses += r.time_loss;
+                    if (auto it = pending.find(g/2); it != pending.end()) {
+                        stats.pairs[it->second + points]++;
+                        pending.erase(it);
+                    }
+                    else pending[g/2] = points;
+
+                    update_estimates(stats, config);
+                    stats.seconds = since(start)/1000.0;
+                    if (progress) progress(stats);
+                    if (stats.decided()) done = true;
+                }
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) error = std::current_exception();
+                done = true;
+            }
+        };
+
+        unsigned int threads = std::min<unsigned int>(pgn::thread_count(config.threads), std::max(1, config.games));
+        std::vector<std::thread> pool;
+        for (unsigned int t=1; t<threads; ++t) pool.emplace_back(worker);
+        worker();
+        for (std::thread& t: pool) t.join();
+
+        if (error && !stats.games()) std::rethrow_exception(error);
+        stats.seconds = since(start)/1000.0;
+        return stats;
+    }
+}
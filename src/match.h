@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Engine against engine matches. Every game thread owns one process of each engine and plays
+ * its games back to back, the openings are played twice with colors reversed
+*/
+namespace match {
+
+    struct Config {
+        std::string engines[2];             // "<command>[|Option=value...]", "self" - this binary in UCI mode
+        std::string openings;               // .epd positions or .pgn games cut after opening_plies, empty - start position
+        int opening_plies = 8;
+        int games = 1000;
+        unsigned int threads = 0;           // 0 - every hardware thread
+        int64_t time = 10000, increment = 100;      // ms per game and per move
+        int adjudicate_score = 1000;        // cp, both engines agree for adjudicate_moves moves
+        int adjudicate_moves = 4;
+        int draw_ply = 80;                  // draw when both scores stay within 10cp for adjudicate_moves moves after it
+        double elo0 = 0, elo1 = 5;          // SPRT hypotheses for the first engine
+        double alpha = 0.05, beta = 0.05;
+    };
+
+    /**
+     * First engine point of view
+    */
+    struct Stats {
+        int wins = 0, draws = 0, losses = 0;
+        int pairs[5] {};                    // opening pairs scoring 0, 0.5, 1, 1.5 and 2 points
+        int time_losses = 0, adjudicated = 0;
+        double elo = 0, elo_error = 0;      // 95% interval
+        double llr = 0, lower = 0, upper = 0;
+        double seconds = 0;
+
+        int games() const { return wins + draws + losses; }
+        bool decided() const { return llr <= lower || llr >= upper; }
+    };
+
+    /**
+     * Elo and its interval from the wins, draws and losses, the pentanomial LLR from the pairs
+     * and the SPRT bounds of config.alpha and config.beta
+    */
+    void update_estimates(Stats& s, const Config& config);
+
+    using on_progress = std::function<void (const Stats& stats)>;
+
+    /**
+     * Plays until config.games are done or the SPRT accepts a hypothesis, progress is called after
+     * every game from the game threads one at a time. Throws std::runtime_error when an engine fails to start
+    */
+    Stats run(const Config& config, const on_progress& progress = nullptr);
+}
@@ -0,0 +1,190 @@
+#include "mate.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "movegen.h"
+
+namespace mate {
+
+    using namespace engine;
+
+    namespace {
+
+        constexpr uint32_t INF = 0x3FFFFFFF;
+        constexpr int MAX_MATE_MOVES = 100;
+        constexpr uint32_t QUIET_PROOF = 16;       // initial proof number of a move without check
+    }
+
+    Solver::Solver(size_t mb) {
+
+        clusters = std::max<size_t>(1, (mb << 20) / sizeof(Cluster));
+        table = std::make_unique<Cluster[]>(clusters);
+        clear();
+    }
+
+    void Solver::clear() {
+
+        std::memset(static_cast<void*>(table.get()), 0, clusters*sizeof(Cluster));
+    }
+
+    bool Solver::lookup(Key key, int plies, bool attacking, uint32_t& phi, uint32_t& delta) const {
+
+        // a mate within fewer plies holds with more, an escape with more plies holds with fewer
+        const Cluster& c = table[key % clusters];
+        for (const Entry& e: c.entries) {
+            if (e.key != key || !e.work) continue;
+            bool mate = attacking? e.phi == 0: e.delta == 0;
+            bool escape = attacking? e.delta == 0: e.phi == 0;
+            if (e.plies == plies || (mate && e.plies < plies) || (escape && e.plies > plies)) {
+                phi = e.phi, delta = e.delta;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Solver::store(Key key, int plies, uint32_t phi, uint32_t delta, uint32_t work) {
+
+        Cluster& c = table[key % clusters];
+        Entry* replace = &c.entries[0];
+        for (Entry& e: c.entries) {
+            if (e.key == key && e.plies == plies) { replace = &e; work = std::max(work, e.work); break; }
+            if (e.work < replace->work) replace = &e;
+        }
+        *replace = {key, phi, delta, std::max<uint32_t>(work, 1), static_cast<uint16_t>(plies)};
+    }
+
+    /**
+     * Expands the node until its proof or disproof number reaches the threshold.
+     * phi is the number of the side to move: proof number when attacking, disproof number when defending
+    */
+    void Solver::mid(Position& pos, int plies, uint32_t& phi, uint32_t& delta, uint32_t th_phi, uint32_t th_delta) {
+
+        ++nodes;
+        bool attacking = pos.side_to_move() == attacker;
+        auto defended = [&] { phi = attacking? INF: 0, delta = attacking? 0: INF; };
+
+        // a repetition is a successful defence
+        if (pos.is_draw()) { defended(); return; }
+        MoveList list = legal_moves(pos);
+        if (!list.size()) {
+            if (pos.in_check()) phi = INF, delta = 0;
+            else defended();
+            return;
+        }
+        if (!plies) { defended(); return; }
+
+        // with one ply left only a mating check proves the node, the children are not worth a table probe
+        if (plies == 1) {
+            defended();
+            for (Move m: list) {
+                if (!pos.gives_check(m)) continue;
+                pos.do_move(m);
+                bool mated = !legal_moves(pos).size();
+                pos.undo_move(m);
+                if (mated) { phi = 0, delta = INF; break; }
+            }
+            store(pos.key(), plies, phi, delta, 1);
+            return;
+        }
+
+        uint64_t start = nodes;
+        uint32_t child_phi[MAX_MOVES], child_delta[MAX_MOVES];
+        Key child_key[MAX_MOVES];
+        for (int i=0; i<list.size(); ++i) {
+            child_key[i] = pos.key_after(list.moves[i]);
+            __builtin_prefetch(&table[child_key[i] % clusters]);
+        }
+        for (int i=0; i<list.size(); ++i) {
+
+            Move m = list.moves[i];
+            if (lookup(child_key[i], plies-1, !attacking, child_phi[i], child_delta[i])) continue;
+            child_phi[i] = child_delta[i] = 1;
+            if (!attacking) continue;
+
+            // replies to a check estimate the proof number, quiet moves start behind every check
+            if (!pos.gives_check(m)) {
+                child_delta[i] = QUIET_PROOF;
+                continue;
+            }
+            pos.do_move(m);
+            if (int replies = legal_moves(pos).size()) child_delta[i] = replies;
+            else child_phi[i] = INF, child_delta[i] = 0;
+            pos.undo_move(m);
+        }
+
+        while (true) {
+
+            // phi is the smallest delta of a child, delta the sum of the children phi
+            uint32_t second = INF;
+            int best = 0;
+            phi = INF, delta = 0;
+            for (int i=0; i<list.size(); ++i) {
+                if (child_delta[i] < phi) second = phi, phi = child_delta[i], best = i;
+                else if (child_delta[i] < second) second = child_delta[i];
+                delta = std::min(INF, delta + child_phi[i]);
+            }
+            if (phi >= th_phi || delta >= th_delta || stopped.load(std::memory_order_relaxed)) break;
+
+            Move m = list.moves[best];
+            pos.do_move(m);
+            mid(pos, plies-1, child_phi[best], child_delta[best], th_delta - delta + child_phi[best], std::min<uint32_t>(th_phi, second + second/4 + 1));
+            pos.undo_move(m);
+        }
+        store(pos.key(), plies, phi, delta, static_cast<uint32_t>(std::min<uint64_t>(nodes-start, INF)));
+    }
+
+    std::vector<Move> Solver::principal_variation(Position& pos, int plies) const {
+
+        std::vector<Move> pv;
+        for (; plies > 0; --plies) {
+
+            Move next = MOVE_NONE;
+            for (Move m: legal_moves(pos)) {
+                uint32_t phi, delta;
+                pos.do_move(m);
+                bool mated = pos.in_check() && !legal_moves(pos).size();
+                pos.undo_move(m);
+                bool proven = lookup(pos.key_after(m), plies-1, pos.side_to_move() != attacker, phi, delta)
+                    && (pos.side_to_move() == attacker? delta == 0: phi == 0);
+                if (mated || proven) {
+                    next = m;
+                    if (mated) break;
+                }
+            }
+            if (next == MOVE_NONE) break;
+            pv.push_back(next);
+            pos.do_move(next);
+        }
+        for (auto it = pv.rbegin(); it != pv.rend(); ++it) pos.undo_move(*it);
+        return pv;
+    }
+
+    Result Solver::solve(const Position& root, int max_moves) {
+
+        auto start = std::chrono::steady_clock::now();
+        Result result;
+        Position pos = root;
+        attacker = pos.side_to_move();
+        nodes = 0;
+
+        // short limits are cheap to disprove, the first proof is the shortest mate
+        for (int n=1; n <= std::min(max_moves, MAX_MATE_MOVES) && !stopped; ++n) {
+
+            int plies = 2*n-1;
+            uint32_t phi, delta;
+            if (!lookup(pos.key(), plies, true, phi, delta)) phi = delta = 1;
+            while (phi && delta && !stopped) mid(pos, plies, phi, delta, INF, INF);
+            if (phi) continue;
+
+            result.found = true;
+            result.moves = n;
+            result.pv = principal_variation(pos, plies);
+            break;
+        }
+        result.stopped = stopped;
+        result.nodes = nodes;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        return result;
+    }
+}
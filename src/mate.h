@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "position.h"
+
+/**
+ * Mate solver with depth first proof-number search (df-pn), independent of the alpha-beta
+ * search. The side to move attacks, every defence has to be refuted
+*/
+namespace mate {
+
+    struct Result {
+        bool found = false;
+        bool stopped = false;                   // stop() ended the solve before an answer
+        int moves = 0;                          // mate in moves, the shortest one within the limit
+        std::vector<engine::Move> pv;           // one defence line, may stop early when entries were replaced
+        uint64_t nodes = 0;
+        double seconds = 0;
+    };
+
+    class Solver {
+    private:
+        struct Entry {
+            engine::Key key;
+            uint32_t phi, delta;                // side to move point of view: proof and disproof numbers
+            uint32_t work;                      // nodes spent below, the replacement priority
+            uint16_t plies;                     // plies left for the attacker to mate
+        };
+        struct Cluster {
+            Entry entries[4];
+        };
+
+        std::unique_ptr<Cluster[]> table;
+        size_t clusters;
+        std::atomic<bool> stopped {false};
+        uint64_t nodes = 0;
+        engine::Color attacker;
+
+        bool lookup(engine::Key key, int plies, bool attacking, uint32_t& phi, uint32_t& delta) const;
+        void store(engine::Key key, int plies, uint32_t phi, uint32_t delta, uint32_t work);
+        void mid(engine::Position& pos, int plies, uint32_t& phi, uint32_t& delta, uint32_t th_phi, uint32_t th_delta);
+        std::vector<engine::Move> principal_variation(engine::Position& pos, int plies) const;
+    public:
+        /**
+         * The node table takes mb megabytes and never grows
+        */
+        explicit Solver(size_t mb = 64);
+
+        /**
+         * Proves a mate within max_moves, then retries with shorter limits to find the shortest one.
+         * Returns when no shorter mate exists or stop() is called
+        */
+        Result solve(const engine::Position& pos, int max_moves);
+        void stop() { stopped.store(true, std::memory_order_relaxed); }
+
+        /**
+         * Clears the stop() of an earlier solve, called before the thread running solve() starts
+        */
+        void prepare() { stopped.store(false, std::memory_order_relaxed); }
+        void clear();
+    };
+}
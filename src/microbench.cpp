@@ -0,0 +1,346 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "chess.h"
+#include "movegen.h"
+#include "notation.h"
+#include "pgn.h"
+#include "tt.h"
+#ifdef CHESS_BENCH_NET
+    #include "connection.h"
+#endif
+
+/**
+ * Timing of the hot functions one at a time. Every benchmark is a fixed batch of operations run
+ * first without measuring, then repeatedly until both the minimal number of samples and the minimal time
+ * are reached. Nanoseconds per operation of the samples go out as JSON on stdout: min, median, p90, p99,
+ * mean and standard deviation, the median is the number to compare between builds. net::Connection logs
+ * on stdout too, --output keeps the JSON apart from it
+*/
+namespace {
+
+    using namespace engine;
+    using clock_type = std::chrono::steady_clock;
+
+    // opening, middlegames, endgames
+    constexpr const char* FENS[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+        "r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14",
+        "2rqkb1r/ppp2p2/2npb1p1/1N1Nn2p/2P1PP2/8/PP2B1PP/R1BQK2R b KQ - 0 11",
+        "3q2k1/pb3p1p/4pbp1/2r5/PpN2N2/1P2P2P/5PP1/Q2R2K1 b - - 4 26",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11",
+        "8/pp2r1k1/2p1p3/3pP2p/1P1P1P1P/P5KR/8/8 w - - 0 1",
+        "8/R7/2q5/8/6k1/8/1P5p/K6R w - - 0 124",
+    };
+
+    struct Options {
+        std::string filter;                 // substring of the names to run, empty - all
+        std::string output;                 // JSON file, empty - stdout
+        int warmup = 20;                    // runs
+        int samples = 50;                   // at least
+        int64_t min_time = 200;             // ms of samples at least
+    };
+
+    struct Stats {
+        std::string name;
+        int64_t ops = 0;                    // operations in one sample
+        size_t samples = 0;
+        double min = 0, median = 0, p90 = 0, p99 = 0, mean = 0, stddev = 0;
+    };
+
+    // results go here so the compiler can not drop the measured work
+    volatile uint64_t sink = 0;
+
+    double percentile(const std::vector<double>& sorted, double p) {
+
+        double at = p*(sorted.size()-1);
+        size_t low = static_cast<size_t>(at);
+        size_t high = std::min(low+1, sorted.size()-1);
+        return sorted[low] + (sorted[high]-sorted[low])*(at-low);
+    }
+
+    /**
+     * run() does ops operations and returns a value depending on all of them
+    */
+    Stats measure(const Options& options, const std::string& name, int64_t ops, const std::function<uint64_t ()>& run) {
+
+        for (int i=0; i<options.warmup; ++i) sink = sink + run();
+
+        std::vector<double> times;
+        auto start = clock_type::now(), limit = start + std::chrono::milliseconds(options.min_time);
+        for (auto now = start; times.size() < static_cast<size_t>(options.samples) || now < limit; ) {
+
+            uint64_t value = run();
+            auto end = clock_type::now();
+            sink = sink + value;
+            times.push_back(std::chrono::duration<double, std::nano>(end-now).count()/ops);
+            now = end;
+        }
+
+        Stats s;
+        s.name = name;
+        s.ops = ops;
+        s.samples = times.size();
+        std::sort(times.begin(), times.end());
+        s.min = times.front();
+        s.median = percentile(times, 0.5);
+        s.p90 = percentile(times, 0.9);
+        s.p99 = percentile(times, 0.99);
+        for (double t: times) s.mean += t;
+        s.mean /= times.size();
+        for (double t: times) s.stddev += (t-s.mean)*(t-s.mean);
+        s.stddev = std::sqrt(s.stddev/times.size());
+        return s;
+    }
+
+    /**
+     * Deterministic games of pseudo random legal moves, the same text on every run
+    */
+    std::string make_pgn(int games, int plies) {
+
+        std::ostringstream out;
+        uint64_t seed = 0x9E3779B97F4A7C15ull;
+        for (int g=0; g<games; ++g) {
+
+            Position pos;
+            out<<"[Event \"microbench\"]\n[Round \""<<g+1<<"\"]\n[Result \"*\"]\n\n";
+            for (int ply=0; ply<plies; ++ply) {
+
+                MoveList list = legal_moves(pos);
+                if (!list.size()) break;
+                seed ^= seed<<13, seed ^= seed>>7, seed ^= seed<<17;
+                Move m = list.moves[seed%list.size()];
+                if (ply%2 == 0) out<<ply/2+1<<". ";
+                out<<to_san(pos, m)<<' ';
+                pos.do_move(m);
+            }
+            out<<"*\n\n";
+        }
+        return out.str();
+    }
+
+    /**
+     * The moves of make_pgn() games in the network notation the GUI board takes
+    */
+    std::vector<std::vector<std::string>> make_network_games(int games, int plies) {
+
+        std::vector<std::vector<std::string>> result;
+        pgn::parse(make_pgn(games, plies), [&] (const pgn::Game& game, unsigned int) {
+            result.emplace_back();
+            for (Move m: game.moves) result.back().push_back(chess::to_network_move(m));
+        });
+        return result;
+    }
+
+    std::vector<Stats> run_all(const Options& options) {
+
+        std::vector<Position> positions;
+        for (const char* fen: FENS) positions.emplace_back(fen);
+        std::vector<MoveList> moves;
+        int64_t move_count = 0;
+        for (const Position& pos: positions) moves.push_back(legal_moves(pos)), move_count += moves.back().size();
+        constexpr int64_t count = sizeof(FENS)/sizeof(FENS[0]);
+
+        std::vector<Stats> results;
+        auto add = [&] (const std::string& name, int64_t ops, const std::function<uint64_t ()>& run) {
+
+            if (!options.filter.empty() && name.find(options.filter) == std::string::npos) return;
+            std::cerr<<name<<"...\r"<<std::flush;
+            results.push_back(measure(options, name, ops, run));
+            std::cerr<<name<<": "<<std::fixed<<std::setprecision(2)<<results.back().median<<" ns\n";
+        };
+
+        add("attackers_to", count*64, [&] {
+
+            uint64_t x = 0;
+            for (const Position& pos: positions)
+                for (int s=0; s<64; ++s) x += pos.attackers_to(Square(s));
+            return x;
+        });
+
+        add("attacked", count*64*2, [&] {
+
+            uint64_t x = 0;
+            for (const Position& pos: positions)
+                for (int s=0; s<64; ++s) x += pos.attacked(Square(s), WHITE) + pos.attacked(Square(s), BLACK);
+            return x;
+        });
+
+        add("generate_legal", count, [&] {
+
+            uint64_t x = 0;
+            MoveList list;
+            for (const Position& pos: positions) list.count = 0, generate<LEGAL>(pos, list), x += list.size();
+            return x;
+        });
+
+        add("do_undo_move", move_count, [&] {
+
+            uint64_t x = 0;
+            for (size_t i=0; i<positions.size(); ++i)
+                for (Move m: moves[i]) positions[i].do_move(m), x ^= positions[i].key(), positions[i].undo_move(m);
+            return x;
+        });
+
+        add("key_after", move_count, [&] {
+
+            uint64_t x = 0;
+            for (size_t i=0; i<positions.size(); ++i)
+                for (Move m: moves[i]) x ^= positions[i].key_after(m);
+            return x;
+        });
+
+        search::TranspositionTable tt(16);
+        std::vector<Key> keys;
+        for (size_t i=0; i<positions.size(); ++i) for (Move m: moves[i]) keys.push_back(positions[i].key_after(m));
+        add("tt_store_probe", static_cast<int64_t>(keys.size())*2, [&] {
+
+            uint64_t x = 0;
+            search::TTData data;
+            for (Key k: keys) tt.store(k, MOVE_NONE, static_cast<int>(k&255), 0, 1, search::BOUND_EXACT);
+            for (Key k: keys) if (tt.probe(k, data)) x += data.score;
+            return x;
+        });
+
+        add("fen_set", count, [&] {
+
+            uint64_t x = 0;
+            Position pos;
+            for (const char* fen: FENS) pos.set(fen), x ^= pos.key();
+            return x;
+        });
+
+        add("fen_get", count, [&] {
+
+            uint64_t x = 0;
+            for (const Position& pos: positions) x += pos.fen().size();
+            return x;
+        });
+
+        std::string text = make_pgn(20, 120);
+        uint64_t pgn_moves = pgn::parse(text, nullptr).moves;
+        add("pgn_parse_move", static_cast<int64_t>(pgn_moves), [&] {
+
+            return pgn::parse(text, [] (const pgn::Game& game, unsigned int) { sink = sink + game.moves.size(); }).moves;
+        });
+
+        // the GUI applies a move to chess::position and uploads the cells as a uniform on the next frame,
+        // without a GL context the upload is the copy to the staging memory
+        std::vector<std::vector<std::string>> network = make_network_games(4, 80);
+        int64_t board_moves = 0;
+        for (const auto& game: network) board_moves += game.size();
+        std::array<unsigned int, chess::BOARD_SIZE*chess::BOARD_SIZE> uploaded {};
+        add("board_update", board_moves, [&] {
+
+            uint64_t x = 0;
+            for (const auto& game: network) {
+                chess::init(true, [] (std::string_view) {}, [] (unsigned int, unsigned int) {});
+                for (size_t i=0; i<game.size(); ++i) {
+                    if (i%2 == 0) chess::play_move(game[i]);
+                    else chess::opponent_move(game[i]);
+                    std::memcpy(uploaded.data(), chess::position.data(), sizeof(uploaded));
+                    x += uploaded[i&63];
+                }
+            }
+            return x;
+        });
+
+#ifdef CHESS_BENCH_NET
+        // the two ends of a loopback TCP connection, everything runs on this thread
+        boost::asio::io_context io;
+        boost::asio::ip::tcp::acceptor acceptor(io, {boost::asio::ip::address_v4::loopback(), 0});
+        boost::asio::ip::tcp::socket server_sock(io), client_sock(io);
+        client_sock.connect(acceptor.local_endpoint());
+        acceptor.accept(server_sock);
+        server_sock.set_option(boost::asio::ip::tcp::no_delay(true));
+        client_sock.set_option(boost::asio::ip::tcp::no_delay(true));
+
+        constexpr int64_t MESSAGES = 64;
+        const std::string message = "move:e2e4\n";
+        int64_t received = 0;
+        uint64_t parsed = 0;
+        Position start;
+        auto on_error = [] (const boost::system::error_code& er) { throw boost::system::system_error(er); };
+        net::Connection sender(client_sock, [] (std::string_view) {}, on_error);
+        std::unique_ptr<net::Connection> receiver;
+        receiver = std::make_unique<net::Connection>(server_sock, [&] (std::string_view m) {
+
+            // the same split as the game does, then the move itself
+            if (!m.empty()) {
+                size_t colon = m.find(':');
+                parsed += from_uci(start, m.substr(colon+1));
+                ++received;
+            }
+            if (received < MESSAGES) receiver->read_message();
+        }, on_error);
+
+        add("connection_round", MESSAGES, [&] {
+
+            received = 0;
+            for (int i=0; i<MESSAGES; ++i) sender.send_message(message);
+            receiver->read_message();
+            io.restart();
+            io.run();
+            return parsed;
+        });
+#endif
+        return results;
+    }
+
+    void write_json(std::ostream& out, const std::vector<Stats>& results, const Options& options) {
+
+        out<<"{\n  \"warmup\": "<<options.warmup<<",\n  \"min_samples\": "<<options.samples
+           <<",\n  \"min_time_ms\": "<<options.min_time<<",\n  \"unit\": \"ns/op\",\n  \"benchmarks\": [";
+        out<<std::fixed<<std::setprecision(3);
+        for (size_t i=0; i<results.size(); ++i) {
+            const Stats& s = results[i];
+            out<<(i? ",": "")<<"\n    {\"name\": \""<<s.name<<"\", \"ops\": "<<s.ops<<", \"samples\": "<<s.samples
+               <<", \"min\": "<<s.min<<", \"median\": "<<s.median<<", \"p90\": "<<s.p90<<", \"p99\": "<<s.p99
+               <<", \"mean\": "<<s.mean<<", \"stddev\": "<<s.stddev<<'}';
+        }
+        out<<"\n  ]\n}\n";
+    }
+}
+
+int main(int argc, char*argv[]) {
+
+    Options options;
+    for (int i=1; i<argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--warmup" && i+1 < argc) options.warmup = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--samples" && i+1 < argc) options.samples = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--min-time" && i+1 < argc) options.min_time = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--output" && i+1 < argc) options.output = argv[++i];
+        else if (arg[0] != '-') options.filter = arg;
+        else {
+            std::cerr<<"Usage: "<<argv[0]<<" [name filter] [--warmup runs] [--samples count] [--min-time ms] [--output file.json]\n";
+            return 1;
+        }
+    }
+    try {
+        std::vector<Stats> results = run_all(options);
+        if (options.output.empty()) write_json(std::cout, results, options);
+        else {
+            std::ofstream file(options.output);
+            if (!file) throw std::runtime_error("Can not open " + options.output);
+            write_json(file, results, options);
+        }
+    }
+    catch (std::exception& e) {
+        std::cerr<<e.what()<<'\n';
+        return 1;
+    }
+    return 0;
+}
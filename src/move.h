@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include "bitboard.h"
+
+namespace engine {
+
+    /**
+     * 16 bit move: bits 0-5 destination, 6-11 origin, 12-13 promotion piece (knight..queen),
+     * 14-15 move type. Castling is encoded as the king move (e1g1)
+    */
+    enum Move : uint16_t { MOVE_NONE=0, MOVE_NULL=65 };
+
+    enum MoveType { NORMAL=0, PROMOTION=1<<14, EN_PASSANT=2<<14, CASTLING=3<<14 };
+
+    constexpr Square from_sq(Move m) { return (m>>6)&0x3F; }
+    constexpr Square to_sq(Move m) { return m&0x3F; }
+    constexpr MoveType type_of(Move m) { return MoveType(m&(3<<14)); }
+    constexpr PieceType promotion_type(Move m) { return PieceType(((m>>12)&3)+KNIGHT); }
+    constexpr bool is_ok(Move m) { return from_sq(m) != to_sq(m); }
+
+    constexpr Move make_move(Square from, Square to) { return Move((from<<6)|to); }
+
+    template<MoveType T> constexpr Move make(Square from, Square to, PieceType pt=KNIGHT) {
+        return Move(T|((pt-KNIGHT)<<12)|(from<<6)|to);
+    }
+
+    constexpr int MAX_MOVES = 256;
+
+    struct MoveList {
+        Move moves[MAX_MOVES];
+        int count = 0;
+
+        void push(Move m) { moves[count++] = m; }
+        Move* begin() { return moves; }
+        Move* end() { return moves+count; }
+        const Move* begin() const { return moves; }
+        const Move* end() const { return moves+count; }
+        int size() const { return count; }
+        bool contains(Move m) const { for (Move x: *this) if (x==m) return true; return false; }
+    };
+}
@@ -0,0 +1,171 @@
+#include "movegen.h"
+#include <algorithm>
+#include "eval.h"
+#include "trace.h"
+
+namespace engine {
+
+    namespace {
+
+        template<bool captures, bool quiets>
+        void add_promotions(MoveList& list, Square from, Square to) {
+
+            if (captures) list.push(make<PROMOTION>(from, to, QUEEN));
+            if (quiets) {
+                list.push(make<PROMOTION>(from, to, ROOK));
+                list.push(make<PROMOTION>(from, to, BISHOP));
+                list.push(make<PROMOTION>(from, to, KNIGHT));
+            }
+        }
+
+        template<Color us, bool captures, bool quiets>
+        void pawn_moves(const Position& pos, MoveList& list) {
+
+            constexpr Color them = ~us;
+            constexpr int up = pawn_push(us);
+            constexpr Bitboard rank7 = rank_bb(relative_rank(us, 6));
+            constexpr Bitboard rank3 = rank_bb(relative_rank(us, 2));
+            auto shift = [] (Bitboard b) { return us == WHITE? b << 8: b >> 8; };
+
+            Bitboard empty = ~pos.pieces();
+            Bitboard enemies = pos.pieces(them);
+            Bitboard pawns = pos.pieces(us, PAWN) & ~rank7;
+            Bitboard promoting = pos.pieces(us, PAWN) & rank7;
+
+            if (quiets) {
+                Bitboard single = shift(pawns) & empty;
+                Bitboard twice = shift(single & rank3) & empty;
+                while (single) { Square to = pop_lsb(single); list.push(make_move(to-up, to)); }
+                while (twice) { Square to = pop_lsb(twice); list.push(make_move(to-2*up, to)); }
+            }
+
+            for (Bitboard b = promoting; b; ) {
+
+                Square from = pop_lsb(b);
+                if (empty & square_bb(from+up)) add_promotions<captures, quiets>(list, from, from+up);
+                for (Bitboard a = pawn_attacks[us][from] & enemies; a; )
+                    add_promotions<captures, quiets>(list, from, pop_lsb(a));
+            }
+
+            if (captures) {
+                for (Bitboard b = pawns; b; ) {
+                    Square from = pop_lsb(b);
+                    for (Bitboard a = pawn_attacks[us][from] & enemies; a; ) list.push(make_move(from, pop_lsb(a)));
+                }
+                if (pos.ep_square() != NO_SQUARE)
+                    for (Bitboard a = pawn_attacks[them][pos.ep_square()] & pawns; a; )
+                        list.push(make<EN_PASSANT>(pop_lsb(a), pos.ep_square()));
+            }
+        }
+
+        template<bool captures, bool quiets>
+        void piece_moves(const Position& pos, MoveList& list) {
+
+            Color us = pos.side_to_move();
+            Bitboard target = (captures? pos.pieces(~us): 0) | (quiets? ~pos.pieces(): 0);
+            Bitboard occupied = pos.pieces();
+
+            for (PieceType pt: {KNIGHT, BISHOP, ROOK, QUEEN, KING})
+                for (Bitboard b = pos.pieces(us, pt); b; ) {
+                    Square from = pop_lsb(b);
+                    for (Bitboard a = attacks_bb(pt, from, occupied) & target; a; ) list.push(make_move(from, pop_lsb(a)));
+                }
+
+            if (quiets && !pos.in_check()) {
+
+                int rights = pos.castling_rights() & (us == WHITE? WHITE_OO|WHITE_OOO: BLACK_OO|BLACK_OOO);
+                Square ksq = relative_square(us, 4);
+                if ((rights & (WHITE_OO|BLACK_OO)) && !(occupied & between_bb[ksq][ksq+3]))
+                    list.push(make<CASTLING>(ksq, ksq+2));
+                if ((rights & (WHITE_OOO|BLACK_OOO)) && !(occupied & between_bb[ksq][ksq-4]))
+                    list.push(make<CASTLING>(ksq, ksq-2));
+            }
+        }
+
+        template<bool captures, bool quiets>
+        void all_moves(const Position& pos, MoveList& list) {
+
+            if (pos.side_to_move() == WHITE) pawn_moves<WHITE, captures, quiets>(pos, list);
+            else pawn_moves<BLACK, captures, quiets>(pos, list);
+            piece_moves<captures, quiets>(pos, list);
+        }
+    }
+
+    template<GenType T> void generate(const Position& pos, MoveList& list) {
+
+        if constexpr (T == LEGAL) {
+            TRACE_SCOPE("engine", "generate legal")
+            MoveList pseudo;
+            all_moves<true, true>(pos, pseudo);
+            for (Move m: pseudo) if (pos.legal(m)) list.push(m);
+        }
+        else all_moves<T != QUIETS, T != CAPTURES>(pos, list);
+    }
+
+    template void generate<CAPTURES>(const Position&, MoveList&);
+    template void generate<QUIETS>(const Position&, MoveList&);
+    template void generate<PSEUDO_LEGAL>(const Position&, MoveList&);
+    template void generate<LEGAL>(const Position&, MoveList&);
+
+    int see(const Position& pos, Move m) {
+
+        if (type_of(m) == CASTLING) return 0;
+
+        constexpr int VALUE[PIECE_TYPE_NB] = {0, eval::PIECE_VALUE[PAWN], eval::PIECE_VALUE[KNIGHT], eval::PIECE_VALUE[BISHOP],
+                                              eval::PIECE_VALUE[ROOK], eval::PIECE_VALUE[QUEEN], 20000};
+        Square from = from_sq(m), to = to_sq(m);
+        Color side = pos.side_to_move();
+        Bitboard occupied = pos.pieces();
+        int gain[32];
+        int d = 0;
+
+        PieceType attacker = type_of(pos.moved_piece(m));
+        gain[0] = VALUE[type_of(pos.piece_on(to))];
+        if (type_of(m) == EN_PASSANT) {
+            occupied ^= square_bb(to - pawn_push(side));
+            gain[0] = VALUE[PAWN];
+        }
+        else if (type_of(m) == PROMOTION) {
+            attacker = promotion_type(m);
+            gain[0] += VALUE[attacker] - VALUE[PAWN];
+        }
+
+        Bitboard from_bb = square_bb(from);
+        do {
+            ++d;
+            gain[d] = VALUE[attacker] - gain[d-1];      // score if the last capture is answered
+            if (std::max(-gain[d-1], gain[d]) < 0) break;
+
+            occupied ^= from_bb;                        // uncovers sliders behind the attacker
+            Bitboard attackers = pos.attackers_to(to, occupied) & occupied;
+            side = ~side;
+            from_bb = 0;
+            for (PieceType pt: {PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING})
+                if (Bitboard b = attackers & pos.pieces(side, pt)) {
+                    // the king cannot capture into a defended square
+                    if (pt == KING && (attackers & pos.pieces(~side))) break;
+                    from_bb = b & -b;
+                    attacker = pt;
+                    break;
+                }
+        } while (from_bb && d < 31);
+
+        while (--d) gain[d-1] = -std::max(-gain[d-1], gain[d]);
+        return gain[0];
+    }
+
+    uint64_t perft(Position& pos, int depth) {
+
+        MoveList list;
+        generate<LEGAL>(pos, list);
+        if (depth <= 1) return depth == 1? list.size(): 1;
+
+        uint64_t nodes = 0;
+        for (Move m: list) {
+            pos.do_move(m);
+            nodes += perft(pos, depth-1);
+            pos.undo_move(m);
+        }
+        return nodes;
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "position.h"
+
+namespace engine {
+
+    enum GenType { CAPTURES, QUIETS, PSEUDO_LEGAL, LEGAL };
+
+    /**
+     * CAPTURES also yields queen promotions, QUIETS the remaining moves, so that
+     * CAPTURES+QUIETS == PSEUDO_LEGAL. Only LEGAL filters moves leaving the king in check
+    */
+    template<GenType T> void generate(const Position& pos, MoveList& list);
+
+    inline MoveList legal_moves(const Position& pos) {
+
+        MoveList list;
+        generate<LEGAL>(pos, list);
+        return list;
+    }
+
+    /**
+     * Static exchange evaluation: material won in centipawns by the side to move when both
+     * sides keep capturing on the target square with their least valuable piece and may stop
+     * at any point. Pins are ignored, 0 for castling
+    */
+    int see(const Position& pos, Move m);
+
+    /**
+     * Counts leaf nodes of the legal move tree, used to verify move generation
+    */
+    uint64_t perft(Position& pos, int depth);
+}
@@ -0,0 +1,150 @@
+#include "movepick.h"
+#include <utility>
+#include "eval.h"
+#include "movegen.h"
+
+namespace search {
+
+    using namespace engine;
+
+    namespace {
+
+        int mvv_lva(const Position& pos, Move m) {
+
+            PieceType victim = type_of(m) == EN_PASSANT? PAWN: type_of(pos.piece_on(to_sq(m)));
+            int score = 10*eval::PIECE_VALUE[victim] - eval::PIECE_VALUE[type_of(pos.moved_piece(m))];
+            if (type_of(m) == PROMOTION) score += eval::PIECE_VALUE[promotion_type(m)];
+            return score;
+        }
+
+        // a capture of an equal or more valuable piece never loses material, unless the king walks into a defended square
+        bool losing(const Position& pos, Move m) {
+
+            PieceType victim = type_of(m) == EN_PASSANT? PAWN: type_of(pos.piece_on(to_sq(m)));
+            PieceType attacker = type_of(pos.moved_piece(m));
+            if (type_of(m) != PROMOTION && attacker != KING && eval::PIECE_VALUE[victim] >= eval::PIECE_VALUE[attacker]) return false;
+            return see(pos, m) < 0;
+        }
+    }
+
+    MovePicker::MovePicker(const Position& pos, Move tt_move, const Move* killers, Move counter, const History& history):
+        pos{pos}, history{history}, tt_move{tt_move}, refutations{killers[0], killers[1], counter},
+        stage{HASH_MOVE}, evasions{pos.in_check()} {
+
+        if (this->tt_move != MOVE_NONE && !pos.pseudo_legal(this->tt_move)) this->tt_move = MOVE_NONE;
+    }
+
+    MovePicker::MovePicker(const Position& pos, Move tt_move, const History& history):
+        pos{pos}, history{history}, tt_move{tt_move}, refutations{MOVE_NONE, MOVE_NONE, MOVE_NONE},
+        stage{QS_HASH_MOVE}, evasions{pos.in_check()} {
+
+        // outside check the hash move is only tried when it is a capture the stage would yield
+        if (this->tt_move != MOVE_NONE && (!pos.pseudo_legal(this->tt_move) || (!evasions && !pos.capture(this->tt_move)
+            && !(type_of(this->tt_move) == PROMOTION && promotion_type(this->tt_move) == QUEEN))))
+            this->tt_move = MOVE_NONE;
+    }
+
+    void MovePicker::score_captures() {
+
+        for (int i=0; i<moves.size(); ++i) scores[i] = mvv_lva(pos, moves.moves[i]);
+    }
+
+    void MovePicker::score_quiets() {
+
+        Color us = pos.side_to_move();
+        for (int i=0; i<moves.size(); ++i) scores[i] = history[us][from_sq(moves.moves[i])][to_sq(moves.moves[i])];
+    }
+
+    // selection sort step, moves are usually cut off long before the list is sorted
+    Move MovePicker::pick_best() {
+
+        int best = current;
+        for (int j=current+1; j<moves.size(); ++j) if (scores[j] > scores[best]) best = j;
+        std::swap(moves.moves[current], moves.moves[best]);
+        std::swap(scores[current], scores[best]);
+        return moves.moves[current++];
+    }
+
+    bool MovePicker::refutation(Move m) const {
+
+        return m == refutations[0] || m == refutations[1] || m == refutations[2];
+    }
+
+    Move MovePicker::next() {
+
+        while (true) {
+            switch (stage) {
+
+                case HASH_MOVE:
+                case QS_HASH_MOVE:
+                    ++stage;
+                    if (tt_move != MOVE_NONE) return tt_move;
+                    break;
+
+                case CAPTURE_INIT:
+                case QS_CAPTURE_INIT:
+                    moves.count = current = 0;
+                    generate<CAPTURES>(pos, moves);
+                    score_captures();
+                    ++stage;
+                    break;
+
+                case GOOD_CAPTURES:
+                    while (current < moves.size()) {
+                        Move m = pick_best();
+                        if (m == tt_move) continue;
+                        if (!evasions && losing(pos, m)) { bad_captures.push(m); continue; }
+                        return m;
+                    }
+                    ++stage;
+                    break;
+
+                case REFUTATIONS:
+                    while (refutation_index < 3) {
+                        int i = refutation_index++;
+                        Move m = refutations[i];
+                        if (m == MOVE_NONE || m == tt_move || (i > 0 && m == refutations[0]) || (i > 1 && m == refutations[1])
+                            || pos.capture(m) || type_of(m) == PROMOTION || !pos.pseudo_legal(m))
+                            continue;
+                        return m;
+                    }
+                    ++stage;
+                    break;
+
+                case QUIET_INIT:
+                    moves.count = current = 0;
+                    generate<QUIETS>(pos, moves);
+                    score_quiets();
+                    ++stage;
+                    break;
+
+                case QUIET_MOVES:
+                    while (current < moves.size()) {
+                        Move m = pick_best();
+                        if (m == tt_move || (type_of(m) != PROMOTION && refutation(m))) continue;
+                        return m;
+                    }
+                    ++stage;
+                    break;
+
+                case BAD_CAPTURES:
+                    if (bad_current < bad_captures.size()) return bad_captures.moves[bad_current++];
+                    stage = DONE;
+                    break;
+
+                case QS_CAPTURE_MOVES:
+                    while (current < moves.size()) {
+                        Move m = pick_best();
+                        if (m == tt_move || (!evasions && losing(pos, m))) continue;
+                        return m;
+                    }
+                    // evasions go on with the quiet moves
+                    stage = evasions? QUIET_INIT: DONE;
+                    break;
+
+                default:
+                    return MOVE_NONE;
+            }
+        }
+    }
+}
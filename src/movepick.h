@@ -0,0 +1,54 @@
+#pragma once
+#include "position.h"
+
+namespace search {
+
+    using History = int[engine::COLOR_NB][64][64];
+
+    /**
+     * Hands out the moves of a node one at a time, every stage is generated only when reached:
+     * hash move, captures winning or keeping material by MVV-LVA, killers and the countermove,
+     * quiets by history, then captures losing material. Moves are pseudo legal
+    */
+    class MovePicker {
+    private:
+        enum Stage {
+            HASH_MOVE, CAPTURE_INIT, GOOD_CAPTURES, REFUTATIONS, QUIET_INIT, QUIET_MOVES, BAD_CAPTURES,
+            QS_HASH_MOVE, QS_CAPTURE_INIT, QS_CAPTURE_MOVES, DONE
+        };
+
+        const engine::Position& pos;
+        const History& history;
+        engine::Move tt_move;
+        engine::Move refutations[3];        // killers and countermove
+        int refutation_index = 0;
+        int stage;
+        bool evasions;
+        engine::MoveList moves;
+        int scores[engine::MAX_MOVES];
+        int current = 0;
+        engine::MoveList bad_captures;
+        int bad_current = 0;
+
+        void score_captures();
+        void score_quiets();
+        engine::Move pick_best();
+        bool refutation(engine::Move m) const;
+    public:
+        /**
+         * Main search, killers holds two moves
+        */
+        MovePicker(const engine::Position& pos, engine::Move tt_move, const engine::Move* killers,
+                   engine::Move counter, const History& history);
+
+        /**
+         * Quiescence search: captures not losing material, every move when in check
+        */
+        MovePicker(const engine::Position& pos, engine::Move tt_move, const History& history);
+
+        /**
+         * MOVE_NONE when the moves are exhausted
+        */
+        engine::Move next();
+    };
+}
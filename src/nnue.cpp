@@ -0,0 +1,345 @@
+#include "nnue.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include "position.h"
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define NNUE_X86
+#endif
+
+namespace nnue {
+
+    using namespace engine;
+
+    namespace {
+
+        constexpr int MAX_FEATURES = 32;
+
+        struct alignas(64) Network {
+            int16_t feature_biases[HALF_DIMENSIONS];
+            int16_t feature_weights[INPUTS*HALF_DIMENSIONS];
+            int32_t biases1[L1];
+            alignas(64) int8_t weights1[L1*2*HALF_DIMENSIONS];
+            int32_t biases2[L2];
+            alignas(64) int8_t weights2[L2*L1];
+            int32_t output_bias;
+            int8_t output_weights[L2];
+        };
+
+        std::unique_ptr<Network> network {nullptr};
+
+        using Rows = const int16_t* const*;
+
+        // dst = src + sum of added rows - sum of removed rows, HALF_DIMENSIONS values
+        void update_scalar(int16_t* dst, const int16_t* src, Rows add, int added, Rows sub, int removed) {
+
+            for (int i=0; i<HALF_DIMENSIONS; ++i) {
+                int v = src[i];
+                for (int a=0; a<added; ++a) v += add[a][i];
+                for (int r=0; r<removed; ++r) v -= sub[r][i];
+                dst[i] = static_cast<int16_t>(v);
+            }
+        }
+
+        // clipped ReLU, 0..127
+        void clip_scalar(const int16_t* in, uint8_t* out) {
+
+            for (int i=0; i<HALF_DIMENSIONS; ++i) out[i] = static_cast<uint8_t>(std::clamp<int>(in[i], 0, 127));
+        }
+
+        int32_t dot_scalar(const uint8_t* in, const int8_t* w, int inputs) {
+
+            int32_t sum = 0;
+            for (int i=0; i<inputs; ++i) sum += in[i]*w[i];
+            return sum;
+        }
+
+#ifdef NNUE_X86
+        __attribute__((target("sse4.1")))
+        void update_sse41(int16_t* dst, const int16_t* src, Rows add, int added, Rows sub, int removed) {
+
+            for (int i=0; i<HALF_DIMENSIONS; i+=8) {
+                __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(src+i));
+                for (int a=0; a<added; ++a) v = _mm_add_epi16(v, _mm_load_si128(reinterpret_cast<const __m128i*>(add[a]+i)));
+                for (int r=0; r<removed; ++r) v = _mm_sub_epi16(v, _mm_load_si128(reinterpret_cast<const __m128i*>(sub[r]+i)));
+                _mm_store_si128(reinterpret_cast<__m128i*>(dst+i), v);
+            }
+        }
+
+        __attribute__((target("sse4.1")))
+        void clip_sse41(const int16_t* in, uint8_t* out) {
+
+            const __m128i zero = _mm_setzero_si128();
+            for (int i=0; i<HALF_DIMENSIONS; i+=16) {
+                __m128i a = _mm_load_si128(reinterpret_cast<const __m128i*>(in+i));
+                __m128i b = _mm_load_si128(reinterpret_cast<const __m128i*>(in+i+8));
+                _mm_store_si128(reinterpret_cast<__m128i*>(out+i), _mm_max_epi8(_mm_packs_epi16(a, b), zero));
+            }
+        }
+
+        __attribute__((target("sse4.1")))
+        int32_t dot_sse41(const uint8_t* in, const int8_t* w, int inputs) {
+
+            const __m128i ones = _mm_set1_epi16(1);
+            __m128i sum = _mm_setzero_si128();
+            for (int i=0; i<inputs; i+=16) {
+                __m128i p = _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in+i)),
+                                              _mm_loadu_si128(reinterpret_cast<const __m128i*>(w+i)));
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(p, ones));
+            }
+            sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+            sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+            return _mm_cvtsi128_si32(sum);
+        }
+
+        __attribute__((target("avx2")))
+        void update_avx2(int16_t* dst, const int16_t* src, Rows add, int added, Rows sub, int removed) {
+
+            for (int i=0; i<HALF_DIMENSIONS; i+=16) {
+                __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i*>(src+i));
+                for (int a=0; a<added; ++a) v = _mm256_add_epi16(v, _mm256_load_si256(reinterpret_cast<const __m256i*>(add[a]+i)));
+                for (int r=0; r<removed; ++r) v = _mm256_sub_epi16(v, _mm256_load_si256(reinterpret_cast<const __m256i*>(sub[r]+i)));
+                _mm256_store_si256(reinterpret_cast<__m256i*>(dst+i), v);
+            }
+        }
+
+        __attribute__((target("avx2")))
+        void clip_avx2(const int16_t* in, uint8_t* out) {
+
+            const __m256i zero = _mm256_setzero_si256();
+            for (int i=0; i<HALF_DIMENSIONS; i+=32) {
+                __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(in+i));
+                __m256i b = _mm256_load_si256(reinterpret_cast<const __m256i*>(in+i+16));
+                // packs works per 128 bit lane, the permute restores the order
+                __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(a, b), 0xD8);
+                _mm256_store_si256(reinterpret_cast<__m256i*>(out+i), _mm256_max_epi8(packed, zero));
+            }
+        }
+
+        __attribute__((target("avx2")))
+        int32_t dot_avx2(const uint8_t* in, const int8_t* w, int inputs) {
+
+            const __m256i ones = _mm256_set1_epi16(1);
+            __m256i sum = _mm256_setzero_si256();
+            for (int i=0; i<inputs; i+=32) {
+                __m256i p = _mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in+i)),
+                                                 _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w+i)));
+                sum = _mm256_add_epi32(sum, _mm256_madd_epi16(p, ones));
+            }
+            __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+            s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+            s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+            return _mm_cvtsi128_si32(s);
+        }
+
+        __attribute__((target("avx512f,avx512bw")))
+        void update_avx512(int16_t* dst, const int16_t* src, Rows add, int added, Rows sub, int removed) {
+
+            for (int i=0; i<HALF_DIMENSIONS; i+=32) {
+                __m512i v = _mm512_load_si512(src+i);
+                for (int a=0; a<added; ++a) v = _mm512_add_epi16(v, _mm512_load_si512(add[a]+i));
+                for (int r=0; r<removed; ++r) v = _mm512_sub_epi16(v, _mm512_load_si512(sub[r]+i));
+                _mm512_store_si512(dst+i, v);
+            }
+        }
+
+        __attribute__((target("avx512f,avx512bw")))
+        void clip_avx512(const int16_t* in, uint8_t* out) {
+
+            const __m512i zero = _mm512_setzero_si512();
+            const __m512i order = _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7);
+            for (int i=0; i<HALF_DIMENSIONS; i+=64) {
+                __m512i packed = _mm512_packs_epi16(_mm512_load_si512(in+i), _mm512_load_si512(in+i+32));
+                _mm512_store_si512(out+i, _mm512_max_epi8(_mm512_maskz_permutexvar_epi64(0xFF, order, packed), zero));
+            }
+        }
+
+        __attribute__((target("avx512f,avx512bw")))
+        int32_t dot_avx512(const uint8_t* in, const int8_t* w, int inputs) {
+
+            if (inputs % 64) return dot_avx2(in, w, inputs);
+            const __m512i ones = _mm512_set1_epi16(1);
+            __m512i sum = _mm512_setzero_si512();
+            for (int i=0; i<inputs; i+=64) {
+                __m512i p = _mm512_maddubs_epi16(_mm512_loadu_si512(in+i), _mm512_loadu_si512(w+i));
+                sum = _mm512_add_epi32(sum, _mm512_madd_epi16(p, ones));
+            }
+            __m256i half = _mm256_add_epi32(_mm512_maskz_extracti64x4_epi64(0xFF, sum, 0), _mm512_maskz_extracti64x4_epi64(0xFF, sum, 1));
+            __m128i s = _mm_add_epi32(_mm256_castsi256_si128(half), _mm256_extracti128_si256(half, 1));
+            s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+            s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+            return _mm_cvtsi128_si32(s);
+        }
+#endif
+
+        struct Kernels {
+            void (*update)(int16_t* dst, const int16_t* src, Rows add, int added, Rows sub, int removed);
+            void (*clip)(const int16_t* in, uint8_t* out);
+            int32_t (*dot)(const uint8_t* in, const int8_t* w, int inputs);
+            const char* name;
+        };
+
+        constexpr Kernels KERNELS[] = {
+            {update_scalar, clip_scalar, dot_scalar, "scalar"},
+#ifdef NNUE_X86
+            {update_sse41, clip_sse41, dot_sse41, "SSE4.1"},
+            {update_avx2, clip_avx2, dot_avx2, "AVX2"},
+            {update_avx512, clip_avx512, dot_avx512, "AVX-512"},
+#else
+            {update_scalar, clip_scalar, dot_scalar, "scalar"},
+            {update_scalar, clip_scalar, dot_scalar, "scalar"},
+            {update_scalar, clip_scalar, dot_scalar, "scalar"},
+#endif
+        };
+
+        Simd detect_cpu() {
+
+#ifdef NNUE_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512bw")) return AVX512;
+            if (__builtin_cpu_supports("avx2")) return AVX2;
+            if (__builtin_cpu_supports("sse4.1")) return SSE41;
+#endif
+            return SCALAR;
+        }
+
+        const Simd cpu = detect_cpu();
+        const Kernels* kernels = &KERNELS[cpu];
+
+        inline Square orient(Color perspective, Square s) { return perspective == WHITE? s: s ^ 56; }
+
+        inline const int16_t* feature_row(Color perspective, Square ksq, Piece pc, Square s) {
+
+            int kind = 2*(type_of(pc)-PAWN) + (color_of(pc) != perspective);
+            return network->feature_weights + static_cast<size_t>((ksq*10 + kind)*64 + orient(perspective, s))*HALF_DIMENSIONS;
+        }
+
+        void refresh(const Position& pos, Color perspective) {
+
+            const int16_t* rows[MAX_FEATURES];
+            int n = 0;
+            Square ksq = orient(perspective, pos.king_square(perspective));
+            for (Bitboard b = pos.pieces() ^ pos.pieces(KING); b; ) {
+                Square s = pop_lsb(b);
+                rows[n++] = feature_row(perspective, ksq, pos.piece_on(s), s);
+            }
+            Accumulator& acc = pos.accumulator(0);
+            kernels->update(acc.values[perspective], network->feature_biases, rows, n, nullptr, 0);
+            acc.computed[perspective] = true;
+        }
+
+        /**
+         * Walks back to the last computed state and replays the changed pieces forward,
+         * a move of the own king changes every feature and needs a refresh
+        */
+        void compute(const Position& pos, Color perspective) {
+
+            int back = 0;
+            for (; !pos.accumulator(back).computed[perspective]; ++back) {
+                const DirtyPiece& dp = pos.dirty_piece(back);
+                if (back+1 == pos.state_count() || (dp.count && dp.piece[0] == make_piece(perspective, KING))) {
+                    refresh(pos, perspective);
+                    return;
+                }
+            }
+
+            Square ksq = orient(perspective, pos.king_square(perspective));
+            for (; back > 0; --back) {
+
+                const DirtyPiece& dp = pos.dirty_piece(back-1);
+                const int16_t* add[3];
+                const int16_t* sub[3];
+                int added = 0, removed = 0;
+                for (int i=0; i<dp.count; ++i) {
+                    if (type_of(dp.piece[i]) == KING) continue;
+                    if (dp.from[i] != NO_SQUARE) sub[removed++] = feature_row(perspective, ksq, dp.piece[i], dp.from[i]);
+                    if (dp.to[i] != NO_SQUARE) add[added++] = feature_row(perspective, ksq, dp.piece[i], dp.to[i]);
+                }
+                Accumulator& acc = pos.accumulator(back-1);
+                kernels->update(acc.values[perspective], pos.accumulator(back).values[perspective], add, added, sub, removed);
+                acc.computed[perspective] = true;
+            }
+        }
+
+        void layer(const uint8_t* in, int inputs, const int8_t* weights, const int32_t* biases, int outputs, uint8_t* out) {
+
+            for (int j=0; j<outputs; ++j) {
+                int32_t sum = biases[j] + kernels->dot(in, weights + j*inputs, inputs);
+                out[j] = static_cast<uint8_t>(std::clamp(sum >> 6, 0, 127));
+            }
+        }
+
+        template <typename T>
+        void read(std::ifstream& in, T* data, size_t count) {
+
+            in.read(reinterpret_cast<char*>(data), sizeof(T)*count);
+        }
+    }
+
+    void load(const std::string& path) {
+
+        std::ifstream in(path, std::ios::binary);
+        if (!in) throw std::runtime_error("Could not open network " + path);
+
+        char magic[8];
+        uint32_t header[5];
+        in.read(magic, sizeof(magic));
+        read(in, header, 5);
+        if (!in || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || header[0] != VERSION || header[1] != INPUTS
+            || header[2] != HALF_DIMENSIONS || header[3] != L1 || header[4] != L2)
+            throw std::runtime_error("Not a compatible network: " + path);
+
+        auto net = std::make_unique<Network>();
+        read(in, net->feature_biases, HALF_DIMENSIONS);
+        read(in, net->feature_weights, static_cast<size_t>(INPUTS)*HALF_DIMENSIONS);
+        read(in, net->biases1, L1);
+        read(in, net->weights1, L1*2*HALF_DIMENSIONS);
+        read(in, net->biases2, L2);
+        read(in, net->weights2, L2*L1);
+        read(in, &net->output_bias, 1);
+        read(in, net->output_weights, L2);
+        if (!in || in.peek() != std::ifstream::traits_type::eof()) throw std::runtime_error("Network has a wrong size: " + path);
+        network = std::move(net);
+    }
+
+    bool loaded() {
+
+        return network != nullptr;
+    }
+
+    Simd detected() {
+
+        return cpu;
+    }
+
+    void select(Simd simd) {
+
+        kernels = &KERNELS[std::min(simd, cpu)];
+    }
+
+    const char* simd_name() {
+
+        return kernels->name;
+    }
+
+    int evaluate(const Position& pos) {
+
+        Accumulator& acc = pos.accumulator(0);
+        for (Color c: {WHITE, BLACK}) if (!acc.computed[c]) compute(pos, c);
+
+        alignas(64) uint8_t input[2*HALF_DIMENSIONS];
+        alignas(64) uint8_t hidden1[L1];
+        alignas(64) uint8_t hidden2[L2];
+        Color us = pos.side_to_move();
+        kernels->clip(acc.values[us], input);
+        kernels->clip(acc.values[~us], input+HALF_DIMENSIONS);
+
+        layer(input, 2*HALF_DIMENSIONS, network->weights1, network->biases1, L1, hidden1);
+        layer(hidden1, L1, network->weights2, network->biases2, L2, hidden2);
+        int32_t output = network->output_bias + dot_scalar(hidden2, network->output_weights, L2);
+        return output / OUTPUT_SCALE;
+    }
+}
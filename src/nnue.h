@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace engine { class Position; }
+
+/**
+ * Efficiently updatable network, HalfKP features: for each side its own king square
+ * x 10 non king pieces x 64 squares, seen from that side (ranks flipped for black)
+*/
+namespace nnue {
+
+    constexpr int INPUTS = 64*10*64;
+    constexpr int HALF_DIMENSIONS = 256;
+    constexpr int L1 = 32;
+    constexpr int L2 = 32;
+    constexpr int OUTPUT_SCALE = 16;            // network output per centipawn
+
+    /**
+     * Weights file, all integers little endian:
+     *   magic, u32 version, u32 INPUTS, u32 HALF_DIMENSIONS, u32 L1, u32 L2
+     *   i16 feature biases[HALF_DIMENSIONS], i16 feature weights[INPUTS][HALF_DIMENSIONS]
+     *   i32 biases[L1], i8 weights[L1][2*HALF_DIMENSIONS]
+     *   i32 biases[L2], i8 weights[L2][L1]
+     *   i32 output bias, i8 output weights[L2]
+     * Hidden layers shift their sums right by 6 and clip to 0..127
+    */
+    constexpr char MAGIC[8] = {'C', 'H', 'S', 'N', 'N', 'U', 'E', '1'};
+    constexpr uint32_t VERSION = 1;
+
+    /**
+     * Feature layer output of both sides for one position state
+    */
+    struct alignas(64) Accumulator {
+        int16_t values[2][HALF_DIMENSIONS];
+        bool computed[2];
+    };
+
+    enum Simd { SCALAR, SSE41, AVX2, AVX512 };
+
+    /**
+     * Throws std::runtime_error on a missing or malformed file
+    */
+    void load(const std::string& path);
+    bool loaded();
+
+    /**
+     * Kernels are chosen at startup from the CPU features, select() forces a lower level
+    */
+    Simd detected();
+    void select(Simd simd);
+    const char* simd_name();
+
+    /**
+     * Centipawns from the side to move point of view, only after load()
+    */
+    int evaluate(const engine::Position& pos);
+}
@@ -0,0 +1,167 @@
+#include "notation.h"
+#include <cstdlib>
+#include "movegen.h"
+
+namespace engine {
+
+    namespace {
+
+        constexpr std::string_view PIECE_LETTERS = "  NBRQK";
+
+        PieceType letter_to_type(char c) {
+
+            switch (c) {
+                case 'N': case 'n': return KNIGHT;
+                case 'B': case 'b': return BISHOP;
+                case 'R': case 'r': return ROOK;
+                case 'Q': case 'q': return QUEEN;
+                case 'K': case 'k': return KING;
+                default: return NO_PIECE_TYPE;
+            }
+        }
+
+        Move castling(const Position& pos, bool king_side) {
+
+            Color us = pos.side_to_move();
+            Square ksq = relative_square(us, 4);
+            int right = king_side? (us == WHITE? WHITE_OO: BLACK_OO): (us == WHITE? WHITE_OOO: BLACK_OOO);
+
+            if (!(pos.castling_rights() & right) || pos.piece_on(ksq) != make_piece(us, KING)) return MOVE_NONE;
+            if (pos.pieces() & between_bb[ksq][king_side? ksq+3: ksq-4]) return MOVE_NONE;
+            Move m = make<CASTLING>(ksq, king_side? ksq+2: ksq-2);
+            return pos.legal(m)? m: MOVE_NONE;
+        }
+    }
+
+    std::string square_to_str(Square s) {
+        return {static_cast<char>('a'+file_of(s)), static_cast<char>('1'+rank_of(s))};
+    }
+
+    std::string to_uci(Move m) {
+
+        if (m == MOVE_NONE) return "(none)";
+        if (m == MOVE_NULL) return "0000";
+        std::string str = square_to_str(from_sq(m)) + square_to_str(to_sq(m));
+        if (type_of(m) == PROMOTION) str += " nbrq"[promotion_type(m)-1];
+        return str;
+    }
+
+    Move from_uci(const Position& pos, std::string_view str) {
+
+        MoveList list;
+        generate<LEGAL>(pos, list);
+        for (Move m: list) if (to_uci(m) == str) return m;
+        return MOVE_NONE;
+    }
+
+    std::string to_san(Position& pos, Move m) {
+
+        std::string san;
+        Color us = pos.side_to_move();
+        Square from = from_sq(m), to = to_sq(m);
+        PieceType pt = type_of(pos.piece_on(from));
+
+        if (type_of(m) == CASTLING) san = to > from? "O-O": "O-O-O";
+        else {
+            if (pt == PAWN) {
+                if (pos.capture(m)) san += static_cast<char>('a'+file_of(from));
+            }
+            else {
+                san += PIECE_LETTERS[pt];
+                Bitboard others = attacks_bb(pt, to, pos.pieces()) & pos.pieces(us, pt) & ~square_bb(from), ambiguous = 0;
+                while (others) {
+                    Square s = pop_lsb(others);
+                    if (pos.legal(make_move(s, to))) ambiguous |= square_bb(s);
+                }
+                if (ambiguous) {
+                    if (!(ambiguous & file_bb(file_of(from)))) san += static_cast<char>('a'+file_of(from));
+                    else if (!(ambiguous & rank_bb(rank_of(from)))) san += static_cast<char>('1'+rank_of(from));
+                    else san += square_to_str(from);
+                }
+            }
+            if (pos.capture(m)) san += 'x';
+            san += square_to_str(to);
+            if (type_of(m) == PROMOTION) { san += '='; san += PIECE_LETTERS[promotion_type(m)]; }
+        }
+
+        pos.do_move(m);
+        if (pos.in_check()) san += legal_moves(pos).size()? '+': '#';
+        pos.undo_move(m);
+        return san;
+    }
+
+    Move from_san(const Position& pos, std::string_view san) {
+
+        while (!san.empty() && (san.back() == '+' || san.back() == '#' || san.back() == '!' || san.back() == '?'))
+            san.remove_suffix(1);
+        if (san.size() < 2) return MOVE_NONE;
+
+        if (san == "O-O" || san == "0-0") return castling(pos, true);
+        if (san == "O-O-O" || san == "0-0-0") return castling(pos, false);
+
+        Color us = pos.side_to_move();
+        PieceType pt = PAWN, promotion = NO_PIECE_TYPE;
+        if (san[0] >= 'A' && san[0] <= 'Z') {
+            pt = letter_to_type(san[0]);
+            if (pt == NO_PIECE_TYPE) return MOVE_NONE;
+            san.remove_prefix(1);
+        }
+        else if (san.size() > 2 && !(san.back() >= '1' && san.back() <= '8')) {
+            promotion = letter_to_type(san.back());
+            if (promotion == NO_PIECE_TYPE || promotion == KING) return MOVE_NONE;
+            san.remove_suffix(1);
+            if (san.back() == '=') san.remove_suffix(1);
+        }
+        if (san.size() < 2) return MOVE_NONE;
+
+        char f = san[san.size()-2], r = san[san.size()-1];
+        if (f < 'a' || f > 'h' || r < '1' || r > '8') return MOVE_NONE;
+        Square to = make_square(f-'a', r-'1');
+        if (pos.pieces(us) & square_bb(to)) return MOVE_NONE;
+
+        int file = -1, rank = -1;
+        for (char c: san.substr(0, san.size()-2)) {
+            if (c >= 'a' && c <= 'h') file = c-'a';
+            else if (c >= '1' && c <= '8') rank = c-'1';
+            else if (c != 'x' && c != '-' && c != ':') return MOVE_NONE;
+        }
+
+        Move m = MOVE_NONE;
+        if (pt == PAWN) {
+
+            int up = pawn_push(us);
+            Piece pawn = make_piece(us, PAWN);
+            bool last_rank = relative_rank(us, rank_of(to)) == 7;
+            if (last_rank != (promotion != NO_PIECE_TYPE)) return MOVE_NONE;
+
+            if (file < 0 || file == file_of(to)) {
+                if (!pos.empty(to) || to-up < 0 || to-up > 63) return MOVE_NONE;
+                if (pos.piece_on(to-up) == pawn) m = make_move(to-up, to);
+                else if (pos.empty(to-up) && relative_rank(us, rank_of(to)) == 3 && pos.piece_on(to-2*up) == pawn)
+                    m = make_move(to-2*up, to);
+                else return MOVE_NONE;
+            }
+            else {
+                if (std::abs(file-file_of(to)) != 1 || to-up < 0 || to-up > 63) return MOVE_NONE;
+                Square from = make_square(file, rank_of(to-up));
+                if (pos.piece_on(from) != pawn) return MOVE_NONE;
+                if (to == pos.ep_square()) m = make<EN_PASSANT>(from, to);
+                else if (pos.pieces(~us) & square_bb(to)) m = make_move(from, to);
+                else return MOVE_NONE;
+            }
+            if (promotion != NO_PIECE_TYPE) m = make<PROMOTION>(from_sq(m), to, promotion);
+            return pos.legal(m)? m: MOVE_NONE;
+        }
+
+        Bitboard candidates = attacks_bb(pt, to, pos.pieces()) & pos.pieces(us, pt);
+        if (file >= 0) candidates &= file_bb(file);
+        if (rank >= 0) candidates &= rank_bb(rank);
+        while (candidates) {
+            Move c = make_move(pop_lsb(candidates), to);
+            if (!pos.legal(c)) continue;
+            if (m != MOVE_NONE) return MOVE_NONE;   // ambiguous
+            m = c;
+        }
+        return m;
+    }
+}
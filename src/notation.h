@@ -0,0 +1,22 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include "position.h"
+
+namespace engine {
+
+    std::string square_to_str(Square s);
+
+    /**
+     * Long algebraic notation as used by UCI: e2e4, e7e8q, e1g1 for castling
+    */
+    std::string to_uci(Move m);
+    Move from_uci(const Position& pos, std::string_view str);
+
+    /**
+     * Standard algebraic notation. from_san() accepts check/annotation suffixes,
+     * "0-0" as well as "O-O", and returns MOVE_NONE for illegal or ambiguous input
+    */
+    std::string to_san(Position& pos, Move m);
+    Move from_san(const Position& pos, std::string_view san);
+}
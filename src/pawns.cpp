@@ -0,0 +1,112 @@
+#include "pawns.h"
+#include <algorithm>
+#include <bit>
+
+namespace eval {
+
+    using namespace engine;
+
+    namespace {
+
+        constexpr auto ADJACENT_FILES = [] {
+
+            std::array<Bitboard, 8> t {};
+            for (int f=0; f<8; ++f) t[f] = (f > 0? file_bb(f-1): 0) | (f < 7? file_bb(f+1): 0);
+            return t;
+        }();
+
+        // squares in front of a pawn on its own and the adjacent files
+        constexpr auto PASSED_SPAN = [] {
+
+            std::array<std::array<Bitboard, 64>, COLOR_NB> t {};
+            for (Square s=0; s<64; ++s) {
+                Bitboard files = file_bb(file_of(s)) | ADJACENT_FILES[file_of(s)];
+                for (int r=0; r<8; ++r) {
+                    if (r > rank_of(s)) t[WHITE][s] |= files & rank_bb(r);
+                    if (r < rank_of(s)) t[BLACK][s] |= files & rank_bb(r);
+                }
+            }
+            return t;
+        }();
+
+        // two ranks in front of the king on its own and the adjacent files
+        constexpr auto KING_SHIELD = [] {
+
+            std::array<std::array<Bitboard, 64>, COLOR_NB> t {};
+            for (Color c: {WHITE, BLACK})
+                for (Square s=0; s<64; ++s)
+                    for (Square sq=0; sq<64; ++sq) {
+                        int distance = rank_of(sq) > rank_of(s)? rank_of(sq)-rank_of(s): rank_of(s)-rank_of(sq);
+                        if ((PASSED_SPAN[c][s] & square_bb(sq)) && distance <= 2) t[c][s] |= square_bb(sq);
+                    }
+            return t;
+        }();
+
+        Score evaluate_side(const Position& pos, Color c, Bitboard& passed, Trace* trace) {
+
+            Score score;
+            int sign = c == WHITE? 1: -1;
+            auto add = [&] (const Score& term) {
+                score += term;
+                if (trace) trace->add(term, sign);
+            };
+
+            Bitboard own = pos.pieces(c, PAWN), enemy = pos.pieces(~c, PAWN);
+            for (Bitboard b = own; b; ) {
+
+                Square s = pop_lsb(b);
+                int f = file_of(s);
+                Bitboard ahead = PASSED_SPAN[c][s] & file_bb(f);
+                bool isolated = !(ADJACENT_FILES[f] & own);
+
+                if (ahead & own) add(params.doubled_pawn);
+                else if (!(PASSED_SPAN[c][s] & enemy)) {
+                    add(params.passed_pawn[relative_rank(c, rank_of(s))]);
+                    passed |= square_bb(s);
+                }
+                if (isolated) add(params.isolated_pawn);
+                // no neighbour level or behind to support it and the advance runs into an enemy pawn
+                else if (!(ADJACENT_FILES[f] & ~PASSED_SPAN[c][s] & own) && (pawn_attacks[c][s + pawn_push(c)] & enemy))
+                    add(params.backward_pawn);
+            }
+            return score;
+        }
+    }
+
+    Score PawnEntry::king_shelter(const Position& pos, Color c, Trace* trace) {
+
+        Square ksq = pos.king_square(c);
+        if (king_square[c] != ksq) {
+            int pawns = popcount(KING_SHIELD[c][ksq] & pos.pieces(c, PAWN));
+            king_square[c] = ksq;
+            shield[c] = params.pawn_shield * pawns;
+            if (trace) trace->add(params.pawn_shield, c == WHITE? pawns: -pawns);
+        }
+        return shield[c];
+    }
+
+    void evaluate_pawns(const Position& pos, PawnEntry& entry, Trace* trace) {
+
+        entry.key = pos.pawn_key();
+        entry.passed[WHITE] = entry.passed[BLACK] = 0;
+        entry.king_square[WHITE] = entry.king_square[BLACK] = NO_SQUARE;
+        entry.score = evaluate_side(pos, WHITE, entry.passed[WHITE], trace) - evaluate_side(pos, BLACK, entry.passed[BLACK], trace);
+    }
+
+    PawnTable::PawnTable(size_t count): entries(std::bit_ceil(std::max<size_t>(count, 1))) {}
+
+    PawnEntry& PawnTable::probe(const Position& pos) {
+
+        PawnEntry& entry = entries[pos.pawn_key() & (entries.size()-1)];
+        ++probes;
+        // an unused entry has key 0 and matches only a board without pawns, whose terms are all 0
+        if (entry.key == pos.pawn_key()) ++hits;
+        else evaluate_pawns(pos, entry);
+        return entry;
+    }
+
+    void PawnTable::clear() {
+
+        std::fill(entries.begin(), entries.end(), PawnEntry {});
+    }
+}
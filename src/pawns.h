@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+#include "eval.h"
+#include "position.h"
+
+namespace eval {
+
+    /**
+     * Pawn structure terms of one pawn configuration, white point of view
+    */
+    struct PawnEntry {
+        engine::Key key = 0;
+        Score score;                                        // doubled, isolated, backward and passed pawns
+        engine::Bitboard passed[engine::COLOR_NB] {};
+        engine::Square king_square[engine::COLOR_NB] {engine::NO_SQUARE, engine::NO_SQUARE};
+        Score shield[engine::COLOR_NB];                     // for the king on king_square
+
+        /**
+         * Pawn shield of the side's king, recomputed only when the king has moved
+        */
+        Score king_shelter(const engine::Position& pos, engine::Color c, Trace* trace = nullptr);
+    };
+
+    void evaluate_pawns(const engine::Position& pos, PawnEntry& entry, Trace* trace = nullptr);
+
+    /**
+     * Pawn structure cache indexed by the pawn key, one per search thread
+    */
+    class PawnTable {
+    private:
+        std::vector<PawnEntry> entries;
+        uint64_t hits = 0, probes = 0;
+    public:
+        /**
+         * count is rounded up to a power of two
+        */
+        explicit PawnTable(size_t count = 16384);
+
+        PawnEntry& probe(const engine::Position& pos);
+        void clear();
+        void reset_stats() { hits = probes = 0; }
+        uint64_t hit_count() const { return hits; }
+        uint64_t probe_count() const { return probes; }
+    };
+}
@@ -0,0 +1,217 @@
+#include "pgn.h"
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include "notation.h"
+#include "log.h"
+
+namespace pgn {
+
+    namespace {
+
+        constexpr size_t npos = std::string_view::npos;
+
+        inline bool is_space(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+        inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+        inline bool token_end(char c) { return is_space(c) || c == '{' || c == '}' || c == '(' || c == ')' || c == ';' || c == '$'; }
+
+        /**
+         * First game start at or after offset: a tag line whose previous line is not a tag line
+        */
+        size_t game_boundary(std::string_view text, size_t offset) {
+
+            if (offset == 0) return 0;
+            for (size_t pos = text.find("\n[", offset-1); pos != npos; pos = text.find("\n[", pos+1)) {
+
+                size_t prev = text.rfind('\n', pos == 0? 0: pos-1);
+                prev = prev == npos || prev == pos? 0: prev+1;
+                std::string_view line = text.substr(prev, pos-prev);
+                while (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+                if (line.empty() || line[0] != '[') return pos+1;
+            }
+            return text.size();
+        }
+
+        class Parser {
+        private:
+            std::string_view text;
+            size_t i = 0;
+            const engine::Position startpos;
+            engine::Position board;
+            Game game;
+            Stats stats;
+            const on_game& callback;
+            unsigned int thread;
+            bool done = false;
+
+            bool line_start() const { return i == 0 || text[i-1] == '\n'; }
+            void skip_line() { size_t eol = text.find('\n', i); i = eol == npos? text.size(): eol+1; }
+            void skip_space() { while (i < text.size() && is_space(text[i])) ++i; }
+
+            void skip_until(char c) { size_t p = text.find(c, i); i = p == npos? text.size(): p+1; }
+
+            void skip_variation() {
+
+                int depth = 0;
+                while (i < text.size()) {
+                    char c = text[i++];
+                    if (c == '(') ++depth;
+                    else if (c == ')' && --depth == 0) return;
+                    else if (c == '{') skip_until('}');
+                }
+            }
+
+            void parse_tag() {
+
+                size_t begin = ++i;
+                while (i < text.size() && !is_space(text[i]) && text[i] != '"' && text[i] != ']') ++i;
+                std::string_view name = text.substr(begin, i-begin);
+                while (i < text.size() && text[i] != '"' && text[i] != '\n') ++i;
+                if (i >= text.size() || text[i] != '"') { skip_line(); return; }
+
+                begin = ++i;
+                while (i < text.size() && text[i] != '"' && text[i] != '\n') i += text[i] == '\\'? 2: 1;
+                std::string_view value = text.substr(begin, std::min(i, text.size())-begin);
+                skip_line();
+
+                game.tags.push_back({name, value});
+                if (name == "FEN") game.fen = value;
+            }
+
+            void parse_token() {
+
+                size_t begin = i;
+                while (i < text.size() && !token_end(text[i])) ++i;
+                std::string_view token = text.substr(begin, i-begin);
+
+                if (is_digit(token[0])) {
+                    size_t digits = 0;
+                    while (digits < token.size() && is_digit(token[digits])) ++digits;
+                    // move number, possibly glued to the move as in "12.e4"
+                    if (digits < token.size() && token[digits] == '.') {
+                        size_t dots = digits;
+                        while (dots < token.size() && token[dots] == '.') ++dots;
+                        i = begin+dots;
+                        return;
+                    }
+                    Result r = to_result(token);
+                    if (r != UNKNOWN) { game.result = r; done = true; return; }
+                }
+                if (!game.valid) return;
+
+                engine::Move m = engine::from_san(board, token);
+                if (m == engine::MOVE_NONE) { game.valid = false; return; }
+                board.do_move(m);
+                game.moves.push_back(m);
+            }
+
+            void parse_movetext() {
+
+                while (i < text.size() && !done) {
+
+                    char c = text[i];
+                    if (is_space(c)) { ++i; continue; }
+                    if (line_start() && c == '[') return;     // next game without termination marker
+                    switch (c) {
+                        case '{': skip_until('}'); break;
+                        case ';': skip_line(); break;
+                        case '(': skip_variation(); break;
+                        case ')': case '}': ++i; break;
+                        case '$': ++i; while (i < text.size() && is_digit(text[i])) ++i; break;
+                        case '*': ++i; done = true; break;
+                        case '%': if (line_start()) skip_line(); else ++i; break;
+                        default: parse_token();
+                    }
+                }
+            }
+
+        public:
+            Parser(std::string_view text, const on_game& callback, unsigned int thread)
+                : text{text}, callback{callback}, thread{thread} {
+
+                game.tags.reserve(16);
+                game.moves.reserve(256);
+            }
+
+            Stats run() {
+
+                skip_space();
+                while (i < text.size()) {
+
+                    size_t begin = i;
+                    game.tags.clear();
+                    game.moves.clear();
+                    game.fen = {};
+                    game.result = UNKNOWN;
+                    game.valid = true;
+                    done = false;
+
+                    while (i < text.size() && text[i] == '[') { parse_tag(); skip_space(); }
+
+                    board = startpos;
+                    if (!game.fen.empty()) {
+                        try { board.set(game.fen); }
+                        catch (const std::invalid_argument&) { game.valid = false; }
+                    }
+                    parse_movetext();
+                    if (game.result == UNKNOWN) game.result = to_result(game.tag("Result"));
+                    skip_space();
+                    if (i == begin) { skip_line(); continue; }      // unreadable line, make progress
+
+                    ++stats.games;
+                    stats.moves += game.moves.size();
+                    if (!game.valid) ++stats.errors;
+                    if (callback) callback(game, thread);
+                }
+                stats.bytes = text.size();
+                return stats;
+            }
+        };
+    }
+
+    Result to_result(std::string_view token) {
+
+        if (token == "1-0") return WHITE_WINS;
+        if (token == "0-1") return BLACK_WINS;
+        if (token == "1/2-1/2") return DRAW;
+        return UNKNOWN;
+    }
+
+    unsigned int thread_count(unsigned int requested) {
+
+        if (requested) return requested;
+        unsigned int hw = std::thread::hardware_concurrency();
+        return hw? hw: 1;
+    }
+
+    Stats parse(std::string_view text, const on_game& callback, unsigned int thread) {
+
+        return Parser(text, callback, thread).run();
+    }
+
+    Stats Reader::read(const on_game& callback, unsigned int threads) const {
+
+        auto start = std::chrono::steady_clock::now();
+        std::string_view text = file.view();
+        threads = thread_count(threads);
+
+        std::vector<size_t> bounds {0};
+        for (unsigned int t=1; t<threads; ++t)
+            bounds.push_back(std::max(bounds.back(), game_boundary(text, text.size()/threads*t)));
+        bounds.push_back(text.size());
+
+        std::vector<Stats> stats(threads);
+        std::vector<std::thread> workers;
+        for (unsigned int t=0; t<threads; ++t)
+            workers.emplace_back([&, t] {
+                stats[t] = parse(text.substr(bounds[t], bounds[t+1]-bounds[t]), callback, t);
+            });
+        for (auto& w: workers) w.join();
+
+        Stats total;
+        for (const Stats& s: stats) total += s;
+        total.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        LOGD("Read %lu games, %lu moves, %lu errors in %.2fs", total.games, total.moves, total.errors, total.seconds)
+        return total;
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "position.h"
+#include "mapped_file.h"
+
+namespace pgn {
+
+    enum Result { UNKNOWN, WHITE_WINS, BLACK_WINS, DRAW };
+
+    /**
+     * Views point straight into the mapped file, values keep PGN escapes (\" and \\) as is
+    */
+    struct Tag {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    struct Game {
+        std::vector<Tag> tags;
+        std::vector<engine::Move> moves;
+        std::string_view fen;       // FEN tag, empty for the standard start position
+        Result result = UNKNOWN;
+        bool valid = true;          // false when replay stopped on an illegal move, moves keeps the legal prefix
+
+        std::string_view tag(std::string_view name) const {
+
+            for (const Tag& t: tags) if (t.name == name) return t.value;
+            return {};
+        }
+        engine::Position start() const { return fen.empty()? engine::Position(): engine::Position(fen); }
+    };
+
+    struct Stats {
+        uint64_t games = 0;
+        uint64_t moves = 0;
+        uint64_t errors = 0;
+        uint64_t bytes = 0;
+        double seconds = 0;
+
+        Stats& operator += (const Stats& other) {
+
+            games += other.games, moves += other.moves, errors += other.errors, bytes += other.bytes;
+            return *this;
+        }
+    };
+
+    /**
+     * Called once per game, concurrently from every reader thread. The game and its views
+     * are valid only during the call, thread is the index of the calling reader thread
+    */
+    using on_game = std::function<void (const Game& game, unsigned int thread)>;
+
+    /**
+     * Parses games from the text sequentially in the calling thread
+    */
+    Stats parse(std::string_view text, const on_game& callback, unsigned int thread = 0);
+
+    class Reader {
+    private:
+        io::MappedFile file;
+    public:
+        explicit Reader(const std::string& path): file(path) {}
+
+        /**
+         * Splits the mapped file at game boundaries and parses the parts in parallel,
+         * threads==0 uses every hardware thread
+        */
+        Stats read(const on_game& callback, unsigned int threads = 0) const;
+        std::string_view text() const { return file.view(); }
+    };
+
+    unsigned int thread_count(unsigned int requested);
+    Result to_result(std::string_view token);
+}
@@ -0,0 +1,441 @@
+#include "position.h"
+#include "movegen.h"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace engine {
+
+    namespace {
+
+        constexpr std::string_view PIECE_CHARS = " PNBRQK  pnbrqk";
+
+        // castling rights lost when a piece leaves or enters the square
+        constexpr auto castling_mask = [] {
+
+            std::array<int, 64> m {};
+            m[0]  = WHITE_OOO; m[7]  = WHITE_OO; m[4]  = WHITE_OO|WHITE_OOO;
+            m[56] = BLACK_OOO; m[63] = BLACK_OO; m[60] = BLACK_OO|BLACK_OOO;
+            return m;
+        }();
+
+        inline void castling_rook(Square from, Square to, Square& rfrom, Square& rto) {
+
+            bool king_side = to > from;
+            rfrom = king_side? to+1: to-2;
+            rto   = king_side? to-1: to+1;
+        }
+    }
+
+    void Position::push_state(const StateInfo& s) {
+
+        states.push_back(s);
+        if (accumulators.size() < states.size()) accumulators.resize(states.size());
+        accumulators[states.size()-1].computed[WHITE] = accumulators[states.size()-1].computed[BLACK] = false;
+    }
+
+    void Position::put_piece(Piece pc, Square s) {
+
+        board[s] = pc;
+        by_type[type_of(pc)] |= square_bb(s);
+        by_color[color_of(pc)] |= square_bb(s);
+        psq += eval::psq[pc][s];
+    }
+
+    void Position::remove_piece(Square s) {
+
+        Piece pc = board[s];
+        by_type[type_of(pc)] ^= square_bb(s);
+        by_color[color_of(pc)] ^= square_bb(s);
+        board[s] = NO_PIECE;
+        psq -= eval::psq[pc][s];
+    }
+
+    void Position::move_piece(Square from, Square to) {
+
+        Piece pc = board[from];
+        Bitboard from_to = square_bb(from) | square_bb(to);
+        by_type[type_of(pc)] ^= from_to;
+        by_color[color_of(pc)] ^= from_to;
+        board[from] = NO_PIECE;
+        board[to] = pc;
+        psq += eval::psq[pc][to] - eval::psq[pc][from];
+    }
+
+    void Position::set(std::string_view fen) {
+
+        board.fill(NO_PIECE);
+        by_type.fill(0);
+        by_color.fill(0);
+        psq = {};
+        states.clear();
+        states.reserve(256);
+
+        std::istringstream str {std::string(fen)};
+        std::string placement, color, castling, ep;
+        int rule50 = 0, move_number = 1;
+        str >> placement >> color >> castling >> ep;
+        if (!(str >> rule50)) rule50 = 0;
+        if (!(str >> move_number)) move_number = 1;
+        if (placement.empty() || (color != "w" && color != "b"))
+            throw std::invalid_argument("Invalid FEN: " + std::string(fen));
+
+        int file = 0, rank = 7;
+        for (char c: placement) {
+
+            if (c == '/') { --rank; file = 0; }
+            else if (c >= '1' && c <= '8') file += c-'0';
+            else {
+                size_t idx = PIECE_CHARS.find(c);
+                if (idx == std::string_view::npos || c == ' ' || file > 7 || rank < 0)
+                    throw std::invalid_argument("Invalid FEN: " + std::string(fen));
+                put_piece(Piece(idx), make_square(file++, rank));
+            }
+        }
+        if (popcount(pieces(WHITE, KING)) != 1 || popcount(pieces(BLACK, KING)) != 1)
+            throw std::invalid_argument("Invalid FEN, need one king per side: " + std::string(fen));
+
+        side = color == "w"? WHITE: BLACK;
+        ply = std::max(2*(move_number-1), 0) + (side == BLACK);
+
+        StateInfo s {};
+        s.ep = NO_SQUARE;
+        s.rule50 = rule50;
+        for (char c: castling) {
+            switch (c) {
+                case 'K': if (piece_on(4) == W_KING && piece_on(7) == W_ROOK) s.castling |= WHITE_OO; break;
+                case 'Q': if (piece_on(4) == W_KING && piece_on(0) == W_ROOK) s.castling |= WHITE_OOO; break;
+                case 'k': if (piece_on(60) == B_KING && piece_on(63) == B_ROOK) s.castling |= BLACK_OO; break;
+                case 'q': if (piece_on(60) == B_KING && piece_on(56) == B_ROOK) s.castling |= BLACK_OOO; break;
+                default: break;
+            }
+        }
+        // keep en passant square only when a capture is possible, so equal positions get equal keys
+        if (ep.size() == 2 && ep[0] >= 'a' && ep[0] <= 'h' && (ep[1] == '3' || ep[1] == '6')) {
+            Square sq = make_square(ep[0]-'a', ep[1]-'1');
+            if (pawn_attacks[~side][sq] & pieces(side, PAWN)) s.ep = sq;
+        }
+
+        s.key = side == BLACK? zobrist::keys.side: 0;
+        for (Bitboard b = pieces(); b; ) { Square sq = pop_lsb(b); s.key ^= zobrist::keys.psq[board[sq]][sq]; }
+        for (Bitboard b = pieces(PAWN); b; ) { Square sq = pop_lsb(b); s.pawn_key ^= zobrist::keys.psq[board[sq]][sq]; }
+        s.key ^= zobrist::keys.castling[s.castling];
+        if (s.ep != NO_SQUARE) s.key ^= zobrist::keys.ep[file_of(s.ep)];
+        push_state(s);
+        update_check_info();
+    }
+
+    void Position::set(const Piece* pieces, const Square* squares, int count, Color stm) {
+
+        board.fill(NO_PIECE);
+        by_type.fill(0);
+        by_color.fill(0);
+        psq = {};
+        states.clear();
+        states.reserve(256);
+
+        StateInfo s {};
+        s.ep = NO_SQUARE;
+        s.key = stm == BLACK? zobrist::keys.side: 0;
+        for (int i=0; i<count; ++i) {
+            put_piece(pieces[i], squares[i]);
+            s.key ^= zobrist::keys.psq[pieces[i]][squares[i]];
+            if (type_of(pieces[i]) == PAWN) s.pawn_key ^= zobrist::keys.psq[pieces[i]][squares[i]];
+        }
+        s.key ^= zobrist::keys.castling[0];
+        side = stm;
+        ply = stm == BLACK;
+        push_state(s);
+        update_check_info();
+    }
+
+    std::string Position::fen() const {
+
+        std::ostringstream str;
+        for (int rank=7; rank>=0; --rank) {
+
+            int gap = 0;
+            for (int file=0; file<8; ++file) {
+                Piece pc = board[make_square(file, rank)];
+                if (pc == NO_PIECE) { ++gap; continue; }
+                if (gap) { str << gap; gap = 0; }
+                str << PIECE_CHARS[pc];
+            }
+            if (gap) str << gap;
+            if (rank) str << '/';
+        }
+        str << (side == WHITE? " w ": " b ");
+        int cr = castling_rights();
+        if (cr & WHITE_OO)  str << 'K';
+        if (cr & WHITE_OOO) str << 'Q';
+        if (cr & BLACK_OO)  str << 'k';
+        if (cr & BLACK_OOO) str << 'q';
+        if (!cr) str << '-';
+        if (ep_square() == NO_SQUARE) str << " -";
+        else str << ' ' << static_cast<char>('a'+file_of(ep_square())) << static_cast<char>('1'+rank_of(ep_square()));
+        str << ' ' << rule50() << ' ' << 1+ply/2;
+        return str.str();
+    }
+
+    Bitboard Position::attackers_to(Square s, Bitboard occupied) const {
+
+        return (pawn_attacks[BLACK][s] & pieces(WHITE, PAWN))
+             | (pawn_attacks[WHITE][s] & pieces(BLACK, PAWN))
+             | (knight_attacks[s] & pieces(KNIGHT))
+             | (rook_attacks(s, occupied) & pieces(ROOK, QUEEN))
+             | (bishop_attacks(s, occupied) & pieces(BISHOP, QUEEN))
+             | (king_attacks[s] & pieces(KING));
+    }
+
+    void Position::update_check_info() {
+
+        Color us = side, them = ~side;
+        Square ksq = king_square(us);
+        StateInfo& s = st();
+        s.checkers = attackers_to(ksq) & pieces(them);
+        s.pinned = 0;
+
+        Bitboard snipers = (rook_attacks(ksq, 0) & pieces(them, ROOK, QUEEN))
+                         | (bishop_attacks(ksq, 0) & pieces(them, BISHOP, QUEEN));
+        while (snipers) {
+            Bitboard b = between_bb[ksq][pop_lsb(snipers)] & pieces();
+            if (b && !more_than_one(b)) s.pinned |= b & pieces(us);
+        }
+    }
+
+    bool Position::is_draw() const {
+
+        if (st().rule50 > 99 && !in_check()) return true;
+
+        int end = std::min(st().rule50, st().plies_from_null);
+        for (int i=4; i<=end && i<static_cast<int>(states.size()); i+=2)
+            if (states[states.size()-1-i].key == st().key) return true;
+        return false;
+    }
+
+    bool Position::legal(Move m) const {
+
+        Color us = side, them = ~side;
+        Square from = from_sq(m), to = to_sq(m), ksq = king_square(us);
+
+        if (type_of(m) == EN_PASSANT) {
+
+            Square capsq = to - pawn_push(us);
+            Bitboard occupied = (pieces() ^ square_bb(from) ^ square_bb(capsq)) | square_bb(to);
+            return !(attackers_to(ksq, occupied) & pieces(them) & ~square_bb(capsq));
+        }
+
+        if (type_of(m) == CASTLING) {
+
+            if (in_check()) return false;
+            int step = to > from? 1: -1;
+            for (Square s = from+step; s != to+step; s += step)
+                if (attackers_to(s) & pieces(them)) return false;
+            return true;
+        }
+
+        if (from == ksq) return !(attackers_to(to, pieces() ^ square_bb(from)) & pieces(them));
+
+        Bitboard checkers = st().checkers;
+        if (checkers) {
+            if (more_than_one(checkers)) return false;
+            if (!((between_bb[ksq][lsb(checkers)] | checkers) & square_bb(to))) return false;
+        }
+        return !(st().pinned & square_bb(from)) || aligned(from, to, ksq);
+    }
+
+    bool Position::pseudo_legal(Move m) const {
+
+        Color us = side;
+        Square from = from_sq(m), to = to_sq(m);
+        Piece pc = board[from];
+        if (m == MOVE_NONE || m == MOVE_NULL || pc == NO_PIECE || color_of(pc) != us) return false;
+
+        // special moves are rare here, compare with the generator
+        if (type_of(m) != NORMAL) {
+            MoveList list;
+            generate<PSEUDO_LEGAL>(*this, list);
+            return list.contains(m);
+        }
+
+        if (pieces(us) & square_bb(to)) return false;
+        if (type_of(pc) != PAWN) return attacks_bb(type_of(pc), from, pieces()) & square_bb(to);
+
+        if (relative_rank(us, rank_of(to)) == 7) return false;
+        if (pawn_attacks[us][from] & pieces(~us) & square_bb(to)) return true;
+        if (!empty(to)) return false;
+        return from + pawn_push(us) == to
+            || (from + 2*pawn_push(us) == to && relative_rank(us, rank_of(from)) == 1 && empty(from + pawn_push(us)));
+    }
+
+    bool Position::gives_check(Move m) const {
+
+        Color us = side, them = ~side;
+        Square from = from_sq(m), to = to_sq(m), ksq = king_square(them);
+        PieceType moved = type_of(m) == PROMOTION? promotion_type(m): type_of(board[from]);
+        Bitboard occupied = (pieces() ^ square_bb(from)) | square_bb(to);
+        Bitboard own = (pieces(us) ^ square_bb(from)) | square_bb(to);
+
+        if (type_of(m) == EN_PASSANT) occupied ^= square_bb(to - pawn_push(us));
+        if (type_of(m) == CASTLING) {
+            Square rfrom, rto;
+            castling_rook(from, to, rfrom, rto);
+            occupied ^= square_bb(rfrom) | square_bb(rto);
+            return rook_attacks(rto, occupied) & square_bb(ksq);
+        }
+
+        auto after = [&] (PieceType pt) { return (pieces(us, pt) & own) | (moved == pt? square_bb(to): 0); };
+        return (pawn_attacks[them][ksq] & after(PAWN))
+             | (knight_attacks[ksq] & after(KNIGHT))
+             | (bishop_attacks(ksq, occupied) & (after(BISHOP) | after(QUEEN)))
+             | (rook_attacks(ksq, occupied) & (after(ROOK) | after(QUEEN)));
+    }
+
+    Key Position::key_after(Move m) const {
+
+        Color us = side, them = ~side;
+        Square from = from_sq(m), to = to_sq(m);
+        Piece pc = board[from];
+        Piece captured = type_of(m) == EN_PASSANT? make_piece(them, PAWN): board[to];
+        Key k = st().key ^ zobrist::keys.side;
+        if (st().ep != NO_SQUARE) k ^= zobrist::keys.ep[file_of(st().ep)];
+
+        if (type_of(m) == CASTLING) {
+            Square rfrom, rto;
+            castling_rook(from, to, rfrom, rto);
+            k ^= zobrist::keys.psq[board[rfrom]][rfrom] ^ zobrist::keys.psq[board[rfrom]][rto];
+            captured = NO_PIECE;
+        }
+        if (captured) k ^= zobrist::keys.psq[captured][type_of(m) == EN_PASSANT? to - pawn_push(us): to];
+
+        Piece placed = type_of(m) == PROMOTION? make_piece(us, promotion_type(m)): pc;
+        k ^= zobrist::keys.psq[pc][from] ^ zobrist::keys.psq[placed][to];
+
+        int castling = st().castling;
+        if (castling && (castling_mask[from] | castling_mask[to]))
+            k ^= zobrist::keys.castling[castling] ^ zobrist::keys.castling[castling & ~(castling_mask[from] | castling_mask[to])];
+
+        if (type_of(pc) == PAWN && (from^to) == 16 && (pawn_attacks[us][from+pawn_push(us)] & pieces(them, PAWN)))
+            k ^= zobrist::keys.ep[file_of(from+pawn_push(us))];
+        return k;
+    }
+
+    void Position::do_move(Move m) {
+
+        StateInfo n = st();
+        Color us = side, them = ~side;
+        Square from = from_sq(m), to = to_sq(m);
+        Piece pc = board[from];
+        Piece captured = type_of(m) == EN_PASSANT? make_piece(them, PAWN): board[to];
+        DirtyPiece& dp = n.dirty;
+        dp.count = 1;
+        dp.piece[0] = pc, dp.from[0] = from, dp.to[0] = to;
+
+        n.key ^= zobrist::keys.side;
+        n.rule50++;
+        n.plies_from_null++;
+        if (n.ep != NO_SQUARE) { n.key ^= zobrist::keys.ep[file_of(n.ep)]; n.ep = NO_SQUARE; }
+
+        if (type_of(m) == CASTLING) {
+
+            Square rfrom, rto;
+            castling_rook(from, to, rfrom, rto);
+            Piece rook = board[rfrom];
+            dp.piece[1] = rook, dp.from[1] = rfrom, dp.to[1] = rto, dp.count = 2;
+            n.key ^= zobrist::keys.psq[rook][rfrom] ^ zobrist::keys.psq[rook][rto];
+            move_piece(rfrom, rto);
+            captured = NO_PIECE;
+        }
+
+        if (captured) {
+
+            Square capsq = type_of(m) == EN_PASSANT? to - pawn_push(us): to;
+            dp.piece[1] = captured, dp.from[1] = capsq, dp.to[1] = NO_SQUARE, dp.count = 2;
+            n.key ^= zobrist::keys.psq[captured][capsq];
+            if (type_of(captured) == PAWN) n.pawn_key ^= zobrist::keys.psq[captured][capsq];
+            remove_piece(capsq);
+            n.rule50 = 0;
+        }
+
+        n.key ^= zobrist::keys.psq[pc][from] ^ zobrist::keys.psq[pc][to];
+        move_piece(from, to);
+
+        if (n.castling && (castling_mask[from] | castling_mask[to])) {
+
+            n.key ^= zobrist::keys.castling[n.castling];
+            n.castling &= ~(castling_mask[from] | castling_mask[to]);
+            n.key ^= zobrist::keys.castling[n.castling];
+        }
+
+        if (type_of(pc) == PAWN) {
+
+            n.rule50 = 0;
+            n.pawn_key ^= zobrist::keys.psq[pc][from] ^ zobrist::keys.psq[pc][to];
+            if ((from^to) == 16 && (pawn_attacks[us][from+pawn_push(us)] & pieces(them, PAWN))) {
+                n.ep = from+pawn_push(us);
+                n.key ^= zobrist::keys.ep[file_of(n.ep)];
+            }
+            else if (type_of(m) == PROMOTION) {
+                Piece promoted = make_piece(us, promotion_type(m));
+                remove_piece(to);
+                put_piece(promoted, to);
+                dp.to[0] = NO_SQUARE;
+                dp.piece[dp.count] = promoted, dp.from[dp.count] = NO_SQUARE, dp.to[dp.count] = to, ++dp.count;
+                n.key ^= zobrist::keys.psq[pc][to] ^ zobrist::keys.psq[promoted][to];
+                n.pawn_key ^= zobrist::keys.psq[pc][to];
+            }
+        }
+
+        n.captured = captured;
+        side = them;
+        ++ply;
+        push_state(n);
+        update_check_info();
+    }
+
+    void Position::undo_move(Move m) {
+
+        side = ~side;
+        --ply;
+        Color us = side;
+        Square from = from_sq(m), to = to_sq(m);
+        Piece captured = st().captured;
+
+        if (type_of(m) == PROMOTION) {
+            remove_piece(to);
+            put_piece(make_piece(us, PAWN), to);
+        }
+
+        move_piece(to, from);
+        if (type_of(m) == CASTLING) {
+            Square rfrom, rto;
+            castling_rook(from, to, rfrom, rto);
+            move_piece(rto, rfrom);
+        }
+        else if (captured) put_piece(captured, type_of(m) == EN_PASSANT? to - pawn_push(us): to);
+
+        states.pop_back();
+    }
+
+    void Position::do_null_move() {
+
+        StateInfo n = st();
+        n.key ^= zobrist::keys.side;
+        if (n.ep != NO_SQUARE) { n.key ^= zobrist::keys.ep[file_of(n.ep)]; n.ep = NO_SQUARE; }
+        n.rule50++;
+        n.plies_from_null = 0;
+        n.captured = NO_PIECE;
+        n.dirty.count = 0;
+        side = ~side;
+        ++ply;
+        push_state(n);
+        update_check_info();
+    }
+
+    void Position::undo_null_move() {
+
+        side = ~side;
+        --ply;
+        states.pop_back();
+    }
+}
@@ -0,0 +1,170 @@
+#pragma once
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "bitboard.h"
+#include "eval.h"
+#include "move.h"
+#include "nnue.h"
+
+namespace engine {
+
+    namespace zobrist {
+
+        constexpr Key next_random(Key& s) {
+
+            // xorshift64*, fixed seed so keys are identical in every build
+            s ^= s >> 12, s ^= s << 25, s ^= s >> 27;
+            return s * 2685821657736338717ULL;
+        }
+
+        struct Keys {
+            Key psq[PIECE_NB][64] {};
+            Key castling[16] {};
+            Key ep[8] {};
+            Key side = 0;
+        };
+
+        inline constexpr Keys keys = [] {
+
+            Keys k;
+            Key seed = 1070372;
+            for (int p=0; p<PIECE_NB; ++p)
+                for (Square s=0; s<64; ++s) k.psq[p][s] = next_random(seed);
+            for (int c=0; c<16; ++c) k.castling[c] = next_random(seed);
+            for (int f=0; f<8; ++f) k.ep[f] = next_random(seed);
+            k.side = next_random(seed);
+            return k;
+        }();
+    }
+
+    /**
+     * Pieces changed by the last move, read by the NNUE accumulator update
+    */
+    struct DirtyPiece {
+        int count;
+        Piece piece[3];
+        Square from[3];     // NO_SQUARE - piece added
+        Square to[3];       // NO_SQUARE - piece removed
+    };
+
+    /**
+     * Irreversible part of a position, one entry per played move
+    */
+    struct StateInfo {
+        Key key;
+        Key pawn_key;       // pawns only, for the pawn structure cache
+        int castling;
+        Square ep;
+        int rule50;
+        int plies_from_null;
+        Piece captured;
+        Bitboard checkers;  // enemy pieces giving check to side to move
+        Bitboard pinned;    // side to move pieces pinned to own king
+        DirtyPiece dirty;
+    };
+
+    class Position {
+    private:
+        std::array<Piece, 64> board;
+        std::array<Bitboard, PIECE_TYPE_NB> by_type;
+        std::array<Bitboard, COLOR_NB> by_color;
+        Color side;
+        int ply;
+        eval::Score psq;        // material and piece-square sum, white point of view
+        std::vector<StateInfo> states;
+        mutable std::vector<nnue::Accumulator> accumulators;    // one per state, filled on demand
+
+        void put_piece(Piece pc, Square s);
+        void remove_piece(Square s);
+        void move_piece(Square from, Square to);
+        void update_check_info();
+        StateInfo& st() { return states.back(); }
+        const StateInfo& st() const { return states.back(); }
+        void push_state(const StateInfo& s);
+    public:
+        static constexpr const char* START_FEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+        Position() { set(START_FEN); }
+        explicit Position(std::string_view fen) { set(fen); }
+
+        /**
+         * Throws std::invalid_argument on malformed FEN
+        */
+        void set(std::string_view fen);
+
+        /**
+         * Pieces on an empty board without castling or en passant, fast setup for enumerating
+         * tablebase positions. The caller checks squares are distinct and there is one king per side
+        */
+        void set(const Piece* pieces, const Square* squares, int count, Color stm);
+        std::string fen() const;
+
+        Piece piece_on(Square s) const { return board[s]; }
+        bool empty(Square s) const { return board[s] == NO_PIECE; }
+        Bitboard pieces() const { return by_color[WHITE] | by_color[BLACK]; }
+        Bitboard pieces(Color c) const { return by_color[c]; }
+        Bitboard pieces(PieceType pt) const { return by_type[pt]; }
+        Bitboard pieces(PieceType pt1, PieceType pt2) const { return by_type[pt1] | by_type[pt2]; }
+        Bitboard pieces(Color c, PieceType pt) const { return by_color[c] & by_type[pt]; }
+        Bitboard pieces(Color c, PieceType pt1, PieceType pt2) const { return by_color[c] & (by_type[pt1] | by_type[pt2]); }
+        Square king_square(Color c) const { return lsb(pieces(c, KING)); }
+        eval::Score psq_score() const { return psq; }
+
+        Color side_to_move() const { return side; }
+        int castling_rights() const { return st().castling; }
+        Square ep_square() const { return st().ep; }
+        int rule50() const { return st().rule50; }
+        int game_ply() const { return ply; }
+        Key key() const { return st().key; }
+        Key pawn_key() const { return st().pawn_key; }
+        Bitboard checkers() const { return st().checkers; }
+        bool in_check() const { return st().checkers != 0; }
+        Piece captured_piece() const { return st().captured; }
+        Piece moved_piece(Move m) const { return board[from_sq(m)]; }
+        bool capture(Move m) const { return (!empty(to_sq(m)) && type_of(m) != CASTLING) || type_of(m) == EN_PASSANT; }
+
+        Bitboard attackers_to(Square s, Bitboard occupied) const;
+        Bitboard attackers_to(Square s) const { return attackers_to(s, pieces()); }
+        bool attacked(Square s, Color by) const { return attackers_to(s) & pieces(by); }
+
+        /**
+         * Fifty move rule or a repetition since the last irreversible move, used inside search
+         * where a single repetition is enough to score the line as a draw
+        */
+        bool is_draw() const;
+
+        /**
+         * Full legality check for a pseudo legal move
+        */
+        bool legal(Move m) const;
+
+        /**
+         * Whether the move could be generated here, validates hash and killer moves
+        */
+        bool pseudo_legal(Move m) const;
+
+        /**
+         * NNUE view of the state n moves back, 0 - current
+        */
+        int state_count() const { return static_cast<int>(states.size()); }
+        const DirtyPiece& dirty_piece(int back) const { return states[states.size()-1-back].dirty; }
+        nnue::Accumulator& accumulator(int back) const { return accumulators[states.size()-1-back]; }
+
+        /**
+         * Whether the pseudo legal move checks the enemy king, directly or by discovery
+        */
+        bool gives_check(Move m) const;
+
+        /**
+         * Key of the position after a legal move without making it
+        */
+        Key key_after(Move m) const;
+
+        void do_move(Move m);
+        void undo_move(Move m);
+        void do_null_move();
+        void undo_null_move();
+    };
+}
@@ -0,0 +1,517 @@
+#include "search.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include "movegen.h"
+#include "movepick.h"
+#include "eval.h"
+#include "tb.h"
+#include "trace.h"
+
+namespace search {
+
+    using namespace engine;
+
+    namespace {
+
+        // mate and tablebase scores are stored relative to the node, not the root
+        int to_tt(int score, int ply) {
+            return score >= VALUE_TB_WIN_IN_MAX_PLY? score+ply: score <= -VALUE_TB_WIN_IN_MAX_PLY? score-ply: score;
+        }
+
+        int from_tt(int score, int ply) {
+            return score >= VALUE_TB_WIN_IN_MAX_PLY? score-ply: score <= -VALUE_TB_WIN_IN_MAX_PLY? score+ply: score;
+        }
+
+        // move keeping the tablebase result: fastest mate, then a draw, then longest defence
+        Move tb_best(Position& pos) {
+
+            Move best = MOVE_NONE;
+            int best_rank = INT32_MIN;
+            for (Move m: legal_moves(pos)) {
+
+                tb::WDL wdl;
+                int moves;
+                pos.do_move(m);
+                bool found = tb::probe_dtm(pos, wdl, moves);
+                pos.undo_move(m);
+                if (!found) return MOVE_NONE;
+
+                int rank = wdl == tb::WDL_LOSS? 1000-moves: wdl == tb::WDL_WIN? -1000+moves: 0;
+                if (rank > best_rank) best_rank = rank, best = m;
+            }
+            return best;
+        }
+
+        // plies of the DTZ line reported at the root, every ply probes all legal moves
+        constexpr int DTZ_LINE = 8;
+
+        /**
+         * Syzygy root order, higher is better: wins the fifty move rule allows, faster first (rank / 10000 == 4),
+         * wins it turns into draws (3), draws (2), losses it saves (1), other losses, slower first (0)
+        */
+        int dtz_rank(int plies, int rule50) {
+
+            if (plies > 0) return (plies + rule50 <= 99? 50000: 40000) - plies;
+            if (plies < 0) return (-plies + rule50 <= 99? 0: 10000) - plies;
+            return 25000;
+        }
+
+        // legal moves by dtz_rank, best first, false when a table is missing
+        bool dtz_ranks(Position& pos, std::vector<std::pair<int, Move>>& ranked) {
+
+            ranked.clear();
+            for (Move m: legal_moves(pos)) {
+
+                int plies;
+                pos.do_move(m);
+                bool found = tb::probe_dtz(pos, plies);
+                bool zeroing = !pos.rule50(), mate = pos.in_check() && !legal_moves(pos).size();
+                pos.undo_move(m);
+                if (!found) return false;
+
+                // one ply more from our side, a capture or pawn move zeroes the count itself
+                if (mate) plies = 1;
+                else if (zeroing) plies = -(plies > 100? 101: plies > 0? 1: plies < -100? -101: plies < 0? -1: 0);
+                else plies = plies > 0? -plies-1: plies < 0? -plies+1: 0;
+                ranked.emplace_back(dtz_rank(plies, pos.rule50()), m);
+            }
+            std::stable_sort(ranked.begin(), ranked.end(), [] (const auto& a, const auto& b) { return a.first > b.first; });
+            return !ranked.empty();
+        }
+    }
+
+    void Searcher::check_limits() {
+
+        if (stop_requested.load(std::memory_order_relaxed)) stopped = true;
+        if (limits.nodes && stats.nodes >= limits.nodes) stopped = true;
+        if ((stats.nodes & 1023) == 0 && time.enabled() && !pondering && elapsed() >= time.maximum()) stopped = true;
+    }
+
+    void Searcher::update_pv(int ply, Move m) {
+
+        pv[ply][ply] = m;
+        for (int j=ply+1; j<pv_length[ply+1]; ++j) pv[ply][j] = pv[ply+1][j];
+        pv_length[ply] = std::max(pv_length[ply+1], ply+1);
+    }
+
+    Info Searcher::report(int depth, int score, const Move* line, int length, int multipv) {
+
+        Info info;
+        info.depth = depth;
+        info.multipv = multipv;
+        info.seldepth = std::max(seldepth, length);
+        info.score = score;
+        info.nodes = stats.nodes;
+        info.time = elapsed();
+        info.hashfull = tt.hashfull();
+        info.tb_hits = tb_hits;
+        info.tb_probes = tb_probes;
+        info.pv.assign(line, line+length);
+        if (info_callback) info_callback(info);
+        return info;
+    }
+
+    bool Searcher::tb_root(Result& result) {
+
+        if (pos.castling_rights() || popcount(pos.pieces()) > tb::max_pieces()) return false;
+
+        tb::WDL wdl;
+        int moves;
+        std::vector<std::pair<int, Move>> ranked;
+        ++tb_probes;
+        if (dtz_ranks(pos, ranked)) { ++tb_hits; return tb_root_dtz(result, ranked); }
+        if (!tb::probe_dtm(pos, wdl, moves)) return false;
+        ++tb_hits;
+
+        if (wdl == tb::WDL_DRAW) {
+            // search chooses among the moves holding the draw
+            for (Move m: legal_moves(pos)) {
+                tb::WDL child;
+                pos.do_move(m);
+                bool found = tb::probe_dtm(pos, child, moves);
+                pos.undo_move(m);
+                if (!found) { root_moves.clear(); return false; }
+                if (child == tb::WDL_DRAW) root_moves.push_back(m);
+            }
+            return false;
+        }
+
+        Move line[MAX_PLY];
+        int length = 0, score = wdl == tb::WDL_WIN? mate_in(2*moves-1): mated_in(2*moves);
+        while (length < std::min(MAX_PLY, VALUE_MATE-std::abs(score))) {
+            Move m = tb_best(pos);
+            if (m == MOVE_NONE) break;
+            line[length++] = m;
+            pos.do_move(m);
+        }
+        for (int i=length-1; i>=0; --i) pos.undo_move(line[i]);
+        if (!length) return false;
+
+        result.best = line[0];
+        result.ponder = length > 1? line[1]: MOVE_NONE;
+        result.score = score;
+        result.depth = 1;
+        result.lines.push_back(report(1, score, line, length, 1));
+        return true;
+    }
+
+    bool Searcher::tb_root_dtz(Result& result, std::vector<std::pair<int, Move>>& ranked) {
+
+        // a draw under the fifty move rule is left to the search among the moves keeping it
+        int category = ranked[0].first/10000;
+        if (category > 0 && category < 4) {
+            for (const auto& [rank, m]: ranked)
+                if (rank/10000 == category) root_moves.push_back(m);
+            return false;
+        }
+
+        Move line[DTZ_LINE];
+        int length = 0, score = category == 4? VALUE_TB_WIN: -VALUE_TB_WIN;
+        line[length++] = ranked[0].second;
+        pos.do_move(line[0]);
+        while (length < DTZ_LINE && dtz_ranks(pos, ranked)) {
+            line[length++] = ranked[0].second;
+            pos.do_move(ranked[0].second);
+        }
+        for (int i=length-1; i>=0; --i) pos.undo_move(line[i]);
+
+        result.best = line[0];
+        result.ponder = length > 1? line[1]: MOVE_NONE;
+        result.score = score;
+        result.depth = 1;
+        result.lines.push_back(report(1, score, line, length, 1));
+        return true;
+    }
+
+    Stats& Stats::operator += (const Stats& other) {
+
+        nodes += other.nodes, qnodes += other.qnodes;
+        tt_probes += other.tt_probes, tt_hits += other.tt_hits, tt_cutoffs += other.tt_cutoffs;
+        fail_highs += other.fail_highs, first_move_fail_highs += other.first_move_fail_highs;
+        null_tries += other.null_tries, null_cutoffs += other.null_cutoffs;
+        lmr_tries += other.lmr_tries, lmr_researches += other.lmr_researches;
+        pawn_probes += other.pawn_probes, pawn_hits += other.pawn_hits;
+        depth = std::max(depth, other.depth);
+        for (int d=0; d<MAX_PLY; ++d) {
+            iteration_nodes[d] += other.iteration_nodes[d];
+            iteration_time[d] = std::max(iteration_time[d], other.iteration_time[d]);     // threads run side by side
+        }
+        return *this;
+    }
+
+    double Stats::branching_factor(int d) const {
+
+        return d > 1 && d < MAX_PLY && iteration_nodes[d-1]? static_cast<double>(iteration_nodes[d])/iteration_nodes[d-1]: 0;
+    }
+
+    std::vector<std::string> Stats::to_lines() const {
+
+        auto percent = [] (uint64_t part, uint64_t total) { return std::to_string(total? 100*part/total: 0) + "%"; };
+        std::vector<std::string> lines {
+            "nodes " + std::to_string(nodes) + ", quiescence " + percent(qnodes, nodes),
+            "tt probes " + std::to_string(tt_probes) + ", hits " + percent(tt_hits, tt_probes) + ", cutoffs " + percent(tt_cutoffs, tt_probes),
+            "fail highs " + std::to_string(fail_highs) + ", on the first move " + percent(first_move_fail_highs, fail_highs),
+            "null moves " + std::to_string(null_tries) + ", cutoffs " + percent(null_cutoffs, null_tries),
+            "reductions " + std::to_string(lmr_tries) + ", searched again " + percent(lmr_researches, lmr_tries),
+            "pawn hash probes " + std::to_string(pawn_probes) + ", hits " + percent(pawn_hits, pawn_probes)
+        };
+        for (int d=1; d<=depth; ++d) {
+            char ebf[16];
+            std::snprintf(ebf, sizeof(ebf), "%.2f", branching_factor(d));
+            lines.push_back("depth " + std::to_string(d) + " nodes " + std::to_string(iteration_nodes[d])
+                            + " time " + std::to_string(iteration_time[d]) + " ms ebf " + ebf);
+        }
+        return lines;
+    }
+
+    std::string Stats::to_json() const {
+
+        std::string json = "{\"nodes\":" + std::to_string(nodes) + ",\"qnodes\":" + std::to_string(qnodes)
+            + ",\"tt\":{\"probes\":" + std::to_string(tt_probes) + ",\"hits\":" + std::to_string(tt_hits) + ",\"cutoffs\":" + std::to_string(tt_cutoffs) + "}"
+            + ",\"fail_high\":{\"count\":" + std::to_string(fail_highs) + ",\"first_move\":" + std::to_string(first_move_fail_highs) + "}"
+            + ",\"null_move\":{\"tries\":" + std::to_string(null_tries) + ",\"cutoffs\":" + std::to_string(null_cutoffs) + "}"
+            + ",\"lmr\":{\"tries\":" + std::to_string(lmr_tries) + ",\"researches\":" + std::to_string(lmr_researches) + "}"
+            + ",\"pawn_hash\":{\"probes\":" + std::to_string(pawn_probes) + ",\"hits\":" + std::to_string(pawn_hits) + "}"
+            + ",\"iterations\":[";
+        for (int d=1; d<=depth; ++d) {
+            char ebf[16];
+            std::snprintf(ebf, sizeof(ebf), "%.3f", branching_factor(d));
+            json += std::string(d > 1? ",": "") + "{\"depth\":" + std::to_string(d) + ",\"nodes\":" + std::to_string(iteration_nodes[d])
+                    + ",\"time\":" + std::to_string(iteration_time[d]) + ",\"ebf\":" + ebf + "}";
+        }
+        return json + "]}";
+    }
+
+    Stats Searcher::search_stats() const {
+
+        Stats s = stats;
+        s.pawn_probes = pawns.probe_count();
+        s.pawn_hits = pawns.hit_count();
+        return s;
+    }
+
+    Result Searcher::think(const Position& root, const Limits& l, on_info callback) {
+
+        TRACE_SCOPE("engine", "think")
+        pos = root;
+        limits = l;
+        info_callback = callback;
+        stopped = stop_requested.load();
+        stats = Stats();
+        tb_hits = tb_probes = 0;
+        seldepth = 0;
+        pawns.reset_stats();
+        root_moves.clear();
+        time.init(limits, pos.side_to_move(), pos.game_ply());
+        std::memset(killers, 0, sizeof(killers));
+        std::memset(history, 0, sizeof(history));
+        std::memset(countermoves, 0, sizeof(countermoves));
+        if (!shared_tt) tt.new_search();
+
+        Result result;
+        MoveList legal = legal_moves(pos);
+        if (!legal.size()) return result;
+        result.best = legal.moves[0];
+        if (tb_root(result)) {
+            while ((limits.infinite || pondering) && !stop_requested) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            return result;
+        }
+        if (!root_moves.empty()) result.best = root_moves[0];
+
+        // every line is a full root search without the moves of the lines before it
+        int line_count = std::clamp<int>(limits.multipv, 1, root_moves.empty()? legal.size(): root_moves.size());
+        for (int depth=1; depth<=limits.depth && depth<MAX_PLY; ++depth) {
+
+            std::vector<Info> lines;
+            excluded.clear();
+            uint64_t iteration_start = stats.nodes;
+            int64_t iteration_time = elapsed();
+            for (int line=1; line<=line_count; ++line) {
+                seldepth = 0;
+                int score = search(-VALUE_INFINITE, VALUE_INFINITE, depth, 0, false);
+                if (stopped && (depth > 1 || line > 1)) break;      // incomplete iteration
+                lines.push_back(report(depth, score, pv[0], pv_length[0], line));
+                if (stopped || !pv_length[0]) break;
+                excluded.push_back(pv[0][0]);
+            }
+            if (lines.empty()) break;
+            stats.depth = depth;
+            stats.iteration_nodes[depth] = stats.nodes - iteration_start;
+            stats.iteration_time[depth] = elapsed() - iteration_time;
+
+            Move previous = result.best;
+            const Info& first = lines[0];
+            if (!first.pv.empty()) {
+                result.best = first.pv[0];
+                result.ponder = first.pv.size() > 1? first.pv[1]: MOVE_NONE;
+            }
+            result.score = first.score;
+            result.depth = depth;
+            if (static_cast<int>(lines.size()) == line_count || result.lines.empty()) result.lines = std::move(lines);
+
+            if (stopped) break;
+            // time spent pondering counts towards the limits, the clock only runs after ponderhit
+            bool out_of_time = time.stop_iteration(depth, depth > 1 && result.best != previous, result.score);
+            if (out_of_time && !pondering) break;
+            if (!limits.infinite && is_mate_score(result.score) && VALUE_MATE-std::abs(result.score) <= depth) break;
+        }
+        // infinite analysis and pondering report the best move only after stop() or ponderhit()
+        while ((limits.infinite || pondering) && !stop_requested) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return result;
+    }
+
+    int Searcher::search(int alpha, int beta, int depth, int ply, bool null_allowed) {
+
+        pv_length[ply] = ply;
+        if (depth <= 0) return qsearch(alpha, beta, ply);
+
+        ++stats.nodes;
+        check_limits();
+        if (stopped) return 0;
+        seldepth = std::max(seldepth, ply);
+
+        bool pv_node = beta-alpha > 1;
+        if (ply) {
+            if (pos.is_draw()) return VALUE_DRAW;
+            if (ply >= MAX_PLY) return eval::evaluate(pos, &pawns);
+            alpha = std::max(mated_in(ply), alpha);
+            beta = std::min(mate_in(ply+1), beta);
+            if (alpha >= beta) return alpha;
+        }
+
+        Color us = pos.side_to_move();
+        bool in_check = pos.in_check();
+        TTData tte {};
+        bool tt_hit = tt.probe(pos.key(), tte);
+        Move tt_move = tt_hit? tte.move: MOVE_NONE;
+        ++stats.tt_probes;
+        stats.tt_hits += tt_hit;
+
+        if (tt_hit && !pv_node && tte.depth >= depth) {
+            int score = from_tt(tte.score, ply);
+            if (tte.bound == BOUND_EXACT || (tte.bound == BOUND_LOWER && score >= beta) || (tte.bound == BOUND_UPPER && score <= alpha)) {
+                ++stats.tt_cutoffs;
+                return score;
+            }
+        }
+
+        // tablebase cutoff once a capture or pawn move enters the covered material
+        if (ply && !pos.rule50() && !pos.castling_rights() && popcount(pos.pieces()) <= tb::max_pieces()) {
+
+            tb::WDL wdl;
+            ++tb_probes;
+            if (tb::probe_wdl(pos, wdl)) {
+                ++tb_hits;
+                // the result is exact, only the distance is unknown; the root plays it out by DTM
+                int score = wdl == tb::WDL_WIN? VALUE_TB_WIN-ply: wdl == tb::WDL_LOSS? -VALUE_TB_WIN+ply: VALUE_DRAW;
+                tt.store(pos.key(), MOVE_NONE, to_tt(score, ply), eval::evaluate(pos, &pawns), std::min(depth+6, MAX_PLY-1), BOUND_EXACT);
+                return score;
+            }
+        }
+
+        int static_eval = in_check? -VALUE_INFINITE: tt_hit? tte.eval: eval::evaluate(pos, &pawns);
+
+        // null move pruning, skipped without pieces to avoid zugzwang
+        if (!pv_node && !in_check && null_allowed && depth >= 3 && static_eval >= beta
+            && (pos.pieces(us) ^ pos.pieces(us, PAWN, KING))) {
+
+            int r = 2 + depth/4;
+            played[ply] = MOVE_NULL;
+            pos.do_null_move();
+            ++stats.null_tries;
+            int score = -search(-beta, -beta+1, depth-1-r, ply+1, false);
+            pos.undo_null_move();
+            if (stopped) return 0;
+            if (score >= beta) {
+                ++stats.null_cutoffs;
+                return is_mate_score(score)? beta: score;
+            }
+        }
+
+        Move prev = ply? played[ply-1]: MOVE_NONE;
+        Move counter = prev != MOVE_NONE && prev != MOVE_NULL? countermoves[pos.piece_on(to_sq(prev))][to_sq(prev)]: MOVE_NONE;
+        MovePicker picker(pos, tt_move, killers[ply], counter, history);
+
+        int best = -VALUE_INFINITE, old_alpha = alpha, legal = 0;
+        Move best_move = MOVE_NONE;
+
+        for (Move m; (m = picker.next()) != MOVE_NONE; ) {
+
+            if (!ply && !root_moves.empty() && std::find(root_moves.begin(), root_moves.end(), m) == root_moves.end()) continue;
+            if (!ply && std::find(excluded.begin(), excluded.end(), m) != excluded.end()) continue;
+            if (!pos.legal(m)) continue;
+            ++legal;
+
+            bool quiet = !pos.capture(m) && type_of(m) != PROMOTION;
+            played[ply] = m;
+            pos.do_move(m);
+            bool gives_check = pos.in_check();
+            int new_depth = depth-1+gives_check;
+            int score;
+
+            if (legal == 1) score = -search(-beta, -alpha, new_depth, ply+1, true);
+            else {
+                // late move reductions for quiet moves ordered last
+                int r = 0;
+                if (depth >= 3 && legal > 3 && quiet && !in_check && !gives_check) {
+                    r = 1 + (legal > 8) + (depth > 6) - pv_node;
+                    r = std::clamp(r, 0, new_depth-1);
+                }
+                stats.lmr_tries += r > 0;
+                score = -search(-alpha-1, -alpha, new_depth-r, ply+1, true);
+                if (score > alpha && r) {
+                    ++stats.lmr_researches;
+                    score = -search(-alpha-1, -alpha, new_depth, ply+1, true);
+                }
+                if (score > alpha && score < beta) score = -search(-beta, -alpha, new_depth, ply+1, true);
+            }
+            pos.undo_move(m);
+            if (stopped) return 0;
+
+            if (score > best) {
+                best = score;
+                if (score > alpha) {
+                    alpha = score;
+                    best_move = m;
+                    update_pv(ply, m);
+                    if (score >= beta) {
+                        ++stats.fail_highs;
+                        stats.first_move_fail_highs += legal == 1;
+                        if (quiet) {
+                            if (killers[ply][0] != m) { killers[ply][1] = killers[ply][0]; killers[ply][0] = m; }
+                            int& h = history[us][from_sq(m)][to_sq(m)];
+                            h = std::min(h + depth*depth, 80000);
+                            if (counter != m && prev != MOVE_NONE && prev != MOVE_NULL)
+                                countermoves[pos.piece_on(to_sq(prev))][to_sq(prev)] = m;
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (!legal) return in_check? mated_in(ply): VALUE_DRAW;
+
+        // a root missing the moves of earlier lines keeps the entry of the full search
+        if (ply || excluded.empty()) {
+            Bound bound = best >= beta? BOUND_LOWER: alpha > old_alpha? BOUND_EXACT: BOUND_UPPER;
+            tt.store(pos.key(), best_move, to_tt(best, ply), static_eval, depth, bound);
+        }
+        return best;
+    }
+
+    int Searcher::qsearch(int alpha, int beta, int ply) {
+
+        pv_length[ply] = ply;
+        ++stats.nodes;
+        ++stats.qnodes;
+        check_limits();
+        if (stopped) return 0;
+        seldepth = std::max(seldepth, ply);
+
+        if (pos.is_draw()) return VALUE_DRAW;
+        if (ply >= MAX_PLY) return eval::evaluate(pos, &pawns);
+
+        bool in_check = pos.in_check();
+        int best = -VALUE_INFINITE;
+        if (!in_check) {
+            best = eval::evaluate(pos, &pawns);
+            if (best >= beta) return best;
+            alpha = std::max(alpha, best);
+        }
+
+        TTData tte {};
+        bool tt_hit = tt.probe(pos.key(), tte);
+        Move tt_move = tt_hit? tte.move: MOVE_NONE;
+        ++stats.tt_probes;
+        stats.tt_hits += tt_hit;
+        MovePicker picker(pos, tt_move, history);
+
+        int legal = 0;
+        for (Move m; (m = picker.next()) != MOVE_NONE; ) {
+
+            if (!pos.legal(m)) continue;
+            ++legal;
+
+            pos.do_move(m);
+            int score = -qsearch(-beta, -alpha, ply+1);
+            pos.undo_move(m);
+            if (stopped) return 0;
+
+            if (score > best) {
+                best = score;
+                if (score > alpha) {
+                    alpha = score;
+                    update_pv(ply, m);
+                    if (score >= beta) break;
+                }
+            }
+        }
+
+        if (in_check && !legal) return mated_in(ply);
+        return best;
+    }
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "movepick.h"
+#include "pawns.h"
+#include "position.h"
+#include "timeman.h"
+#include "tt.h"
+
+namespace search {
+
+    constexpr int VALUE_DRAW = 0;
+    constexpr int VALUE_MATE = 32000;
+    constexpr int VALUE_INFINITE = 32001;
+    constexpr int VALUE_MATE_IN_MAX_PLY = VALUE_MATE - MAX_PLY;
+    constexpr int VALUE_TB_WIN = VALUE_MATE_IN_MAX_PLY - 1;         // known win, distance unknown
+    constexpr int VALUE_TB_WIN_IN_MAX_PLY = VALUE_TB_WIN - MAX_PLY;
+
+    constexpr int mate_in(int ply) { return VALUE_MATE - ply; }
+    constexpr int mated_in(int ply) { return -VALUE_MATE + ply; }
+
+    /**
+     * Progress of the search, reported after every completed iteration
+    */
+    struct Info {
+        int depth = 0;
+        int seldepth = 0;
+        int score = 0;
+        uint64_t nodes = 0;
+        int64_t time = 0;           // ms
+        int multipv = 1;            // line number, 1 - the best move
+        int hashfull = 0;
+        uint64_t tb_hits = 0;
+        uint64_t tb_probes = 0;
+        std::vector<engine::Move> pv;
+    };
+
+    struct Result {
+        engine::Move best = engine::MOVE_NONE;
+        engine::Move ponder = engine::MOVE_NONE;
+        int score = 0;
+        int depth = 0;
+        std::vector<Info> lines;    // last completed depth, best line first
+    };
+
+    /**
+     * Counters of one searcher, aligned so that searchers on different threads never share a cache line.
+     * Searchers are summed only when reported
+    */
+    struct alignas(64) Stats {
+        uint64_t nodes = 0, qnodes = 0;
+        uint64_t tt_probes = 0, tt_hits = 0, tt_cutoffs = 0;
+        uint64_t fail_highs = 0, first_move_fail_highs = 0;
+        uint64_t null_tries = 0, null_cutoffs = 0;
+        uint64_t lmr_tries = 0, lmr_researches = 0;    // reduced searches, those failing high are searched again
+        uint64_t pawn_probes = 0, pawn_hits = 0;        // pawn hash, filled in by Searcher::search_stats()
+        int depth = 0;                                  // completed iterations
+        uint64_t iteration_nodes[MAX_PLY] {};
+        int64_t iteration_time[MAX_PLY] {};             // ms
+
+        Stats& operator += (const Stats& other);
+
+        /**
+         * Nodes of the iteration over nodes of the one before it, 0 when unknown
+        */
+        double branching_factor(int depth) const;
+        std::vector<std::string> to_lines() const;
+        std::string to_json() const;
+    };
+
+    using on_info = std::function<void (const Info& info)>;
+
+    /**
+     * Single threaded iterative deepening alpha-beta, the transposition table may be shared
+    */
+    class Searcher {
+    private:
+        TranspositionTable& tt;
+        bool shared_tt;             // the owner of the table starts the searches, think() leaves the generation alone
+        engine::Position pos;
+        Limits limits;
+        on_info info_callback;
+        std::atomic<bool> stop_requested {false};   // stop() from another thread, kept until prepare()
+        std::atomic<bool> stopped {false};          // the running search ends, a request or a limit
+        std::atomic<bool> pondering {false};
+        TimeManager time;
+        Stats stats;
+        uint64_t tb_hits = 0, tb_probes = 0;
+        int seldepth = 0;
+        eval::PawnTable pawns;
+        std::vector<engine::Move> root_moves;       // empty - every legal move
+        std::vector<engine::Move> excluded;         // root moves of the lines already searched at this depth
+
+        engine::Move pv[MAX_PLY+1][MAX_PLY+1];
+        int pv_length[MAX_PLY+1];
+        engine::Move killers[MAX_PLY+1][2];
+        engine::Move countermoves[engine::PIECE_NB][64];    // by piece and destination of the previous move
+        engine::Move played[MAX_PLY+1];
+        History history;
+
+        int search(int alpha, int beta, int depth, int ply, bool null_allowed);
+        int qsearch(int alpha, int beta, int ply);
+        void check_limits();
+        void update_pv(int ply, engine::Move m);
+        int64_t elapsed() const { return time.elapsed(); }
+        bool tb_root(Result& result);
+        bool tb_root_dtz(Result& result, std::vector<std::pair<int, engine::Move>>& ranked);
+        Info report(int depth, int score, const engine::Move* pv, int length, int multipv);
+    public:
+        /**
+         * Searchers thinking at the same time on one table are shared, their owner calls tt.new_search()
+         * once for all of them
+        */
+        explicit Searcher(TranspositionTable& tt, bool shared_tt = false): tt{tt}, shared_tt{shared_tt} {}
+
+        Searcher(const Searcher& other) = delete;
+        Searcher& operator = (const Searcher& other) = delete;
+
+        /**
+         * Searches the position until a limit is reached or stop() is called
+        */
+        Result think(const engine::Position& root, const Limits& limits, on_info callback = nullptr);
+        void stop() { stop_requested.store(true, std::memory_order_relaxed); }
+
+        /**
+         * Clears the stop() of an earlier search and sets pondering from the limits of the next think().
+         * Called before think() and before the thread running it starts, so stop() and ponderhit()
+         * sent right after the start are never lost
+        */
+        void prepare(const Limits& limits) {
+
+            stop_requested.store(false, std::memory_order_relaxed);
+            pondering.store(limits.ponder, std::memory_order_relaxed);
+        }
+
+        /**
+         * The opponent played the move pondered on, the search goes on under the time limits
+        */
+        void ponderhit() { pondering.store(false, std::memory_order_relaxed); }
+        uint64_t node_count() const { return stats.nodes; }
+        Stats search_stats() const;
+        uint64_t tb_hit_count() const { return tb_hits; }
+        uint64_t tb_probe_count() const { return tb_probes; }
+
+        /**
+         * Cached pawn terms are stale after the evaluation weights change
+        */
+        void clear_pawn_cache() { pawns.clear(); }
+    };
+
+    inline bool is_mate_score(int score) { return score >= VALUE_MATE_IN_MAX_PLY || score <= -VALUE_MATE_IN_MAX_PLY; }
+}
@@ -0,0 +1,140 @@
+#include "suite.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "notation.h"
+#include "pgn.h"
+#include "search.h"
+
+namespace suite {
+
+    using namespace engine;
+
+    namespace {
+
+        struct Task {
+            Test test;
+            std::vector<Move> best, avoid;
+        };
+
+        // "bm Nf3 e4; id "name";" after the four FEN fields
+        bool parse(const std::string& line, Task& task) {
+
+            std::istringstream ss(line);
+            std::string fields[4];
+            if (!(ss>>fields[0]>>fields[1]>>fields[2]>>fields[3])) return false;
+            task.test.fen = fields[0] + ' ' + fields[1] + ' ' + fields[2] + ' ' + fields[3] + " 0 1";
+            Position pos;
+            try { pos.set(task.test.fen); }
+            catch (std::invalid_argument&) { return false; }
+
+            for (std::string op; std::getline(ss>>std::ws, op, ';'); ) {
+
+                std::istringstream operands(op);
+                std::string code, value;
+                operands>>code;
+                if (code == "id") {
+                    std::getline(operands>>std::ws, value);
+                    if (value.size() >= 2 && value.front() == '"' && value.back() == '"') value = value.substr(1, value.size()-2);
+                    task.test.id = value;
+                }
+                else if (code == "bm" || code == "am") {
+                    while (operands>>value) {
+                        Move m = from_san(pos, value);
+                        if (m == MOVE_NONE) return false;
+                        (code == "bm"? task.best: task.avoid).push_back(m);
+                    }
+                    task.test.expected += (task.test.expected.empty()? "": "; ") + op;
+                }
+            }
+            return !task.best.empty() || !task.avoid.empty();
+        }
+
+        bool correct(const Task& task, Move m) {
+
+            if (!task.best.empty() && std::find(task.best.begin(), task.best.end(), m) == task.best.end()) return false;
+            return std::find(task.avoid.begin(), task.avoid.end(), m) == task.avoid.end();
+        }
+    }
+
+    Result run(const Config& config, const on_test& progress) {
+
+        auto start = std::chrono::steady_clock::now();
+        std::ifstream file(config.path);
+        if (!file) throw std::runtime_error("Can not open " + config.path);
+
+        Result result;
+        std::vector<Task> tasks;
+        for (std::string line; std::getline(file, line); ) {
+            if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+            Task task;
+            if (parse(line, task)) tasks.push_back(std::move(task));
+            else ++result.skipped;
+        }
+        for (size_t i=0; i<tasks.size(); ++i) if (tasks[i].test.id.empty()) tasks[i].test.id = std::to_string(i+1);
+
+        search::Limits limits;
+        limits.nodes = config.nodes;
+        limits.movetime = config.movetime;
+        if (config.depth) limits.depth = config.depth;
+
+        std::mutex mutex;
+        std::atomic<size_t> next {0};
+        int done = 0;
+        auto worker = [&] {
+
+            search::TranspositionTable tt(config.hash);
+            auto searcher = std::make_unique<search::Searcher>(tt);
+            for (size_t i; (i = next++) < tasks.size(); ) {
+
+                // a fresh table for every position, the result must not depend on what this thread searched before
+                Task& task = tasks[i];
+                Test& test = task.test;
+                tt.clear();
+                Position pos(test.fen);
+                bool right = false;
+                auto started = std::chrono::steady_clock::now();
+                search::Result r = searcher->think(pos, limits, [&] (const search::Info& info) {
+
+                    if (info.multipv != 1 || info.pv.empty()) return;
+                    bool now = correct(task, info.pv[0]);
+                    if (now && !right) test.solve_depth = info.depth, test.solve_nodes = info.nodes, test.solve_time = info.time;
+                    right = now;
+                });
+
+                test.found = r.best == MOVE_NONE? "(none)": to_san(pos, r.best);
+                test.solved = r.best != MOVE_NONE && correct(task, r.best);
+                test.depth = r.depth;
+                test.nodes = searcher->node_count();
+                test.time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-started).count();
+                // an iteration cut short may still change the move, the solution then counts from the end
+                if (!test.solved) test.solve_depth = 0, test.solve_nodes = 0, test.solve_time = 0;
+                else if (!right) test.solve_depth = test.depth, test.solve_nodes = test.nodes, test.solve_time = test.time;
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (progress) progress(test, ++done, static_cast<int>(tasks.size()));
+            }
+        };
+
+        unsigned int threads = std::min<unsigned int>(pgn::thread_count(config.threads), std::max<size_t>(tasks.size(), 1));
+        std::vector<std::thread> pool;
+        for (unsigned int t=1; t<threads; ++t) pool.emplace_back(worker);
+        worker();
+        for (std::thread& t: pool) t.join();
+
+        for (Task& task: tasks) {
+            result.solved += task.test.solved;
+            result.nodes += task.test.nodes;
+            if (task.test.solved) result.solve_nodes += task.test.solve_nodes;
+            result.tests.push_back(std::move(task.test));
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        return result;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * EPD test suites: every position has best moves (bm) to find or moves to avoid (am).
+ * Positions are searched in parallel, each by one searcher with its own transposition table,
+ * so a node limited run gives the same numbers on any machine and thread count
+*/
+namespace suite {
+
+    struct Config {
+        std::string path;
+        uint64_t nodes = 1000000;           // per position, 0 - unlimited
+        int64_t movetime = 0;               // ms per position, 0 - unlimited
+        int depth = 0;                      // 0 - unlimited
+        unsigned int threads = 0;           // 0 - every hardware thread
+        size_t hash = 16;                   // MB per thread
+    };
+
+    struct Test {
+        std::string id;
+        std::string fen;
+        std::string expected;               // "bm Qxf7+" or "am Nxe5" as in the file
+        std::string found;                  // SAN of the final best move
+        bool solved = false;
+        int depth = 0;                      // completed iterations
+        uint64_t nodes = 0;
+        int64_t time = 0;                   // ms
+        int solve_depth = 0;                // first iteration from which the best move stayed right
+        uint64_t solve_nodes = 0;
+        int64_t solve_time = 0;
+    };
+
+    struct Result {
+        std::vector<Test> tests;            // file order
+        int solved = 0;
+        int skipped = 0;                    // lines without bm or am, or with an illegal move in them
+        uint64_t nodes = 0, solve_nodes = 0;
+        double seconds = 0;
+    };
+
+    /**
+     * Called after every test from the searching threads one at a time
+    */
+    using on_test = std::function<void (const Test& test, int done, int total)>;
+
+    /**
+     * Throws std::runtime_error when the file can not be read
+    */
+    Result run(const Config& config, const on_test& progress = nullptr);
+}
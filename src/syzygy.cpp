@@ -0,0 +1,707 @@
+#include "syzygy.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "mapped_file.h"
+#include "movegen.h"
+#include "log.h"
+
+namespace tb::syzygy {
+
+    using namespace engine;
+
+    namespace {
+
+        constexpr char WDL_EXTENSION[] = ".rtbw";
+        constexpr char DTZ_EXTENSION[] = ".rtbz";
+        constexpr uint8_t MAGIC[2][4] = {{0x71, 0xE8, 0x23, 0x5D}, {0xD7, 0x66, 0x0C, 0xA5}};
+
+        enum Kind { WDL_FILE, DTZ_FILE };
+        enum Flag { STM = 1, MAPPED = 2, WIN_PLIES = 4, LOSS_PLIES = 8, WIDE = 16, SINGLE_VALUE = 128 };
+
+        // results as stored, side to move point of view
+        enum Score : int { LOSS = -2, BLESSED_LOSS = -1, DRAW = 0, CURSED_WIN = 1, WIN = 2 };
+
+        // FAIL - a table is missing, CHANGE_STM - the DTZ table holds the other side to move,
+        // ZEROING_BEST_MOVE - a capture or pawn move is best, the DTZ value is not stored
+        enum State { FAIL, OK, CHANGE_STM, ZEROING_BEST_MOVE };
+
+        using Sym = uint16_t;
+
+        template<typename T> T read_le(const uint8_t* p) {
+
+            T v = 0;
+            for (size_t i=0; i<sizeof(T); ++i) v |= T(p[i]) << 8*i;
+            return v;
+        }
+
+        template<typename T> T read_be(const uint8_t* p) {
+
+            T v = 0;
+            for (size_t i=0; i<sizeof(T); ++i) v = T(v << 8) | p[i];
+            return v;
+        }
+
+        constexpr int off_a1h8(Square s) { return rank_of(s) - file_of(s); }
+        constexpr Square flip_diagonal(Square s) { return ((s >> 3) | (s << 3)) & 63; }
+
+        /**
+         * Square numberings of the index, the same for every table
+        */
+        struct Maps {
+            int pawns[64] {};                       // a2-h7 to 47..0, the leading pawn has the highest value
+            int b1h1h7[64] {};                      // below the a1-h8 diagonal to 0..27
+            int a1d1d4[64] {};                      // a1-d1-d4 triangle to 0..9, diagonal squares last
+            int kk[10][64] {};                      // the 462 king pairs with the first king in the triangle
+            int binomial[MAX_PIECES][64] {};        // [k][n] ways to choose k of n
+            int lead_pawn_idx[MAX_PIECES][64] {};   // [leading pawns][square]
+            int lead_pawns_size[MAX_PIECES][4] {};  // [leading pawns][file a..d]
+        };
+
+        constexpr Maps maps = [] {
+
+            Maps m;
+            int code = 0;
+            for (Square s=0; s<64; ++s) if (off_a1h8(s) < 0) m.b1h1h7[s] = code++;
+
+            code = 0;
+            Square diagonal[4] {};
+            int diagonals = 0;
+            for (Square s=0; s<=make_square(3, 3); ++s) {
+                if (off_a1h8(s) < 0 && file_of(s) <= 3) m.a1d1d4[s] = code++;
+                else if (!off_a1h8(s) && file_of(s) <= 3) diagonal[diagonals++] = s;
+            }
+            for (int i=0; i<diagonals; ++i) m.a1d1d4[diagonal[i]] = code++;
+
+            // kings next to each other are left out, with the first king on the diagonal the second
+            // one is not above it. Both kings on the diagonal come last
+            std::pair<int, Square> both[64] {};
+            int both_count = 0;
+            code = 0;
+            for (int idx=0; idx<10; ++idx)
+                for (Square s1=0; s1<=make_square(3, 3); ++s1) {
+                    if (m.a1d1d4[s1] != idx || (!idx && s1 != make_square(1, 0))) continue;
+                    for (Square s2=0; s2<64; ++s2) {
+                        if ((king_attacks[s1] | square_bb(s1)) & square_bb(s2)) continue;
+                        if (!off_a1h8(s1) && off_a1h8(s2) > 0) continue;
+                        if (!off_a1h8(s1) && !off_a1h8(s2)) both[both_count++] = {idx, s2};
+                        else m.kk[idx][s2] = code++;
+                    }
+                }
+            for (int i=0; i<both_count; ++i) m.kk[both[i].first][both[i].second] = code++;
+
+            m.binomial[0][0] = 1;
+            for (int n=1; n<64; ++n)
+                for (int k=0; k<MAX_PIECES && k<=n; ++k)
+                    m.binomial[k][n] = (k > 0? m.binomial[k-1][n-1]: 0) + (k < n? m.binomial[k][n-1]: 0);
+
+            // a leading pawn leaves 47 squares for the others on a2, 2 fewer for every rank further up
+            int available = 47;
+            for (int lead=1; lead<MAX_PIECES-1; ++lead)
+                for (int f=0; f<4; ++f) {
+                    int idx = 0;
+                    for (int r=1; r<=6; ++r) {
+                        Square s = make_square(f, r);
+                        if (lead == 1) {
+                            m.pawns[s] = available--;
+                            m.pawns[s ^ 7] = available--;
+                        }
+                        m.lead_pawn_idx[lead][s] = idx;
+                        idx += m.binomial[lead-1][m.pawns[s]];
+                    }
+                    m.lead_pawns_size[lead][f] = idx;
+                }
+            return m;
+        }();
+
+        bool pawns_before(Square a, Square b) { return maps.pawns[a] < maps.pawns[b]; }
+
+        /**
+         * Decoding data of one side to move and leading pawn file of a table, pointers into the mapped file
+        */
+        struct PairsData {
+            uint8_t flags = 0;
+            uint8_t max_sym_len = 0;
+            uint8_t min_sym_len = 0;                // the value itself for SINGLE_VALUE
+            uint32_t blocks = 0;
+            size_t block_size = 0;
+            size_t span = 0;                        // values between sparse index entries
+            const uint8_t* lowest_sym = nullptr;    // u16 per symbol length, the lowest symbol of that length
+            const uint8_t* btree = nullptr;         // 3 bytes per symbol, 12 bit left and right symbol of a pair
+            const uint8_t* block_length = nullptr;  // u16 per block, values in the block - 1
+            uint32_t block_length_size = 0;
+            const uint8_t* sparse_index = nullptr;  // 6 bytes per entry, u32 block and u16 offset in it
+            size_t sparse_index_size = 0;
+            const uint8_t* data = nullptr;          // Huffman coded blocks
+            std::vector<uint64_t> base64;           // [length - min_sym_len] lowest symbol of the length padded to 64 bits
+            std::vector<uint8_t> symlen;            // values represented by a symbol - 1
+            Piece pieces[MAX_PIECES] {};            // index order, groups of equal pieces are neighbours
+            uint64_t group_idx[MAX_PIECES+1] {};
+            int group_len[MAX_PIECES+1] {};         // zero terminated
+            size_t map_idx[4] {};                   // DTZ value maps of win, loss, cursed win and blessed loss, bytes from TableFile::map
+
+            Sym left(Sym s) const { return ((btree[3*s+1] & 0xF) << 8) | btree[3*s]; }
+            Sym right(Sym s) const { return (btree[3*s+2] << 4) | (btree[3*s+1] >> 4); }
+        };
+
+        struct TableFile {
+            std::string path;                       // empty - no file
+            std::once_flag once;
+            io::MappedFile file;
+            bool ready = false;
+            const uint8_t* map = nullptr;           // DTZ value maps
+            PairsData items[2][4];                  // [side to move][leading pawn file]
+        };
+
+        struct Table {
+            uint64_t key = 0;                       // material with the stronger side, the first of the name, as white
+            uint64_t key2 = 0;                      // colors swapped
+            int count = 0;
+            bool pawns = false;
+            bool unique_pieces = false;
+            int pawn_count[2] {};                   // leading color, the other one
+            TableFile files[2];
+
+            // DTZ files and tables of equal material hold one side to move
+            PairsData* get(Kind kind, int stm, int file) {
+                return &files[kind].items[kind == WDL_FILE? stm: 0][pawns? file: 0];
+            }
+        };
+
+        std::vector<std::unique_ptr<Table>> tables;
+        std::unordered_map<uint64_t, Table*> by_key;       // read only once init() returns
+        int largest = 0;
+
+        uint64_t material_key(const int counts[COLOR_NB][PIECE_TYPE_NB]) {
+
+            uint64_t key = 0;
+            for (Color c: {WHITE, BLACK})
+                for (int pt=PAWN; pt<KING; ++pt) key |= uint64_t(counts[c][pt]) << (4*(pt-PAWN) + 20*c);
+            return key;
+        }
+
+        uint64_t material_key(const Position& pos) {
+
+            int counts[COLOR_NB][PIECE_TYPE_NB] {};
+            for (Color c: {WHITE, BLACK})
+                for (int pt=PAWN; pt<KING; ++pt) counts[c][pt] = popcount(pos.pieces(c, PieceType(pt)));
+            return material_key(counts);
+        }
+
+        /**
+         * Groups are encoded together: the leading pawns, or without pawns the kings and one more unique
+         * piece or the kings alone, then every run of equal pieces. The file gives the order of the groups
+        */
+        void set_groups(const Table& t, PairsData& d, const int order[2], int file) {
+
+            int n = 0, first_len = t.pawns? 0: t.unique_pieces? 3: 2;
+            d.group_len[n] = 1;
+            for (int i=1; i<t.count; ++i)
+                if (--first_len > 0 || d.pieces[i] == d.pieces[i-1]) d.group_len[n]++;
+                else d.group_len[++n] = 1;
+            d.group_len[++n] = 0;
+
+            bool both_pawns = t.pawns && t.pawn_count[1];
+            int next = both_pawns? 2: 1;
+            int free_squares = 64 - d.group_len[0] - (both_pawns? d.group_len[1]: 0);
+            uint64_t idx = 1;
+            for (int k=0; next < n || k == order[0] || k == order[1]; ++k)
+                if (k == order[0]) {
+                    d.group_idx[0] = idx;
+                    idx *= t.pawns? maps.lead_pawns_size[d.group_len[0]][file]: t.unique_pieces? 31332: 462;
+                }
+                else if (k == order[1]) {
+                    d.group_idx[1] = idx;
+                    idx *= maps.binomial[d.group_len[1]][48 - d.group_len[0]];
+                }
+                else {
+                    d.group_idx[next] = idx;
+                    idx *= maps.binomial[d.group_len[next]][free_squares];
+                    free_squares -= d.group_len[next++];
+                }
+            d.group_idx[n] = idx;
+        }
+
+        // values represented by a symbol - 1, pairs expand to their left and right symbol
+        uint8_t set_symlen(PairsData& d, Sym s, std::vector<bool>& visited) {
+
+            visited[s] = true;
+            Sym r = d.right(s);
+            if (r == 0xFFF) return 0;
+            Sym l = d.left(s);
+            if (!visited[l]) d.symlen[l] = set_symlen(d, l, visited);
+            if (!visited[r]) d.symlen[r] = set_symlen(d, r, visited);
+            return d.symlen[l] + d.symlen[r] + 1;
+        }
+
+        const uint8_t* set_sizes(PairsData& d, const uint8_t* data) {
+
+            d.flags = *data++;
+            if (d.flags & SINGLE_VALUE) {
+                d.min_sym_len = *data++;
+                return data;
+            }
+
+            uint64_t size = d.group_idx[std::find(d.group_len, d.group_len+MAX_PIECES+1, 0) - d.group_len];
+            d.block_size = size_t(1) << *data++;
+            d.span = size_t(1) << *data++;
+            d.sparse_index_size = (size + d.span - 1) / d.span;
+            uint8_t padding = *data++;
+            d.blocks = read_le<uint32_t>(data);
+            data += sizeof(uint32_t);
+            d.block_length_size = d.blocks + padding;
+            d.max_sym_len = *data++;
+            d.min_sym_len = *data++;
+            d.lowest_sym = data;
+
+            // canonical Huffman code, longer symbols have lower values
+            d.base64.assign(d.max_sym_len - d.min_sym_len + 1, 0);
+            for (int i=static_cast<int>(d.base64.size())-2; i>=0; --i)
+                d.base64[i] = (d.base64[i+1] + read_le<Sym>(d.lowest_sym + 2*i) - read_le<Sym>(d.lowest_sym + 2*(i+1))) / 2;
+            for (size_t i=0; i<d.base64.size(); ++i) d.base64[i] <<= 64 - i - d.min_sym_len;
+            data += d.base64.size()*sizeof(Sym);
+
+            d.symlen.assign(read_le<uint16_t>(data), 0);
+            data += sizeof(uint16_t);
+            d.btree = data;
+            std::vector<bool> visited(d.symlen.size());
+            for (size_t s=0; s<d.symlen.size(); ++s)
+                if (!visited[s]) d.symlen[s] = set_symlen(d, Sym(s), visited);
+            return data + 3*d.symlen.size() + (d.symlen.size() & 1);
+        }
+
+        const uint8_t* set_dtz_map(Table& t, const uint8_t* data, int files) {
+
+            TableFile& f = t.files[DTZ_FILE];
+            f.map = data;
+            for (int file=0; file<files; ++file) {
+                PairsData& d = *t.get(DTZ_FILE, 0, file);
+                if (!(d.flags & MAPPED)) continue;
+                if (d.flags & WIDE) {
+                    data += reinterpret_cast<uintptr_t>(data) & 1;
+                    for (int i=0; i<4; ++i) {
+                        d.map_idx[i] = data + 2 - f.map;
+                        data += 2*read_le<uint16_t>(data) + 2;
+                    }
+                }
+                else
+                    for (int i=0; i<4; ++i) {
+                        d.map_idx[i] = data + 1 - f.map;
+                        data += *data + 1;
+                    }
+            }
+            return data + (reinterpret_cast<uintptr_t>(data) & 1);
+        }
+
+        /**
+         * Reads the piece order, groups and sizes of every side and file, then points them into the file
+        */
+        void set_tables(Table& t, Kind kind, const uint8_t* data, const uint8_t* end) {
+
+            enum { SPLIT = 1, HAS_PAWNS = 2 };
+            if (bool(*data & HAS_PAWNS) != t.pawns || bool(*data & SPLIT) != (t.key != t.key2))
+                throw std::runtime_error("Syzygy table does not match its name: " + t.files[kind].path);
+            ++data;
+
+            int sides = kind == WDL_FILE && t.key != t.key2? 2: 1;
+            int files = t.pawns? 4: 1;
+            bool both_pawns = t.pawns && t.pawn_count[1];
+            for (int f=0; f<files; ++f) {
+
+                int order[2][2] = {{*data & 0xF, both_pawns? data[1] & 0xF: 0xF},
+                                   {*data >> 4, both_pawns? data[1] >> 4: 0xF}};
+                data += 1 + both_pawns;
+                for (int k=0; k<t.count; ++k, ++data)
+                    for (int i=0; i<sides; ++i) t.get(kind, i, f)->pieces[k] = Piece(i? *data >> 4: *data & 0xF);
+                for (int i=0; i<sides; ++i) set_groups(t, *t.get(kind, i, f), order[i], f);
+            }
+            data += reinterpret_cast<uintptr_t>(data) & 1;
+
+            for (int f=0; f<files; ++f)
+                for (int i=0; i<sides; ++i) data = set_sizes(*t.get(kind, i, f), data);
+            if (kind == DTZ_FILE) data = set_dtz_map(t, data, files);
+
+            for (int f=0; f<files; ++f)
+                for (int i=0; i<sides; ++i) {
+                    PairsData& d = *t.get(kind, i, f);
+                    d.sparse_index = data;
+                    data += 6*d.sparse_index_size;
+                }
+            for (int f=0; f<files; ++f)
+                for (int i=0; i<sides; ++i) {
+                    PairsData& d = *t.get(kind, i, f);
+                    d.block_length = data;
+                    data += sizeof(uint16_t)*d.block_length_size;
+                }
+            for (int f=0; f<files; ++f)
+                for (int i=0; i<sides; ++i) {
+                    PairsData& d = *t.get(kind, i, f);
+                    data = reinterpret_cast<const uint8_t*>((reinterpret_cast<uintptr_t>(data) + 63) & ~uintptr_t(63));
+                    d.data = data;
+                    data += d.blocks*d.block_size;
+                }
+            if (data > end) throw std::runtime_error("Truncated Syzygy table: " + t.files[kind].path);
+        }
+
+        // maps the file on first use, safe to race between search threads
+        bool mapped(Table& t, Kind kind) {
+
+            TableFile& f = t.files[kind];
+            std::call_once(f.once, [&] {
+                if (f.path.empty()) return;
+                try {
+                    io::MappedFile file(f.path, io::MappedFile::RANDOM);
+                    const uint8_t* data = reinterpret_cast<const uint8_t*>(file.data());
+                    if (file.size() % 64 != 16 || std::memcmp(data, MAGIC[kind], sizeof(MAGIC[kind])) != 0)
+                        throw std::runtime_error("Not a Syzygy table: " + f.path);
+                    set_tables(t, kind, data + sizeof(MAGIC[kind]), data + file.size());
+                    f.file = std::move(file);
+                    f.ready = true;
+                }
+                catch (std::exception& e) {
+                    LOGE("%s", e.what())
+                }
+            });
+            return f.ready;
+        }
+
+        int decompress(const PairsData& d, uint64_t idx) {
+
+            if (d.flags & SINGLE_VALUE) return d.min_sym_len;
+
+            // the sparse index entry near idx, then block by block to the one holding it
+            uint64_t k = idx / d.span;
+            uint32_t block = read_le<uint32_t>(d.sparse_index + 6*k);
+            int64_t offset = read_le<uint16_t>(d.sparse_index + 6*k + 4);
+            offset += static_cast<int64_t>(idx % d.span) - static_cast<int64_t>(d.span / 2);
+            while (offset < 0) offset += read_le<uint16_t>(d.block_length + 2*(--block)) + 1;
+            while (offset > read_le<uint16_t>(d.block_length + 2*block)) offset -= read_le<uint16_t>(d.block_length + 2*block++) + 1;
+
+            // symbols of the block until the one covering the offset
+            const uint8_t* ptr = d.data + uint64_t(block)*d.block_size;
+            uint64_t buf = read_be<uint64_t>(ptr);
+            ptr += sizeof(uint64_t);
+            int bits = 64;
+            Sym sym;
+            while (true) {
+                int len = 0;
+                while (buf < d.base64[len]) ++len;
+                sym = Sym((buf - d.base64[len]) >> (64 - len - d.min_sym_len));
+                sym += read_le<Sym>(d.lowest_sym + 2*len);
+                if (offset < d.symlen[sym] + 1) break;
+
+                offset -= d.symlen[sym] + 1;
+                len += d.min_sym_len;
+                buf <<= len;
+                bits -= len;
+                if (bits <= 32) {
+                    bits += 32;
+                    buf |= uint64_t(read_be<uint32_t>(ptr)) << (64 - bits);
+                    ptr += sizeof(uint32_t);
+                }
+            }
+
+            // pairs expand to adjacent values, descend to the leaf
+            while (d.symlen[sym]) {
+                Sym l = d.left(sym);
+                if (offset < d.symlen[l] + 1) sym = l;
+                else {
+                    offset -= d.symlen[l] + 1;
+                    sym = d.right(sym);
+                }
+            }
+            return d.left(sym);
+        }
+
+        // DTZ values are stored by frequency and in moves unless the flags say plies
+        int dtz_plies(Table& t, int file, int value, Score wdl) {
+
+            constexpr int WDL_MAP[] = {1, 3, 0, 2, 0};
+            const PairsData& d = *t.get(DTZ_FILE, 0, file);
+            if (d.flags & MAPPED) {
+                const uint8_t* map = t.files[DTZ_FILE].map + d.map_idx[WDL_MAP[wdl+2]];
+                value = d.flags & WIDE? read_le<uint16_t>(map + 2*value): map[value];
+            }
+            if ((wdl == WIN && !(d.flags & WIN_PLIES)) || (wdl == LOSS && !(d.flags & LOSS_PLIES))
+                || wdl == CURSED_WIN || wdl == BLESSED_LOSS)
+                value *= 2;
+            return value + 1;
+        }
+
+        /**
+         * Stored value of the position: the Score for WDL, plies for DTZ given the wdl of the position
+        */
+        int probe_table(const Position& pos, Kind kind, State& state, Score wdl = DRAW) {
+
+            if (pos.pieces() == pos.pieces(KING)) return DRAW;
+
+            auto it = by_key.find(material_key(pos));
+            if (it == by_key.end() || !mapped(*it->second, kind)) { state = FAIL; return 0; }
+            Table& t = *it->second;
+
+            // tables have the stronger side as white, and white to move for equal material
+            uint64_t key = material_key(pos);
+            bool flip = (t.key == t.key2 && pos.side_to_move() == BLACK) || key != t.key;
+            int flip_color = flip? 8: 0, flip_squares = flip? 56: 0;
+            int stm = flip ^ pos.side_to_move();
+
+            Square squares[MAX_PIECES];
+            Piece pieces[MAX_PIECES];
+            int size = 0, lead_count = 0, file = 0;
+            Bitboard lead_pawns = 0;
+
+            // pawn tables are split by the file of the leading pawn, the one nearest the edge and lowest
+            if (t.pawns) {
+                Piece pc = Piece(t.get(kind, 0, 0)->pieces[0] ^ flip_color);
+                lead_pawns = pos.pieces(color_of(pc), PAWN);
+                for (Bitboard b = lead_pawns; b; ) squares[size++] = pop_lsb(b) ^ flip_squares;
+                lead_count = size;
+                std::swap(squares[0], *std::max_element(squares, squares+lead_count, pawns_before));
+                file = std::min(file_of(squares[0]), 7-file_of(squares[0]));
+            }
+            if (kind == DTZ_FILE && (t.get(kind, stm, file)->flags & STM) != stm && !(t.key == t.key2 && !t.pawns)) {
+                state = CHANGE_STM;
+                return 0;
+            }
+
+            for (Bitboard b = pos.pieces() ^ lead_pawns; b; ) {
+                Square s = pop_lsb(b);
+                squares[size] = s ^ flip_squares;
+                pieces[size++] = Piece(pos.piece_on(s) ^ flip_color);
+            }
+
+            // pieces in the order of the table
+            const PairsData& d = *t.get(kind, stm, file);
+            for (int i=lead_count; i<size-1; ++i)
+                for (int j=i+1; j<size; ++j)
+                    if (d.pieces[i] == pieces[j]) {
+                        std::swap(pieces[i], pieces[j]);
+                        std::swap(squares[i], squares[j]);
+                        break;
+                    }
+
+            // the leading piece goes to the a-d files, without pawns to the a1-d1-d4 triangle
+            if (file_of(squares[0]) > 3)
+                for (int i=0; i<size; ++i) squares[i] ^= 7;
+
+            uint64_t idx;
+            if (t.pawns) {
+                idx = maps.lead_pawn_idx[lead_count][squares[0]];
+                std::stable_sort(squares+1, squares+lead_count, pawns_before);
+                for (int i=1; i<lead_count; ++i) idx += maps.binomial[i][maps.pawns[squares[i]]];
+            }
+            else {
+                if (rank_of(squares[0]) > 3)
+                    for (int i=0; i<size; ++i) squares[i] ^= 56;
+
+                // the first piece of the leading group off the a1-h8 diagonal goes below it
+                for (int i=0; i<d.group_len[0]; ++i) {
+                    if (!off_a1h8(squares[i])) continue;
+                    if (off_a1h8(squares[i]) > 0)
+                        for (int j=i; j<size; ++j) squares[j] = flip_diagonal(squares[j]);
+                    break;
+                }
+
+                if (t.unique_pieces) {
+                    int adjust1 = squares[1] > squares[0];
+                    int adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+                    if (off_a1h8(squares[0]))
+                        idx = (maps.a1d1d4[squares[0]]*63 + (squares[1] - adjust1))*62 + squares[2] - adjust2;
+                    else if (off_a1h8(squares[1]))
+                        idx = (6*63 + rank_of(squares[0])*28 + maps.b1h1h7[squares[1]])*62 + squares[2] - adjust2;
+                    else if (off_a1h8(squares[2]))
+                        idx = 6*63*62 + 4*28*62 + rank_of(squares[0])*7*28 + (rank_of(squares[1]) - adjust1)*28
+                              + maps.b1h1h7[squares[2]];
+                    else
+                        idx = 6*63*62 + 4*28*62 + 4*7*28 + rank_of(squares[0])*7*6 + (rank_of(squares[1]) - adjust1)*6
+                              + rank_of(squares[2]) - adjust2;
+                }
+                else idx = maps.kk[maps.a1d1d4[squares[0]]][squares[1]];
+            }
+
+            // remaining groups in ascending square order, skipping the squares taken by earlier groups
+            idx *= d.group_idx[0];
+            Square* group = squares + d.group_len[0];
+            bool remaining_pawns = t.pawns && t.pawn_count[1];
+            for (int next=1; d.group_len[next]; ++next) {
+                std::stable_sort(group, group+d.group_len[next]);
+                uint64_t n = 0;
+                for (int i=0; i<d.group_len[next]; ++i) {
+                    int adjust = std::count_if(squares, group, [&] (Square s) { return group[i] > s; });
+                    n += maps.binomial[i+1][group[i] - adjust - 8*remaining_pawns];
+                }
+                remaining_pawns = false;
+                idx += n*d.group_idx[next];
+                group += d.group_len[next];
+            }
+
+            int value = decompress(d, idx);
+            return kind == WDL_FILE? value - 2: dtz_plies(t, file, value, wdl);
+        }
+
+        /**
+         * The tables store any value for positions won by a capture, and at least a draw can be stored
+         * as a loss when a capture draws. Captures, and for DTZ pawn moves, are searched first
+        */
+        Score search(Position& pos, State& state, bool zeroing_moves) {
+
+            Score best = LOSS;
+            MoveList list = legal_moves(pos);
+            int searched = 0;
+            for (Move m: list) {
+
+                if (!pos.capture(m) && (!zeroing_moves || type_of(pos.moved_piece(m)) != PAWN)) continue;
+                ++searched;
+                pos.do_move(m);
+                Score value = Score(-search(pos, state, false));
+                pos.undo_move(m);
+                if (state == FAIL) return DRAW;
+                if (value > best) {
+                    best = value;
+                    if (value >= WIN) {
+                        state = ZEROING_BEST_MOVE;
+                        return value;
+                    }
+                }
+            }
+
+            // with every move searched the stored value may be wrong, e.g. for en passant
+            bool no_more_moves = searched && searched == list.size();
+            Score value = best;
+            if (!no_more_moves) {
+                value = Score(probe_table(pos, WDL_FILE, state));
+                if (state == FAIL) return DRAW;
+            }
+            if (best >= value) {
+                state = best > DRAW || no_more_moves? ZEROING_BEST_MOVE: OK;
+                return best;
+            }
+            state = OK;
+            return value;
+        }
+
+        // DTZ is not stored for a zeroing move, it follows from the result
+        int dtz_before_zeroing(Score wdl) {
+
+            return wdl == WIN? 1: wdl == CURSED_WIN? 101: wdl == BLESSED_LOSS? -101: wdl == LOSS? -1: 0;
+        }
+
+        int sign(int v) { return (v > 0) - (v < 0); }
+
+        int dtz(Position& pos, State& state) {
+
+            state = OK;
+            Score wdl = search(pos, state, true);
+            if (state == FAIL || wdl == DRAW) return 0;
+            if (state == ZEROING_BEST_MOVE) return dtz_before_zeroing(wdl);
+
+            int plies = probe_table(pos, DTZ_FILE, state, wdl);
+            if (state == FAIL) return 0;
+            if (state != CHANGE_STM) return (plies + 100*(wdl == BLESSED_LOSS || wdl == CURSED_WIN))*sign(wdl);
+
+            // the table holds the other side to move: the fastest win, or the slowest loss, one ply on
+            int best = 0xFFFF;
+            for (Move m: legal_moves(pos)) {
+
+                bool zeroing = pos.capture(m) || type_of(pos.moved_piece(m)) == PAWN;
+                pos.do_move(m);
+                plies = zeroing? -dtz_before_zeroing(search(pos, state, false)): -dtz(pos, state);
+                if (plies == 1 && pos.in_check() && !legal_moves(pos).size()) best = 1;
+                if (!zeroing) plies += sign(plies);
+                if (plies < best && sign(plies) == sign(wdl)) best = plies;
+                pos.undo_move(m);
+                if (state == FAIL) return 0;
+            }
+            return best == 0xFFFF? -1: best;
+        }
+
+        bool covered(const Position& pos) {
+
+            return largest && !pos.castling_rights() && popcount(pos.pieces()) <= largest;
+        }
+    }
+
+    void init(const std::string& path) {
+
+        tables.clear();
+        by_key.clear();
+        largest = 0;
+        if (path.empty()) return;
+
+        for (const auto& file: std::filesystem::directory_iterator(path)) {
+
+            if (file.path().extension() != WDL_EXTENSION) continue;
+            std::string name = file.path().stem().string();
+            size_t v = name.find('v');
+            int counts[COLOR_NB][PIECE_TYPE_NB] {};
+            int count = 0;
+            bool valid = v != std::string::npos && name[0] == 'K' && v+1 < name.size() && name[v+1] == 'K';
+            for (size_t i=0; i<name.size() && valid; ++i) {
+                if (i == v || i == 0 || i == v+1) continue;
+                const char* p = std::strchr(" PNBRQ", name[i]);
+                if (!p || name[i] == ' ') valid = false;
+                else ++counts[i < v? WHITE: BLACK][p-" PNBRQ"];
+            }
+            for (Color c: {WHITE, BLACK})
+                for (int pt=PAWN; pt<KING; ++pt) count += counts[c][pt];
+            if (!valid || count+2 > MAX_PIECES) {
+                LOGE("Bad Syzygy table name %s", name.c_str())
+                continue;
+            }
+
+            auto t = std::make_unique<Table>();
+            t->count = count+2;
+            t->key = material_key(counts);
+            std::swap(counts[WHITE], counts[BLACK]);
+            t->key2 = material_key(counts);
+            std::swap(counts[WHITE], counts[BLACK]);
+            for (Color c: {WHITE, BLACK})
+                for (int pt=PAWN; pt<KING; ++pt) t->unique_pieces |= counts[c][pt] == 1;
+            t->pawns = counts[WHITE][PAWN] || counts[BLACK][PAWN];
+
+            // the side with fewer pawns leads, white when equal
+            bool white_leads = !counts[BLACK][PAWN] || (counts[WHITE][PAWN] && counts[BLACK][PAWN] >= counts[WHITE][PAWN]);
+            t->pawn_count[0] = counts[white_leads? WHITE: BLACK][PAWN];
+            t->pawn_count[1] = counts[white_leads? BLACK: WHITE][PAWN];
+
+            t->files[WDL_FILE].path = file.path().string();
+            std::filesystem::path dtz_path = file.path();
+            dtz_path.replace_extension(DTZ_EXTENSION);
+            if (std::filesystem::exists(dtz_path)) t->files[DTZ_FILE].path = dtz_path.string();
+
+            by_key[t->key] = t.get();
+            by_key[t->key2] = t.get();
+            largest = std::max(largest, t->count);
+            tables.push_back(std::move(t));
+        }
+    }
+
+    int max_pieces() {
+
+        return largest;
+    }
+
+    bool probe_wdl(Position& pos, WDL& wdl) {
+
+        if (!covered(pos)) return false;
+        State state = OK;
+        Score score = search(pos, state, false);
+        if (state == FAIL) return false;
+        wdl = score == WIN? WDL_WIN: score == LOSS? WDL_LOSS: WDL_DRAW;
+        return true;
+    }
+
+    bool probe_dtz(Position& pos, int& plies) {
+
+        if (!covered(pos)) return false;
+        State state;
+        plies = dtz(pos, state);
+        return state != FAIL;
+    }
+}
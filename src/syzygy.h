@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+#include "tb.h"
+
+/**
+ * Syzygy tables, KRPvKR.rtbw for win/draw/loss and KRPvKR.rtbz for the distance to the next
+ * capture or pawn move. The decoder follows the probing code published with the tables (Fathom,
+ * Stockfish). Files are mapped on their first probe. The tables hold no positions with castling rights,
+ * en passant and positions whose best move is a capture are resolved by probing the captures
+*/
+namespace tb::syzygy {
+
+    constexpr int MAX_PIECES = 7;
+
+    /**
+     * Scans the directory for .rtbw files and the .rtbz files next to them, an empty path disables probing
+    */
+    void init(const std::string& path);
+
+    /**
+     * Largest number of pieces with a WDL table, 0 when there are none
+    */
+    int max_pieces();
+
+    /**
+     * Cursed wins and blessed losses, decided only past the fifty move rule, are draws.
+     * Captures are made and taken back, the position is unchanged on return
+    */
+    bool probe_wdl(engine::Position& pos, WDL& wdl);
+
+    /**
+     * Plies to the next capture or pawn move keeping the result, positive when the side to move wins.
+     * 100 is added to the plies of cursed wins and blessed losses, 0 for a draw
+    */
+    bool probe_dtz(engine::Position& pos, int& dtz);
+}
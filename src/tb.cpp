@@ -0,0 +1,309 @@
+#include "tb.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include "mapped_file.h"
+#include "log.h"
+#include "syzygy.h"
+
+namespace tb {
+
+    using namespace engine;
+
+    namespace {
+
+        constexpr PieceType ORDER[] = {QUEEN, ROOK, BISHOP, KNIGHT, PAWN};
+        constexpr int VALUE[PIECE_TYPE_NB] = {0, 1, 3, 3, 5, 9, 0};
+        constexpr char NAMES[] = " PNBRQK";
+
+        // white king squares a1-d1-d4 triangle of pawnless tables
+        constexpr std::array<int, 64> TRIANGLE = [] {
+
+            std::array<int, 64> t {};
+            t.fill(-1);
+            int n = 0;
+            for (int r=0; r<4; ++r)
+                for (int f=r; f<4; ++f) t[make_square(f, r)] = n++;
+            return t;
+        }();
+
+        constexpr std::array<Square, 10> TRIANGLE_SQUARES = [] {
+
+            std::array<Square, 10> t {};
+            for (Square s=0; s<64; ++s) if (TRIANGLE[s] >= 0) t[TRIANGLE[s]] = s;
+            return t;
+        }();
+
+        struct Table {
+            std::string path;
+            Material material;
+            std::once_flag once;
+            io::MappedFile file;
+            const uint8_t* wdl {nullptr};
+            const uint8_t* dtm {nullptr};
+
+            Table(std::string path, Material material): path{std::move(path)}, material{material} {}
+
+            // maps the file on first use, safe to race between search threads
+            bool mapped() {
+
+                std::call_once(once, [this] {
+                    try {
+                        io::MappedFile f(path, io::MappedFile::RANDOM);
+                        const Header* header = reinterpret_cast<const Header*>(f.data());
+                        uint64_t entries = material.size();
+                        if (f.size() < sizeof(Header) || std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0
+                            || header->version != VERSION || header->entries != entries
+                            || header->wdl_offset + (entries+3)/4 > f.size() || header->dtm_offset + entries > f.size())
+                            throw std::runtime_error("Not a tablebase: " + path);
+                        file = std::move(f);
+                        const uint8_t* base = reinterpret_cast<const uint8_t*>(file.data());
+                        wdl = base + header->wdl_offset;
+                        dtm = base + header->dtm_offset;
+                    }
+                    catch (std::exception& e) {
+                        LOGE("%s", e.what())
+                    }
+                });
+                return wdl != nullptr;
+            }
+        };
+
+        struct Lookup {
+            Table* table;
+            bool flip;
+        };
+
+        std::vector<std::unique_ptr<Table>> tables;
+        std::unordered_map<uint32_t, Lookup> by_code;      // read only once init() returns
+        int largest = 0;
+
+        uint32_t side_code(const int* counts) {
+
+            uint32_t code = 0;
+            for (PieceType pt=PAWN; pt<=QUEEN; pt=PieceType(pt+1)) code |= counts[pt] << 3*(pt-PAWN);
+            return code;
+        }
+
+        // true when the first side is stronger, or equal
+        bool stronger(const int* a, const int* b) {
+
+            int va = 0, vb = 0;
+            for (PieceType pt=PAWN; pt<=QUEEN; pt=PieceType(pt+1)) va += VALUE[pt]*a[pt], vb += VALUE[pt]*b[pt];
+            return va != vb? va > vb: side_code(a) >= side_code(b);
+        }
+
+        Material from_counts(int counts[COLOR_NB][PIECE_TYPE_NB]) {
+
+            Material m;
+            if (!stronger(counts[WHITE], counts[BLACK])) std::swap(counts[WHITE], counts[BLACK]);
+            m.count = 2;
+            m.pieces[0] = make_piece(WHITE, KING);
+            m.pieces[1] = make_piece(BLACK, KING);
+            for (Color c: {WHITE, BLACK})
+                for (PieceType pt: ORDER)
+                    for (int i=0; i<counts[c][pt]; ++i) {
+                        if (m.count == MAX_PIECES) throw std::invalid_argument("Too many pieces for a tablebase");
+                        m.pieces[m.count++] = make_piece(c, pt);
+                        m.pawns |= pt == PAWN;
+                    }
+            return m;
+        }
+
+        bool locate(const Position& pos, Lookup& lookup, uint64_t& idx) {
+
+            if (pos.castling_rights() || pos.ep_square() != NO_SQUARE || popcount(pos.pieces()) > largest) return false;
+
+            auto it = by_code.find(material_code(pos, false));
+            if (it == by_code.end() || !it->second.table->mapped()) return false;
+            lookup = it->second;
+            idx = index(lookup.table->material, pos, lookup.flip);
+            return true;
+        }
+    }
+
+    Material::Material(std::string_view name) {
+
+        size_t v = name.find('v');
+        if (v == std::string_view::npos) throw std::invalid_argument("Bad tablebase name " + std::string(name));
+
+        int counts[COLOR_NB][PIECE_TYPE_NB] {};
+        std::string_view sides[COLOR_NB] = {name.substr(0, v), name.substr(v+1)};
+        for (Color c: {WHITE, BLACK}) {
+            if (sides[c].empty() || sides[c][0] != 'K') throw std::invalid_argument("Bad tablebase name " + std::string(name));
+            for (char ch: sides[c].substr(1)) {
+                const char* p = std::strchr(NAMES, ch);
+                if (!p || ch == ' ' || ch == 'K') throw std::invalid_argument("Bad tablebase name " + std::string(name));
+                ++counts[c][p-NAMES];
+            }
+        }
+        *this = from_counts(counts);
+    }
+
+    Material::Material(const Position& pos) {
+
+        int counts[COLOR_NB][PIECE_TYPE_NB] {};
+        for (Color c: {WHITE, BLACK})
+            for (PieceType pt: ORDER) counts[c][pt] = popcount(pos.pieces(c, pt));
+        *this = from_counts(counts);
+    }
+
+    std::string Material::name() const {
+
+        std::string sides[COLOR_NB] = {"K", "K"};
+        for (int i=2; i<count; ++i) sides[color_of(pieces[i])] += NAMES[type_of(pieces[i])];
+        return sides[WHITE] + 'v' + sides[BLACK];
+    }
+
+    uint64_t Material::size() const {
+
+        uint64_t n = 2*king_squares();
+        for (int i=1; i<count; ++i) n *= 64;
+        return n;
+    }
+
+    uint32_t material_code(const Position& pos, bool swap_colors) {
+
+        int counts[COLOR_NB][PIECE_TYPE_NB] {};
+        for (Color c: {WHITE, BLACK})
+            for (PieceType pt: ORDER) counts[c][pt] = popcount(pos.pieces(c, pt));
+        Color low = swap_colors? BLACK: WHITE;
+        return side_code(counts[low]) | side_code(counts[~low]) << 15;
+    }
+
+    uint64_t index(const Material& m, const Position& pos, bool flip) {
+
+        auto real = [flip] (Color c) { return flip? ~c: c; };
+        auto oriented = [flip] (Square s) { return flip? s ^ 56: s; };
+
+        Square wk = oriented(pos.king_square(real(WHITE)));
+        Square bk = oriented(pos.king_square(real(BLACK)));
+
+        // king symmetries: files for every table, ranks and the diagonal without pawns
+        bool mirror_file = file_of(wk) > 3, mirror_rank = !m.pawns && rank_of(wk) > 3;
+        auto encode = [&] (bool mirror_diagonal) {
+
+            auto transform = [&] (Square s) {
+                if (mirror_file) s ^= 7;
+                if (mirror_rank) s ^= 56;
+                if (mirror_diagonal) s = (s & 7) << 3 | s >> 3;
+                return s;
+            };
+            Square k = transform(wk);
+            uint64_t idx = real(pos.side_to_move()) == WHITE? 0: 1;
+            idx = idx*m.king_squares() + (m.pawns? rank_of(k)*4 + file_of(k): TRIANGLE[k]);
+            idx = idx*64 + transform(bk);
+
+            // equal pieces enter in ascending square order
+            for (int i=2; i<m.count; ) {
+                Piece pc = m.pieces[i];
+                std::array<Square, MAX_PIECES> squares;
+                int n = 0;
+                for (Bitboard b = pos.pieces(real(color_of(pc)), type_of(pc)); b; ++n) {
+                    Square s = transform(oriented(pop_lsb(b)));
+                    int j = n;
+                    for (; j > 0 && squares[j-1] > s; --j) squares[j] = squares[j-1];
+                    squares[j] = s;
+                }
+                for (int j=0; j<n; ++j) idx = idx*64 + squares[j];
+                i += n;
+            }
+            return idx;
+        };
+        if (m.pawns) return encode(false);
+
+        Square k = wk ^ (mirror_file? 7: 0) ^ (mirror_rank? 56: 0);
+        if (rank_of(k) != file_of(k)) return encode(rank_of(k) > file_of(k));
+        return std::min(encode(false), encode(true));     // king on the diagonal, both are candidates
+    }
+
+    void decode(const Material& m, uint64_t idx, std::array<Square, MAX_PIECES>& squares, Color& stm) {
+
+        for (int i=m.count-1; i>=1; --i) {
+            squares[i] = idx % 64;
+            idx /= 64;
+        }
+        int k = idx % m.king_squares();
+        squares[0] = m.pawns? make_square(k % 4, k / 4): TRIANGLE_SQUARES[k];
+        stm = idx / m.king_squares()? BLACK: WHITE;
+    }
+
+    void init(const std::string& path) {
+
+        tables.clear();
+        by_code.clear();
+        largest = 0;
+        if (path.empty()) return;
+
+        for (const auto& file: std::filesystem::directory_iterator(path)) {
+
+            if (file.path().extension() != EXTENSION) continue;
+            try {
+                Material m(file.path().stem().string());
+                tables.push_back(std::make_unique<Table>(file.path().string(), m));
+            }
+            catch (std::invalid_argument& e) {
+                LOGE("%s", e.what())
+                continue;
+            }
+
+            Table* t = tables.back().get();
+            int counts[COLOR_NB][PIECE_TYPE_NB] {};
+            for (int i=2; i<t->material.count; ++i) ++counts[color_of(t->material.pieces[i])][type_of(t->material.pieces[i])];
+            uint32_t white = side_code(counts[WHITE]), black = side_code(counts[BLACK]);
+            by_code[white | black << 15] = {t, false};
+            if (white != black) by_code[black | white << 15] = {t, true};
+            largest = std::max(largest, t->material.count);
+        }
+        syzygy::init(path);
+    }
+
+    int max_pieces() {
+
+        return std::max(largest, syzygy::max_pieces());
+    }
+
+    bool probe_wdl(Position& pos, WDL& wdl) {
+
+        if (pos.pieces() == pos.pieces(KING)) { wdl = WDL_DRAW; return true; }
+
+        if (syzygy::probe_wdl(pos, wdl)) return true;
+
+        Lookup lookup;
+        uint64_t idx;
+        if (!locate(pos, lookup, idx)) return false;
+
+        switch ((lookup.table->wdl[idx >> 2] >> 2*(idx & 3)) & 3) {
+            case STORED_DRAW: wdl = WDL_DRAW; return true;
+            case STORED_WIN: wdl = WDL_WIN; return true;
+            case STORED_LOSS: wdl = WDL_LOSS; return true;
+            default: return false;
+        }
+    }
+
+    bool probe_dtz(Position& pos, int& plies) {
+
+        return syzygy::probe_dtz(pos, plies);
+    }
+
+    bool probe_dtm(const Position& pos, WDL& wdl, int& moves) {
+
+        if (pos.pieces() == pos.pieces(KING)) { wdl = WDL_DRAW, moves = 0; return true; }
+
+        Lookup lookup;
+        uint64_t idx;
+        if (!locate(pos, lookup, idx)) return false;
+
+        uint8_t v = lookup.table->dtm[idx];
+        if (v == DTM_UNUSED) return false;
+        if (v == 0) wdl = WDL_DRAW, moves = 0;
+        else if (v <= DTM_MAX) wdl = WDL_WIN, moves = v;
+        else wdl = WDL_LOSS, moves = v - DTM_LOSS;
+        return true;
+    }
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "position.h"
+
+/**
+ * Endgame tablebases in the engine's own format, one file per material, "KRPvKR.ctb".
+ * White is always the stronger side, positions of the mirrored material are probed
+ * with colors swapped. Positions with castling rights or en passant are not covered.
+ * Syzygy tables in the same directory are probed first, the .ctb files answer what they do not
+ * cover, see syzygy.h
+*/
+namespace tb {
+
+    constexpr int MAX_PIECES = 5;
+
+    /**
+     * File layout, all integers little endian:
+     *   Header
+     *   WDL section, 2 bits per index (0 draw, 1 win, 2 loss, 3 unused), 4 per byte
+     *   DTM section, 1 byte per index, side to move point of view:
+     *       0 draw, 1..127 mate in n moves, 128+n mated in n moves, 255 unused
+    */
+    constexpr char MAGIC[8] = {'C', 'H', 'S', 'T', 'B', 'A', 'S', 'E'};
+    constexpr uint32_t VERSION = 1;
+    constexpr char EXTENSION[] = ".ctb";
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t pieces;
+        char name[16];
+        uint64_t entries;
+        uint64_t wdl_offset;
+        uint64_t dtm_offset;
+    };
+
+    enum WDL : int { WDL_LOSS = -1, WDL_DRAW = 0, WDL_WIN = 1 };
+    enum : uint8_t { STORED_DRAW, STORED_WIN, STORED_LOSS, STORED_UNUSED };
+
+    constexpr uint8_t DTM_LOSS = 128, DTM_UNUSED = 255, DTM_MAX = 127;
+
+    /**
+     * Piece set of a table in index order: white king, black king, then white and
+     * black pieces by type Q R B N P
+    */
+    struct Material {
+        std::array<engine::Piece, MAX_PIECES> pieces {};
+        int count = 0;
+        bool pawns = false;
+
+        Material() = default;
+        /**
+         * Throws std::invalid_argument on a malformed name or more than MAX_PIECES pieces
+        */
+        explicit Material(std::string_view name);
+        explicit Material(const engine::Position& pos);
+
+        std::string name() const;
+        uint64_t size() const;              // number of indices, both sides to move
+        int king_squares() const { return pawns? 32: 10; }
+    };
+
+    /**
+     * 15 bits per color, 3 bits count per piece type, white in the low bits
+    */
+    uint32_t material_code(const engine::Position& pos, bool swap_colors);
+
+    /**
+     * Index of the position in the table of material m, flip swaps colors and mirrors
+     * ranks for positions of the weaker side material. Positions reaching one index through
+     * the king symmetries or an equal piece order are stored once, at the index returned here
+    */
+    uint64_t index(const Material& m, const engine::Position& pos, bool flip);
+
+    /**
+     * Squares in Material::pieces order and side to move of an index, the inverse of index()
+     * for stored positions. Other indices may give overlapping pieces
+    */
+    void decode(const Material& m, uint64_t idx, std::array<engine::Square, MAX_PIECES>& squares, engine::Color& stm);
+
+    /**
+     * Scans the directory for .ctb and Syzygy tables, the files are mapped on the first probe.
+     * An empty path disables probing
+    */
+    void init(const std::string& path);
+
+    /**
+     * Largest number of pieces with a table, 0 when there are none
+    */
+    int max_pieces();
+
+    /**
+     * Safe to call from several search threads, false when the position is not covered.
+     * Syzygy probes make and take back captures on the position
+    */
+    bool probe_wdl(engine::Position& pos, WDL& wdl);
+
+    /**
+     * moves - to mate for a win, to being mated for a loss, 0 for a draw
+    */
+    bool probe_dtm(const engine::Position& pos, WDL& wdl, int& moves);
+
+    /**
+     * Syzygy plies to the next capture or pawn move, positive when the side to move wins,
+     * 100 more for results lost to the fifty move rule. There is no DTZ in .ctb files, DTM is exact
+    */
+    bool probe_dtz(engine::Position& pos, int& plies);
+}
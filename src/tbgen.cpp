@@ -0,0 +1,372 @@
+#include "tbgen.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include "movegen.h"
+#include "pgn.h"
+#include "log.h"
+
+namespace tb {
+
+    using namespace engine;
+
+    namespace {
+
+        // working value of an index: plies to mate + 1, odd plies - side to move wins
+        constexpr uint16_t UNKNOWN = 0, DRAW = 0xFFFE, UNUSED = 0xFFFF;
+
+        using Work = std::vector<std::atomic<uint16_t>>;
+        using Bits = std::vector<std::atomic<uint64_t>>;
+
+        inline bool resolved(uint16_t v) { return v != UNKNOWN && v != DRAW && v != UNUSED; }
+
+        inline void mark(Bits& bits, uint64_t i) { bits[i/64].fetch_or(1ULL << (i%64), std::memory_order_relaxed); }
+        inline bool marked(const Bits& bits, uint64_t i) { return bits[i/64].load(std::memory_order_relaxed) >> (i%64) & 1; }
+
+        /**
+         * Runs f(index, position, scratch position) over [0, n) in chunks on every thread
+        */
+        template <typename F>
+        void parallel(uint64_t n, unsigned int threads, F f) {
+
+            constexpr uint64_t CHUNK = 1 << 14;
+            std::atomic<uint64_t> next {0};
+            auto worker = [&] {
+
+                Position pos, scratch;
+                for (uint64_t begin; (begin = next.fetch_add(CHUNK)) < n; )
+                    for (uint64_t i=begin, end=std::min(n, begin+CHUNK); i<end; ++i) f(i, pos, scratch);
+            };
+            std::vector<std::thread> pool;
+            for (unsigned int t=1; t<threads; ++t) pool.emplace_back(worker);
+            worker();
+            for (std::thread& t: pool) t.join();
+        }
+
+        // puts the index on the board, false when it is not a stored position
+        bool setup(const Material& m, uint64_t idx, Position& pos) {
+
+            std::array<Square, MAX_PIECES> squares;
+            Color stm;
+            decode(m, idx, squares, stm);
+
+            Bitboard occupied = 0;
+            for (int i=0; i<m.count; ++i) {
+                if (occupied & square_bb(squares[i])) return false;
+                if (type_of(m.pieces[i]) == PAWN && (rank_of(squares[i]) == 0 || rank_of(squares[i]) == 7)) return false;
+                occupied |= square_bb(squares[i]);
+            }
+            pos.set(m.pieces.data(), squares.data(), m.count, stm);
+            if (pos.attacked(pos.king_square(~stm), stm)) return false;
+            return index(m, pos, false) == idx;
+        }
+
+        int expand(const Material& m, const Work& work, Position& pos, bool& missing);
+
+        /**
+         * Plies to mate from the successor's side to move, -1 while unknown, -2 for a draw.
+         * Captures and promotions leave the table and are probed in the smaller ones
+        */
+        int successor(const Material& m, const Work& work, Position& pos, Move move, bool& missing) {
+
+            bool leaves = pos.capture(move) || type_of(move) == PROMOTION;
+            int plies = -1;
+            pos.do_move(move);
+            if (leaves) {
+                WDL wdl;
+                int moves;
+                if (!probe_dtm(pos, wdl, moves)) missing = true;
+                else plies = wdl == WDL_DRAW? -2: wdl == WDL_WIN? 2*moves-1: 2*moves;
+            }
+            else if (pos.ep_square() != NO_SQUARE) plies = expand(m, work, pos, missing);
+            else {
+                uint16_t v = work[index(m, pos, false)].load(std::memory_order_relaxed);
+                plies = v == DRAW? -2: resolved(v)? v-1: -1;
+            }
+            pos.undo_move(move);
+            return plies;
+        }
+
+        /**
+         * Tables hold no en passant rights, such a position is valued from its own successors
+        */
+        int expand(const Material& m, const Work& work, Position& pos, bool& missing) {
+
+            MoveList list = legal_moves(pos);
+            if (!list.size()) return pos.in_check()? 0: -2;
+
+            int fastest_loss = INT32_MAX, longest_win = -1;
+            bool all_won = true, open = false;
+            for (Move move: list) {
+                int plies = successor(m, work, pos, move, missing);
+                if (plies >= 0 && plies % 2 == 0) fastest_loss = std::min(fastest_loss, plies);
+                else if (plies >= 0) longest_win = std::max(longest_win, plies);
+                else all_won = false, open |= plies == -1;
+            }
+            if (fastest_loss != INT32_MAX) return fastest_loss+1;
+            return all_won? longest_win+1: open? -1: -2;
+        }
+
+        /**
+         * Calls f with the index of every stored position one move before pos. Moves into the
+         * table never capture or promote, so they are undone as plain piece moves
+        */
+        template <typename F>
+        void predecessors(const Material& m, const Position& pos, Position& scratch, F f) {
+
+            Color them = ~pos.side_to_move();
+            std::array<Piece, MAX_PIECES> pieces;
+            std::array<Square, MAX_PIECES> squares;
+            int n = 0;
+            for (Bitboard b = pos.pieces(); b; ++n) {
+                squares[n] = pop_lsb(b);
+                pieces[n] = pos.piece_on(squares[n]);
+            }
+
+            Bitboard occupied = pos.pieces();
+            for (int k=0; k<n; ++k) {
+
+                if (color_of(pieces[k]) != them) continue;
+                Square to = squares[k];
+                Bitboard from;
+                if (type_of(pieces[k]) == PAWN) {
+                    Square back = to - pawn_push(them);
+                    int rank = relative_rank(them, rank_of(to));
+                    from = rank >= 2 && !(occupied & square_bb(back))? square_bb(back): 0;
+                    if (from && rank == 3 && !(occupied & square_bb(back - pawn_push(them))))
+                        from |= square_bb(back - pawn_push(them));
+                }
+                else from = attacks_bb(type_of(pieces[k]), to, occupied) & ~occupied;
+
+                while (from) {
+                    squares[k] = pop_lsb(from);
+                    scratch.set(pieces.data(), squares.data(), n, them);
+                    if (!scratch.attacked(scratch.king_square(~them), them)) f(index(m, scratch, false));
+                }
+                squares[k] = to;
+            }
+        }
+
+        /**
+         * Value of the position from successors resolved before the pass: a win when one of them
+         * is lost, a loss when all of them are won
+        */
+        uint16_t resolve(const Material& m, const Work& work, Position& pos, int pass, bool& missing) {
+
+            bool all_won = true;
+            int longest = 0;
+            for (Move move: legal_moves(pos)) {
+
+                int plies = successor(m, work, pos, move, missing);
+                if (plies >= pass) plies = -1;
+                if (plies >= 0 && plies % 2 == 0) return plies+2;
+                if (plies >= 0) longest = std::max(longest, plies);
+                else all_won = false;
+            }
+            return all_won? longest+2: UNKNOWN;
+        }
+
+        // successors agree with the stored value
+        bool verify(const Material& m, const Work& work, Position& pos, uint16_t value, bool& missing) {
+
+            MoveList list = legal_moves(pos);
+            if (!list.size()) return value == (pos.in_check()? 1: DRAW);
+
+            int fastest_loss = INT32_MAX, longest_win = -1;
+            bool all_won = true;
+            for (Move move: list) {
+                int plies = successor(m, work, pos, move, missing);
+                if (plies >= 0 && plies % 2 == 0) fastest_loss = std::min(fastest_loss, plies);
+                else if (plies >= 0) longest_win = std::max(longest_win, plies);
+                else all_won = false;
+            }
+            if (value == DRAW) return fastest_loss == INT32_MAX && !all_won;
+            int plies = value-1;
+            return plies % 2? fastest_loss == plies-1: all_won && longest_win == plies-1;
+        }
+
+        std::vector<std::string> smaller_tables(const std::string& name) {
+
+            std::vector<std::string> names;
+            auto add = [&] (const std::string& n) {
+                std::string canonical = Material(n).name();
+                if (canonical != "KvK" && std::find(names.begin(), names.end(), canonical) == names.end())
+                    names.push_back(canonical);
+            };
+            for (size_t i=0; i<name.size(); ++i) {
+                if (name[i] == 'K' || name[i] == 'v') continue;
+                add(name.substr(0, i) + name.substr(i+1));
+                if (name[i] == 'P') for (char promoted: {'Q', 'R', 'B', 'N'}) add(name.substr(0, i) + promoted + name.substr(i+1));
+            }
+            return names;
+        }
+
+        void write(const Material& m, const Work& work, const std::string& file, GenStats& stats) {
+
+            uint64_t n = m.size();
+            std::vector<uint8_t> wdl((n+3)/4), dtm(n);
+            uint64_t saturated = 0;
+
+            for (uint64_t i=0; i<n; ++i) {
+
+                uint16_t v = work[i].load(std::memory_order_relaxed);
+                uint8_t stored = STORED_UNUSED, distance = DTM_UNUSED;
+                if (v == DRAW) stored = STORED_DRAW, distance = 0, ++stats.draws;
+                else if (resolved(v)) {
+                    int plies = v-1, moves = (plies+1)/2;
+                    stats.longest = std::max(stats.longest, plies);
+                    if (plies % 2) {
+                        stored = STORED_WIN, ++stats.wins;
+                        distance = std::min(moves, static_cast<int>(DTM_MAX));
+                    }
+                    else {
+                        stored = STORED_LOSS, ++stats.losses;
+                        distance = DTM_LOSS + std::min(moves, DTM_UNUSED-1-DTM_LOSS);
+                    }
+                    saturated += moves > DTM_MAX-(plies % 2 == 0);
+                }
+                wdl[i/4] |= stored << 2*(i%4);
+                dtm[i] = distance;
+            }
+            stats.positions = stats.wins + stats.draws + stats.losses;
+            if (saturated) LOGI("%s: %lu positions beyond mate in %d, distance capped", stats.name.c_str(), saturated, DTM_MAX)
+
+            auto align = [] (uint64_t offset) { return (offset+63) & ~uint64_t(63); };
+            Header header {};
+            std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+            header.version = VERSION;
+            header.pieces = m.count;
+            std::strncpy(header.name, stats.name.c_str(), sizeof(header.name)-1);
+            header.entries = n;
+            header.wdl_offset = align(sizeof(Header));
+            header.dtm_offset = align(header.wdl_offset + wdl.size());
+
+            std::string tmp = file + ".tmp";
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            if (!out) throw std::runtime_error("Could not create tablebase " + tmp);
+            const char zeros[64] {};
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(zeros, header.wdl_offset - sizeof(header));
+            out.write(reinterpret_cast<const char*>(wdl.data()), wdl.size());
+            out.write(zeros, header.dtm_offset - header.wdl_offset - wdl.size());
+            out.write(reinterpret_cast<const char*>(dtm.data()), dtm.size());
+            out.close();
+            if (!out) throw std::runtime_error("Could not write tablebase " + tmp);
+            if (std::rename(tmp.c_str(), file.c_str()) != 0)
+                throw std::runtime_error("Could not replace tablebase " + file + ": " + strerror(errno));
+        }
+
+        GenStats build(const Material& m, const std::string& file, unsigned int threads) {
+
+            auto start = std::chrono::steady_clock::now();
+            GenStats stats;
+            stats.name = m.name();
+            uint64_t n = m.size();
+            Work work(n);
+            Bits always((n+63)/64), dirty((n+63)/64), next((n+63)/64);
+            std::atomic<bool> missing {false};
+            std::atomic<int> deepest_exit {0};
+
+            // pass 0: legal positions and mates. Positions with moves out of the table or to an
+            // en passant position are looked at every pass, the others only after a successor changed
+            parallel(n, threads, [&] (uint64_t i, Position& pos, Position&) {
+
+                if (!setup(m, i, pos)) { work[i].store(UNUSED, std::memory_order_relaxed); return; }
+                MoveList list = legal_moves(pos);
+                if (!list.size()) { work[i].store(pos.in_check()? 1: DRAW, std::memory_order_relaxed); return; }
+
+                bool missing_table = false;
+                for (Move move: list) {
+                    bool leaves = pos.capture(move) || type_of(move) == PROMOTION;
+                    if (!leaves && !(type_of(pos.moved_piece(move)) == PAWN && std::abs(to_sq(move)-from_sq(move)) == 16))
+                        continue;
+                    int plies = successor(m, work, pos, move, missing_table);
+                    mark(always, i);
+                    int seen = deepest_exit.load(std::memory_order_relaxed);
+                    while (plies > seen && !deepest_exit.compare_exchange_weak(seen, plies)) {}
+                }
+                if (missing_table) missing = true;
+            });
+            if (missing) throw std::runtime_error("Smaller tables missing for " + stats.name);
+
+            parallel(n, threads, [&] (uint64_t i, Position& pos, Position& scratch) {
+
+                if (work[i].load(std::memory_order_relaxed) != 1) return;
+                setup(m, i, pos);
+                predecessors(m, pos, scratch, [&] (uint64_t p) { mark(dirty, p); });
+            });
+
+            // pass p resolves the positions exactly p plies from mate, a pass without changes
+            // ends the search once no line into a smaller table is longer
+            for (int pass=1; ; ++pass) {
+
+                std::atomic<uint64_t> changed {0};
+                parallel(n, threads, [&] (uint64_t i, Position& pos, Position& scratch) {
+
+                    if (work[i].load(std::memory_order_relaxed) != UNKNOWN || !(marked(dirty, i) || marked(always, i))) return;
+                    setup(m, i, pos);
+                    bool missing_table = false;
+                    uint16_t v = resolve(m, work, pos, pass, missing_table);
+                    if (v == UNKNOWN) return;
+
+                    work[i].store(v, std::memory_order_relaxed);
+                    changed.fetch_add(1, std::memory_order_relaxed);
+                    predecessors(m, pos, scratch, [&] (uint64_t p) { mark(next, p); });
+                });
+                stats.passes = pass;
+                LOGD("%s pass %d: %lu resolved", stats.name.c_str(), pass, changed.load())
+                if (!changed && pass > deepest_exit) break;
+
+                std::swap(dirty, next);
+                for (auto& word: next) word.store(0, std::memory_order_relaxed);
+            }
+
+            for (uint64_t i=0; i<n; ++i)
+                if (work[i].load(std::memory_order_relaxed) == UNKNOWN) work[i].store(DRAW, std::memory_order_relaxed);
+
+            std::atomic<uint64_t> errors {0};
+            parallel(n, threads, [&] (uint64_t i, Position& pos, Position&) {
+
+                uint16_t v = work[i].load(std::memory_order_relaxed);
+                if (v == UNUSED) return;
+                setup(m, i, pos);
+                bool missing_table = false;
+                if (!verify(m, work, pos, v, missing_table) || missing_table) {
+                    if (!errors.fetch_add(1)) LOGE("%s: inconsistent value %d at %s", stats.name.c_str(), v, pos.fen().c_str())
+                }
+            });
+            stats.errors = errors;
+
+            write(m, work, file, stats);
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+            return stats;
+        }
+
+        void generate(const Material& m, const std::string& path, unsigned int threads, std::vector<GenStats>& done) {
+
+            for (const std::string& smaller: smaller_tables(m.name())) {
+                std::filesystem::path file = std::filesystem::path(path) / (smaller + EXTENSION);
+                if (!std::filesystem::exists(file)) generate(Material(smaller), path, threads, done);
+            }
+            init(path);     // map the smaller tables for the probes
+            std::filesystem::path file = std::filesystem::path(path) / (m.name() + EXTENSION);
+            done.push_back(build(m, file.string(), threads));
+        }
+    }
+
+    std::vector<GenStats> generate(const std::string& name, const std::string& path, unsigned int threads) {
+
+        std::vector<GenStats> done;
+        std::filesystem::create_directories(path);
+        generate(Material(name), path, pgn::thread_count(threads), done);
+        init(path);
+        return done;
+    }
+}
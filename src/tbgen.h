@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "tb.h"
+
+namespace tb {
+
+    struct GenStats {
+        std::string name;
+        uint64_t positions = 0;     // legal positions stored
+        uint64_t wins = 0, draws = 0, losses = 0;
+        int longest = 0;            // plies to mate
+        int passes = 0;
+        uint64_t errors = 0;        // positions failing the verification pass
+        double seconds = 0;
+    };
+
+    /**
+     * Builds <path>/<name>.ctb by retrograde analysis with the engine move generator,
+     * missing smaller tables reached by captures and promotions are built first.
+     * Every position is checked against its successors after the build.
+     * Throws std::invalid_argument on a bad name, std::runtime_error on write errors
+    */
+    std::vector<GenStats> generate(const std::string& name, const std::string& path, unsigned int threads);
+}
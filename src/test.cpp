@@ -0,0 +1,637 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "archive.h"
+#include "book.h"
+#include "datagen.h"
+#include "eval.h"
+#include "explorer.h"
+#include "log.h"
+#include "match.h"
+#include "mate.h"
+#include "movegen.h"
+#include "movepick.h"
+#include "nnue.h"
+#include "notation.h"
+#include "search.h"
+#include "tbgen.h"
+
+/**
+ * Checks of libchess, "chess-tests <name>" runs one of them, without a name all run.
+ * ctest runs every test as its own case
+*/
+namespace {
+
+    using namespace engine;
+
+    int failures = 0;
+
+    #define CHECK(condition) \
+        if (!(condition)) { ++failures; std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); }
+
+    /**
+     * Deterministic games of pseudo random legal moves
+    */
+    std::vector<std::vector<Move>> random_games(const std::string& fen, int games, int plies) {
+
+        std::vector<std::vector<Move>> result;
+        uint64_t seed = 0x9E3779B97F4A7C15ull;
+        for (int g=0; g<games; ++g) {
+
+            Position pos(fen);
+            result.emplace_back();
+            for (int ply=0; ply<plies; ++ply) {
+                MoveList list = legal_moves(pos);
+                if (!list.size()) break;
+                seed ^= seed<<13, seed ^= seed>>7, seed ^= seed<<17;
+                Move m = list.moves[seed%list.size()];
+                result.back().push_back(m);
+                pos.do_move(m);
+            }
+        }
+        return result;
+    }
+
+    std::filesystem::path scratch_dir(const std::string& name) {
+
+        std::filesystem::path dir = std::filesystem::temp_directory_path()/("chess-tests-" + name);
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        return dir;
+    }
+
+    // the positions and counts of the chessprogramming wiki perft page
+    void perft() {
+
+        struct Case { const char* fen; int depth; uint64_t nodes; };
+        constexpr Case CASES[] = {
+            {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 5, 4865609},
+            {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4, 4085603},
+            {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 6, 11030083},
+            {"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 4, 422333},
+            {"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 4, 2103487},
+        };
+        for (const Case& c: CASES) {
+            Position pos(c.fen);
+            CHECK(engine::perft(pos, c.depth) == c.nodes)
+        }
+    }
+
+    // key test vectors of the polyglot book format description
+    void polyglot() {
+
+        struct Case { const char* moves; uint64_t key; };
+        constexpr Case CASES[] = {
+            {"", 0x463b96181691fc9cULL},
+            {"e2e4", 0x823c9b50fd114196ULL},
+            {"e2e4 d7d5", 0x0756b94461c50fb0ULL},
+            {"e2e4 d7d5 e4e5", 0x662fafb965db29d4ULL},
+            {"e2e4 d7d5 e4e5 f7f5", 0x22a48b5a8e47ff78ULL},
+            {"e2e4 d7d5 e4e5 f7f5 e1e2", 0x652a607ca3f242c1ULL},
+            {"e2e4 d7d5 e4e5 f7f5 e1e2 e8f7", 0x00fdd303c946bdd9ULL},
+            {"a2a4 b7b5 h2h4 b5b4 c2c4", 0x3c8123ea7b067637ULL},
+            {"a2a4 b7b5 h2h4 b5b4 c2c4 b4c3 a1a2", 0x5c3f9b829b279560ULL},
+        };
+        for (const Case& c: CASES) {
+            Position pos;
+            std::string moves = c.moves;
+            for (size_t at=0; at<moves.size(); at+=5) pos.do_move(from_uci(pos, moves.substr(at, 4)));
+            CHECK(book::polyglot_key(pos) == c.key)
+        }
+    }
+
+    /**
+     * Every kernel level the CPU has gives the scores of the scalar code, on a network of random weights
+    */
+    void nnue_simd() {
+
+        std::filesystem::path path = scratch_dir("nnue")/"random.nnue";
+        {
+            std::mt19937 rng(1);
+            std::ofstream out(path, std::ios::binary);
+            auto write = [&out] (const auto& value) { out.write(reinterpret_cast<const char*>(&value), sizeof(value)); };
+            auto fill = [&] (auto type, size_t count, int range) {
+                std::uniform_int_distribution<int> dist(-range, range);
+                for (size_t i=0; i<count; ++i) write(static_cast<decltype(type)>(dist(rng)));
+            };
+            out.write(nnue::MAGIC, sizeof(nnue::MAGIC));
+            for (uint32_t v: {nnue::VERSION, uint32_t(nnue::INPUTS), uint32_t(nnue::HALF_DIMENSIONS), uint32_t(nnue::L1), uint32_t(nnue::L2)}) write(v);
+            fill(int16_t(), nnue::HALF_DIMENSIONS, 64);
+            fill(int16_t(), static_cast<size_t>(nnue::INPUTS)*nnue::HALF_DIMENSIONS, 32);
+            fill(int32_t(), nnue::L1, 2000);
+            fill(int8_t(), nnue::L1*2*nnue::HALF_DIMENSIONS, 127);
+            fill(int32_t(), nnue::L2, 2000);
+            fill(int8_t(), nnue::L2*nnue::L1, 127);
+            fill(int32_t(), 1, 2000);
+            fill(int8_t(), nnue::L2, 127);
+        }
+        nnue::load(path.string());
+
+        // incremental updates along the games, refreshes after king moves
+        auto scores = [] (nnue::Simd simd) {
+            nnue::select(simd);
+            std::vector<int> result;
+            for (const auto& game: random_games(Position::START_FEN, 8, 100)) {
+                Position pos;
+                result.push_back(nnue::evaluate(pos));
+                for (Move m: game) pos.do_move(m), result.push_back(nnue::evaluate(pos));
+            }
+            return result;
+        };
+        std::vector<int> scalar = scores(nnue::SCALAR);
+        for (int level=nnue::SCALAR+1; level<=nnue::detected(); ++level) {
+            std::vector<int> simd = scores(nnue::Simd(level));
+            CHECK(simd == scalar)
+        }
+        nnue::select(nnue::detected());
+        std::filesystem::remove_all(path.parent_path());
+    }
+
+    bool probe_wdl(const char* fen, tb::WDL& wdl) {
+
+        Position pos(fen);
+        return tb::probe_wdl(pos, wdl);
+    }
+
+    void tbgen() {
+
+        std::filesystem::path dir = scratch_dir("tb");
+        for (const char* name: {"KQvK", "KRvK", "KPvK"})
+            for (const tb::GenStats& s: tb::generate(name, dir.string(), 0)) {
+                CHECK(s.errors == 0)
+                CHECK(s.positions > 0)
+            }
+
+        tb::init(dir.string());
+        tb::WDL wdl;
+        int moves = 0;
+        CHECK(tb::probe_dtm(Position("k7/8/1K6/8/8/8/8/6Q1 w - - 0 1"), wdl, moves) && wdl == tb::WDL_WIN && moves == 1)
+        CHECK(probe_wdl("8/8/8/8/8/8/6kR/K7 b - - 0 1", wdl) && wdl == tb::WDL_DRAW)
+        CHECK(probe_wdl("8/8/8/8/8/8/6k1/K6R w - - 0 1", wdl) && wdl == tb::WDL_WIN)
+        CHECK(probe_wdl("k7/8/1K6/8/8/8/8/3R4 b - - 0 1", wdl) && wdl == tb::WDL_LOSS)
+        // the pawn can not be stopped from queening / the black king holds the draw
+        CHECK(probe_wdl("8/8/8/8/8/k7/6P1/K7 w - - 0 1", wdl) && wdl == tb::WDL_WIN)
+        CHECK(probe_wdl("6k1/8/8/8/8/8/6P1/K7 w - - 0 1", wdl) && wdl == tb::WDL_DRAW)
+        tb::init("");
+        std::filesystem::remove_all(dir);
+    }
+
+    /**
+     * Syzygy KQvK tables whose positions all hold one value: white to move wins, DTZ 9 plies
+    */
+    void syzygy() {
+
+        std::filesystem::path dir = scratch_dir("syzygy");
+        auto write = [&dir] (const char* name, std::vector<uint8_t> bytes) {
+            bytes.resize(80);   // the tables are 16 bytes past a multiple of 64
+            std::ofstream(dir/name, std::ios::binary).write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        };
+        // magic, split table without pawns, group order, pieces of both sides, padding, one value per side
+        write("KQvK.rtbw", {0x71, 0xE8, 0x23, 0x5D, 0x01, 0x00, 0x66, 0x55, 0xEE, 0x00, 0x80, 4, 0x80, 0});
+        // one side to move, white, 4 moves
+        write("KQvK.rtbz", {0xD7, 0x66, 0x0C, 0xA5, 0x01, 0x00, 0x06, 0x05, 0x0E, 0x00, 0x80, 4});
+        write("KRvK.rtbw", {0x00, 0x00, 0x00, 0x00});
+
+        tb::init(dir.string());
+        CHECK(tb::max_pieces() == 3)
+        tb::WDL wdl;
+        CHECK(probe_wdl("k7/8/1K6/8/8/8/8/6Q1 w - - 0 1", wdl) && wdl == tb::WDL_WIN)
+        CHECK(probe_wdl("k7/8/1K6/8/8/8/8/6Q1 b - - 0 1", wdl) && wdl == tb::WDL_LOSS)
+        CHECK(probe_wdl("K7/8/1k6/8/8/8/8/6q1 b - - 0 1", wdl) && wdl == tb::WDL_WIN)
+        // the king takes the queen, the capture is searched before the table
+        CHECK(probe_wdl("8/8/8/8/8/8/6kQ/K7 b - - 0 1", wdl) && wdl == tb::WDL_DRAW)
+        // a bad file is reported and not probed
+        CHECK(!probe_wdl("k7/8/1K6/8/8/8/8/6R1 w - - 0 1", wdl))
+
+        Position pos("k7/8/1K6/8/8/8/8/6Q1 w - - 0 1");
+        int plies = 0;
+        CHECK(tb::probe_dtz(pos, plies) && plies == 9)
+        pos.set("k7/8/1K6/8/8/8/8/6Q1 b - - 0 1");
+        CHECK(tb::probe_dtz(pos, plies) && plies == -10)
+        CHECK(pos.fen() == "k7/8/1K6/8/8/8/8/6Q1 b - - 0 1")
+
+        // the root plays the mate the DTZ ranking prefers without a search
+        search::TranspositionTable tt(1);
+        search::Searcher searcher(tt);
+        search::Limits limits;
+        searcher.prepare(limits);
+        search::Result result = searcher.think(Position("k7/8/1K6/8/8/8/8/6Q1 w - - 0 1"), limits);
+        CHECK(to_uci(result.best) == "g1g8" && result.depth == 1)
+
+        tb::init("");
+        std::filesystem::remove_all(dir);
+    }
+
+    void archive() {
+
+        std::filesystem::path dir = scratch_dir("archive");
+        std::string path = (dir/"games.arc").string();
+        const std::string fen = "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1";
+
+        // the first games as one segment, the last two appended one at a time
+        std::vector<archive::StoredGame> games;
+        for (const auto& moves: random_games(Position::START_FEN, 40, 120)) games.push_back({"", moves, pgn::Result(games.size()%3)});
+        for (const auto& moves: random_games(fen, 2, 60)) games.push_back({fen, moves, pgn::DRAW});
+        archive::Writer writer;
+        for (size_t i=0; i+2<games.size(); ++i) writer.add(games[i].fen, games[i].moves, games[i].result);
+        writer.write(path);
+        for (size_t i=games.size()-2; i<games.size(); ++i) {
+            archive::Writer one;
+            one.add(games[i].fen, games[i].moves, games[i].result);
+            one.append_to(path);
+        }
+
+        archive::Archive read(path);
+        CHECK(read.size() == games.size())
+        for (uint32_t id=0; id<read.size() && id<games.size(); ++id) {
+            archive::StoredGame g = read.game(id);
+            CHECK(g.fen == games[id].fen && g.moves == games[id].moves && g.result == games[id].result)
+        }
+
+        // every game is found in the position after its 10th move
+        for (uint32_t id=0; id<games.size(); ++id) {
+            Position pos = games[id].fen.empty()? Position(): Position(games[id].fen);
+            for (size_t i=0; i<10 && i<games[id].moves.size(); ++i) pos.do_move(games[id].moves[i]);
+            std::vector<uint32_t> ids = read.find(pos.key());
+            CHECK(std::find(ids.begin(), ids.end(), id) != ids.end())
+        }
+        std::filesystem::remove_all(dir);
+    }
+
+    void packed_position() {
+
+        for (const char* fen: {Position::START_FEN, "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"})
+            for (const auto& game: random_games(fen, 10, 150)) {
+                Position pos(fen);
+                for (Move m: game) {
+                    pos.do_move(m);
+                    datagen::PackedPosition p = datagen::PackedPosition::pack(pos, 37, -1);
+                    CHECK(p.fen() == pos.fen())
+                    CHECK(p.position().key() == pos.key())
+                    CHECK(p.score == 37 && p.result == -1 && p.side_to_move() == pos.side_to_move())
+                }
+            }
+    }
+
+    /**
+     * SAN of every legal move along random games parses back to the move, the games written as
+     * PGN movetext parse back to the same moves
+    */
+    void san_pgn() {
+
+        for (const char* fen: {Position::START_FEN, "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"})
+            for (const auto& game: random_games(fen, 10, 120)) {
+                Position pos(fen);
+                std::string movetext;
+                for (Move m: game) {
+                    for (Move any: legal_moves(pos)) CHECK(from_san(pos, to_san(pos, any)) == any)
+                    if (pos.side_to_move() == WHITE) movetext += std::to_string(pos.game_ply()/2+1) + ". ";
+                    movetext += to_san(pos, m) + ' ';
+                    pos.do_move(m);
+                }
+                std::string text = std::string("[FEN \"") + fen + "\"]\n\n" + (Position(fen).side_to_move() == BLACK? "1... ": "") + movetext + "*\n";
+                int parsed = 0;
+                pgn::parse(text, [&] (const pgn::Game& g, unsigned int) {
+                    ++parsed;
+                    CHECK(g.valid && g.moves == game && g.result == pgn::UNKNOWN)
+                });
+                CHECK(parsed == 1)
+            }
+
+        Position pos("4k3/P7/8/8/8/8/8/R3K2R w KQ - 0 1");
+        CHECK(to_san(pos, from_uci(pos, "e1g1")) == "O-O")
+        CHECK(to_san(pos, from_uci(pos, "h1h8")) == "Rh8+")
+        CHECK(to_san(pos, from_uci(pos, "a7a8q")) == "a8=Q+")
+        CHECK(from_san(pos, "0-0-0") == from_uci(pos, "e1c1"))
+        CHECK(from_san(pos, "a8=N!?") == from_uci(pos, "a7a8n"))
+        pos.set("4k3/8/R7/8/8/R6R/8/4K3 w - - 0 1");
+        CHECK(to_san(pos, from_uci(pos, "a3d3")) == "Rad3")
+        CHECK(to_san(pos, from_uci(pos, "a3a4")) == "R3a4")
+        CHECK(from_san(pos, "Rhd3") == from_uci(pos, "h3d3"))
+        CHECK(from_san(pos, "Rd3") == MOVE_NONE)
+
+        // tags, comments, NAGs and variations around the main line
+        const char* text = "[Event \"test\"]\n[White \"first\"]\n[Result \"1-0\"]\n\n"
+                           "1. e4 {open game} e5 (1... c5 2. Nf3) 2. Nf3 $1 Nc6 3. Bb5 a6 ; Morphy\n4. Ba4 1-0\n";
+        int parsed = 0;
+        pgn::parse(text, [&parsed] (const pgn::Game& g, unsigned int) {
+            ++parsed;
+            Position pos;
+            std::vector<Move> moves;
+            for (const char* uci: {"e2e4", "e7e5", "g1f3", "b8c6", "f1b5", "a7a6", "b5a4"})
+                moves.push_back(from_uci(pos, uci)), pos.do_move(moves.back());
+            CHECK(g.valid && g.moves == moves && g.result == pgn::WHITE_WINS && g.tag("White") == "first")
+        });
+        CHECK(parsed == 1)
+    }
+
+    /**
+     * Move counts, results and average ratings of a small PGN file
+    */
+    void explorer_build() {
+
+        std::filesystem::path dir = scratch_dir("explorer");
+        std::ofstream(dir/"games.pgn") << "[WhiteElo \"2000\"]\n[BlackElo \"2200\"]\n\n1. e4 e5 2. Nf3 1-0\n\n"
+                                          "[WhiteElo \"1800\"]\n[BlackElo \"1600\"]\n\n1. e4 c5 1/2-1/2\n\n"
+                                          "1. d4 d5 0-1\n\n"
+                                          "1. e4 e5 2. Nf3 Nc6 0-1\n";
+        std::string table_path = (dir/"openings.bin").string();
+        CHECK(explorer::build((dir/"games.pgn").string(), table_path, 2).games == 4)
+
+        explorer::Table table(table_path);
+        Position pos;
+        auto start = table.probe(pos.key());
+        CHECK(start.size() == 2)
+        if (start.size() == 2) {
+            const explorer::Entry& e4 = start[0];
+            CHECK(Move(e4.move) == from_uci(pos, "e2e4") && e4.games == 3)
+            CHECK(e4.white_wins == 1 && e4.draws == 1 && e4.black_wins == 1)
+            CHECK(e4.rated_games == 2 && e4.avg_rating == 1900)
+            CHECK(Move(start[1].move) == from_uci(pos, "d2d4") && start[1].games == 1 && start[1].avg_rating == 0)
+        }
+        for (const char* uci: {"e2e4", "e7e5"}) pos.do_move(from_uci(pos, uci));
+        auto after = table.probe(pos.key());
+        CHECK(after.size() == 1 && after[0].games == 2 && Move(after[0].move) == from_uci(pos, "g1f3"))
+
+        // one ply and moves of two games at least
+        explorer::build((dir/"games.pgn").string(), table_path, 1, 1, 2);
+        explorer::Table short_table(table_path);
+        CHECK(short_table.size() == 1 && short_table.probe(Position().key()).size() == 1)
+        CHECK(short_table.probe(pos.key()).empty())
+        std::filesystem::remove_all(dir);
+    }
+
+    /**
+     * Exchange values on one square, the order of the move picker stages
+    */
+    void see_movepick() {
+
+        constexpr int P = eval::PIECE_VALUE[PAWN], N = eval::PIECE_VALUE[KNIGHT], B = eval::PIECE_VALUE[BISHOP], Q = eval::PIECE_VALUE[QUEEN];
+        struct Case { const char* fen; const char* move; int value; };
+        const Case CASES[] = {
+            {"1k1r4/1pp4p/p7/4p3/8/P5P1/1PP4P/2K1R3 w - - 0 1", "e1e5", P},
+            {"4k3/8/2p5/3p4/8/8/8/3QK3 w - - 0 1", "d1d5", P - Q},
+            {"4k3/8/2p5/3n4/8/8/6B1/3QK3 w - - 0 1", "g2d5", N - B + P},
+            {"3qk3/8/8/3p4/8/8/3R4/3RK3 w - - 0 1", "d2d5", P},             // the rook behind keeps the queen out
+            {"4k3/8/8/3pP3/8/8/8/4K3 w - d6 0 1", "e5d6", P},
+            {"4k3/8/8/8/8/8/8/R3K3 w Q - 0 1", "e1c1", 0},
+        };
+        for (const Case& c: CASES) {
+            Position pos(c.fen);
+            CHECK(see(pos, from_uci(pos, c.move)) == c.value)
+        }
+
+        // hash move, winning captures by victim then attacker, killers and countermove, quiets, the losing capture
+        Position pos("4k3/8/8/1r1q3p/4P3/2N5/8/3QK3 w - - 0 1");
+        search::History history {};
+        Move killers[2] = {from_uci(pos, "e4e5"), from_uci(pos, "d1f3")};
+        search::MovePicker picker(pos, from_uci(pos, "c3b1"), killers, from_uci(pos, "c3a4"), history);
+        std::vector<std::string> order;
+        for (Move m; (m = picker.next()) != MOVE_NONE; ) order.push_back(to_uci(m));
+        const std::vector<std::string> first {"c3b1", "e4d5", "c3d5", "d1d5", "c3b5", "e4e5", "d1f3", "c3a4"};
+        CHECK(order.size() > first.size() && std::equal(first.begin(), first.end(), order.begin()) && order.back() == "d1h5")
+
+        // every pseudo legal move once, with random hash moves and killers
+        uint64_t seed = 1;
+        for (const auto& game: random_games(Position::START_FEN, 10, 100)) {
+            Position p;
+            for (Move m: game) {
+                MoveList all;
+                generate<PSEUDO_LEGAL>(p, all);
+                std::vector<Move> expected(all.moves, all.moves+all.size()), picked;
+                auto any = [&] { seed ^= seed<<13, seed ^= seed>>7, seed ^= seed<<17; return expected[seed%expected.size()]; };
+                Move refutations[2] = {any(), any()};
+                search::MovePicker mp(p, any(), refutations, any(), history);
+                for (Move n; (n = mp.next()) != MOVE_NONE; ) picked.push_back(n);
+                std::sort(expected.begin(), expected.end());
+                std::sort(picked.begin(), picked.end());
+                CHECK(picked == expected)
+                p.do_move(m);
+            }
+        }
+    }
+
+    /**
+     * Shortest mates and their lines, no mate where there is none
+    */
+    void mate_solver() {
+
+        auto mates = [] (Position pos, const std::vector<Move>& pv) {
+            for (Move m: pv) {
+                if (!legal_moves(pos).contains(m)) return false;
+                pos.do_move(m);
+            }
+            return pos.in_check() && !legal_moves(pos).size();
+        };
+
+        mate::Solver solver(16);
+        struct Case { const char* fen; int moves; };
+        for (const Case& c: {Case{"k7/8/1K6/8/8/8/8/6Q1 w - - 0 1", 1}, Case{"k7/8/2K5/8/8/8/8/1R6 w - - 0 1", 2}}) {
+            Position pos(c.fen);
+            solver.clear();
+            mate::Result r = solver.solve(pos, 3);
+            CHECK(r.found && r.moves == c.moves && static_cast<int>(r.pv.size()) == 2*c.moves-1 && mates(pos, r.pv))
+        }
+        solver.clear();
+        CHECK(!solver.solve(Position("k7/8/8/8/8/8/8/K6R w - - 0 1"), 2).found)
+    }
+
+    /**
+     * Time allocation of the clock, moves to go and fixed move times
+    */
+    void time_manager() {
+
+        using search::TimeManager;
+        TimeManager tm;
+        search::Limits limits;
+        tm.init(limits, WHITE, 0);
+        CHECK(!tm.enabled())
+        limits.infinite = true, limits.time[WHITE] = 60000;
+        tm.init(limits, WHITE, 0);
+        CHECK(!tm.enabled())
+
+        limits = search::Limits();
+        limits.movetime = 1000;
+        tm.init(limits, WHITE, 0);
+        CHECK(tm.optimum() == 1000 && tm.maximum() == 1000 && !tm.stop_iteration(5, false, 0))
+
+        // 50 moves to go at the start, the overhead reserve of every one of them
+        limits = search::Limits();
+        limits.time[WHITE] = 60000;
+        tm.init(limits, WHITE, 0);
+        CHECK(tm.optimum() == (60000 - 50*TimeManager::MOVE_OVERHEAD)/50 && tm.maximum() == 5*tm.optimum())
+        tm.init(limits, BLACK, 0);
+        CHECK(!tm.enabled())
+
+        // the last move before the control keeps a fifth of the clock
+        limits.movestogo = 1;
+        tm.init(limits, WHITE, 0);
+        CHECK(tm.maximum() == 60000*4/5 - TimeManager::MOVE_OVERHEAD && tm.optimum() == tm.maximum())
+
+        // later in the game and with an increment more time per move, never the whole clock
+        for (int64_t time: {50, 1000, 10000, 60000, 600000})
+            for (int64_t inc: {0, 100, 2000})
+                for (int movestogo: {0, 1, 10, 40})
+                    for (int ply: {0, 40, 200}) {
+                        limits = search::Limits();
+                        limits.time[WHITE] = time, limits.inc[WHITE] = inc, limits.movestogo = movestogo;
+                        tm.init(limits, WHITE, ply);
+                        CHECK(tm.optimum() >= 1 && tm.optimum() <= tm.maximum() && tm.maximum() <= std::max<int64_t>(1, time*4/5))
+                    }
+        limits = search::Limits();
+        limits.time[WHITE] = 60000;
+        tm.init(limits, WHITE, 0);
+        int64_t opening = tm.optimum();
+        tm.init(limits, WHITE, 120);
+        CHECK(tm.optimum() > opening)
+        limits.inc[WHITE] = 1000;
+        tm.init(limits, WHITE, 0);
+        CHECK(tm.optimum() > opening)
+    }
+
+    /**
+     * Elo from the game results, the pentanomial LLR against the SPRT bounds
+    */
+    void sprt() {
+
+        match::Config config;
+        match::Stats s;
+        s.wins = 60, s.draws = 20, s.losses = 20;
+        match::update_estimates(s, config);
+        CHECK(std::abs(s.elo - 147.19) < 0.01 && s.elo_error > 0)
+        CHECK(std::abs(s.lower - std::log(0.05/0.95)) < 1e-9 && std::abs(s.upper + s.lower) < 1e-9)
+        CHECK(s.llr == 0)
+
+        match::Stats even;
+        even.wins = even.losses = 40, even.draws = 20;
+        match::update_estimates(even, config);
+        CHECK(std::abs(even.elo) < 1e-9)
+        std::swap(s.wins, s.losses);
+        match::update_estimates(s, config);
+        CHECK(std::abs(s.elo + 147.19) < 0.01)
+
+        // pairs scoring 2 points accept H1, 0 points H0, a draw in every pair leans to H0 between elo0 0 and elo1 5
+        match::Stats pairs;
+        pairs.wins = 200, pairs.draws = 0, pairs.losses = 0, pairs.pairs[4] = 100;
+        match::update_estimates(pairs, config);
+        CHECK(pairs.decided() && pairs.llr >= pairs.upper)
+        std::swap(pairs.wins, pairs.losses), std::swap(pairs.pairs[0], pairs.pairs[4]);
+        match::update_estimates(pairs, config);
+        CHECK(pairs.decided() && pairs.llr <= pairs.lower)
+        pairs = match::Stats();
+        pairs.draws = 20, pairs.pairs[2] = 10;
+        match::update_estimates(pairs, config);
+        CHECK(pairs.llr < 0 && !pairs.decided())
+    }
+
+    /**
+     * Formatting and ordering of the asynchronous log, stdout goes to a file meanwhile
+    */
+    void logger_output() {
+
+        CHECK(logger::parse_level("debug") == logger::LEVEL_DEBUG)
+        bool thrown = false;
+        try { logger::parse_level("verbose"); }
+        catch (std::invalid_argument&) { thrown = true; }
+        CHECK(thrown)
+
+        std::filesystem::path dir = scratch_dir("log");
+        std::string path = (dir/"stdout.txt").string();
+        std::fflush(stdout);
+        int saved = dup(STDOUT_FILENO), file = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(file, STDOUT_FILENO);
+        close(file);
+
+        constexpr int THREADS = 4, LINES = 200;
+        logger::set_level(logger::LEVEL_INFO);
+        std::vector<std::thread> threads;
+        for (int t=0; t<THREADS; ++t)
+            threads.emplace_back([t] {
+                for (int i=0; i<LINES; ++i) {
+                    // the string dies right after the call
+                    LOGI("log test %d %d %s %.2f %x %c %% %s", t, i, std::string("copied").c_str(), 1.5, 255u, 'z', static_cast<const char*>(nullptr))
+                    LOGD("log test debug %d", i)
+                }
+            });
+        for (std::thread& t: threads) t.join();
+
+        // the writer thread gets a few seconds to catch up
+        std::vector<std::string> lines;
+        for (int wait=0; wait<500 && static_cast<int>(lines.size()) < THREADS*LINES; ++wait) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            lines.clear();
+            std::ifstream in(path);
+            for (std::string line; std::getline(in, line); ) if (line.find("log test") != std::string::npos) lines.push_back(line);
+        }
+        std::fflush(stdout);
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+
+        CHECK(static_cast<int>(lines.size()) == THREADS*LINES)
+        int next[THREADS] = {};
+        for (const std::string& line: lines) {
+            int t = -1, i = -1;
+            char rest[64] = {};
+            const char* text = std::strstr(line.c_str(), "log test ");
+            CHECK(text && std::sscanf(text, "log test %d %d %63[^\n]", &t, &i, rest) == 3)
+            CHECK(t >= 0 && t < THREADS && std::string(rest) == "copied 1.50 ff z % (null)")
+            if (t >= 0 && t < THREADS) CHECK(i == next[t]++)
+        }
+        std::filesystem::remove_all(dir);
+    }
+
+    struct Test {
+        const char* name;
+        void (*run)();
+    };
+
+    constexpr Test TESTS[] = {
+        {"perft", perft},
+        {"polyglot", polyglot},
+        {"nnue_simd", nnue_simd},
+        {"tbgen", tbgen},
+        {"syzygy", syzygy},
+        {"archive", archive},
+        {"packed_position", packed_position},
+        {"san_pgn", san_pgn},
+        {"explorer", explorer_build},
+        {"see_movepick", see_movepick},
+        {"mate", mate_solver},
+        {"time_manager", time_manager},
+        {"sprt", sprt},
+        {"logger", logger_output},
+    };
+}
+
+int main(int argc, char*argv[]) {
+
+    bool found = false;
+    for (const Test& test: TESTS) {
+        if (argc > 1 && std::strcmp(argv[1], test.name) != 0) continue;
+        found = true;
+        int before = failures;
+        try { test.run(); }
+        catch (std::exception& e) {
+            ++failures;
+            std::fprintf(stderr, "%s: %s\n", test.name, e.what());
+        }
+        std::printf("%s: %s\n", test.name, failures == before? "ok": "FAILED");
+    }
+    if (!found) {
+        std::fprintf(stderr, "Unknown test %s\n", argv[1]);
+        return 1;
+    }
+    return failures? 1: 0;
+}
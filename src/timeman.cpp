@@ -0,0 +1,48 @@
+#include "timeman.h"
+#include <algorithm>
+
+namespace search {
+
+    void TimeManager::init(const Limits& limits, engine::Color us, int game_ply) {
+
+        start = std::chrono::steady_clock::now();
+        optimum_ms = maximum_ms = 0;
+        instability = 0;
+        previous_score = 0;
+        fixed = false;
+        if (limits.infinite) return;
+
+        if (limits.movetime) {
+            optimum_ms = maximum_ms = limits.movetime;
+            fixed = true;
+            return;
+        }
+
+        int64_t time = limits.time[us], inc = limits.inc[us];
+        if (!time) return;
+
+        // moves left to the control, without one an estimate shrinking as the game goes on
+        int moves = limits.movestogo? std::min(limits.movestogo, 50): std::max(20, 50 - game_ply/4);
+        // on a short clock the overhead reserve takes at most half of it
+        int64_t left = std::max<int64_t>(1, time + inc*(moves-1) - std::min(MOVE_OVERHEAD*moves, time/2));
+        maximum_ms = std::max<int64_t>(1, std::min(5*left/moves, time*4/5 - MOVE_OVERHEAD));
+        optimum_ms = std::clamp<int64_t>(left/moves, 1, maximum_ms);
+    }
+
+    bool TimeManager::stop_iteration(int depth, bool best_changed, int score) {
+
+        if (!enabled()) return false;
+        // movetime is spent in full, the hard limit in the search ends it
+        if (fixed) return false;
+
+        // a stable best move ends the search early, changes and falling scores prolong it
+        instability = instability/2 + (best_changed? 1: 0);
+        double scale = 0.75 + 0.6*instability;
+        if (depth > 1 && score < previous_score) scale *= 1 + std::min(previous_score-score, 200)/200.0;
+        previous_score = score;
+
+        // the next iteration takes about as long as all before it
+        int64_t soft = std::min<int64_t>(maximum_ms, static_cast<int64_t>(optimum_ms*scale));
+        return elapsed() > soft/2;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include "bitboard.h"
+
+namespace search {
+
+    constexpr int MAX_PLY = 128;
+
+    struct Limits {
+        int depth = MAX_PLY-1;
+        uint64_t nodes = 0;         // 0 - unlimited
+        int64_t movetime = 0;       // ms, 0 - unlimited
+        int64_t time[engine::COLOR_NB] {};      // ms left on the clock, 0 - no clock
+        int64_t inc[engine::COLOR_NB] {};       // ms added after every move
+        int movestogo = 0;          // moves to the next time control, 0 - the rest of the game
+        int multipv = 1;            // best lines reported
+        bool infinite = false;
+        bool ponder = false;        // the expected reply is on the board, time counts after ponderhit, see Searcher::prepare
+    };
+
+    /**
+     * Turns the clock into a soft limit, checked between iterations, and a hard limit the search never passes.
+     * The soft limit grows while the best move changes or the score falls
+    */
+    class TimeManager {
+    private:
+        std::chrono::steady_clock::time_point start;
+        int64_t optimum_ms = 0, maximum_ms = 0;
+        double instability = 0;     // best move changes, halved every iteration
+        int previous_score = 0;
+        bool fixed = false;         // movetime, no scaling
+    public:
+        static constexpr int64_t MOVE_OVERHEAD = 30;     // ms lost to the protocol and the network per move
+
+        void init(const Limits& limits, engine::Color us, int game_ply);
+
+        /**
+         * Called after every completed iteration, true when another one would most likely not finish in time
+        */
+        bool stop_iteration(int depth, bool best_changed, int score);
+
+        bool enabled() const { return maximum_ms > 0; }
+        int64_t optimum() const { return optimum_ms; }
+        int64_t maximum() const { return maximum_ms; }
+        int64_t elapsed() const {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-start).count();
+        }
+    };
+}
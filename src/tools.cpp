@@ -0,0 +1,330 @@
+#include "tools.h"
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "archive.h"
+#include "batch.h"
+#include "bench.h"
+#include "book.h"
+#include "datagen.h"
+#include "eval.h"
+#include "explorer.h"
+#include "mate.h"
+#include "match.h"
+#include "nnue.h"
+#include "notation.h"
+#include "pgn.h"
+#include "search.h"
+#include "suite.h"
+#include "tb.h"
+#include "tbgen.h"
+#include "tune.h"
+
+namespace tools {
+
+    namespace {
+
+        namespace po=boost::program_options;
+        unsigned int threads = 0;
+
+        void pgn_bench(const std::string& path) {
+
+            pgn::Reader reader(path);
+            pgn::Stats stats = reader.read(nullptr, threads);
+            std::cout<<"Games:   "<<stats.games<<" ("<<stats.errors<<" with errors)\n"
+                     <<"Moves:   "<<stats.moves<<'\n'
+                     <<"Time:    "<<stats.seconds<<"s\n"
+                     <<"Games/s: "<<static_cast<uint64_t>(stats.games/stats.seconds)<<'\n'
+                     <<"Moves/s: "<<static_cast<uint64_t>(stats.moves/stats.seconds)<<'\n'
+                     <<"MB/s:    "<<stats.bytes/stats.seconds/(1<<20)<<'\n';
+        }
+
+        void mate_search(const std::string& fen, int moves) {
+
+            engine::Position pos(fen);
+            mate::Solver solver;
+            mate::Result r = solver.solve(pos, moves);
+            if (r.found) {
+                std::cout<<"Mate in "<<r.moves<<':';
+                for (engine::Move m: r.pv) {
+                    std::cout<<' '<<engine::to_san(pos, m);
+                    pos.do_move(m);
+                }
+                std::cout<<'\n';
+            }
+            else std::cout<<"No mate in "<<moves<<'\n';
+            std::cout<<"Nodes: "<<r.nodes<<'\n'
+                     <<"Time:  "<<r.seconds<<"s\n";
+        }
+
+        void analyse(const std::string& fen, int lines, int depth) {
+
+            engine::Position pos(fen);
+            search::TranspositionTable tt(64);
+            auto searcher = std::make_unique<search::Searcher>(tt);
+            search::Limits limits;
+            limits.depth = depth;
+            limits.multipv = lines;
+
+            searcher->think(pos, limits, [&pos] (const search::Info& info) {
+
+                int mate = (search::VALUE_MATE - std::abs(info.score) + 1)/2;
+                std::ostringstream score;
+                if (search::is_mate_score(info.score)) score<<(info.score > 0? "#": "#-")<<mate;
+                else score<<std::showpos<<std::fixed<<std::setprecision(2)<<info.score/100.0;
+
+                engine::Position line = pos;
+                std::cout<<std::setw(2)<<info.depth<<' '<<std::setw(2)<<info.multipv<<". "<<std::setw(6)<<score.str()<<' ';
+                for (engine::Move m: info.pv) {
+                    std::cout<<' '<<engine::to_san(line, m);
+                    line.do_move(m);
+                }
+                std::cout<<"  ("<<info.nodes<<" nodes, "<<info.time<<" ms)\n";
+            });
+        }
+
+        void play_match(const std::vector<std::string>& engines, const po::variables_map& vm) {
+
+            if (engines.size() != 2) throw std::invalid_argument("--match needs two engines");
+            match::Config config;
+            config.engines[0] = engines[0], config.engines[1] = engines[1];
+            config.games = vm["games"].as<int>();
+            config.threads = threads;
+            if (vm.count("openings")) config.openings = vm["openings"].as<std::string>();
+
+            std::string tc = vm["tc"].as<std::string>(), sprt = vm["sprt"].as<std::string>();
+            size_t plus = tc.find('+'), comma = sprt.find(',');
+            config.time = static_cast<int64_t>(std::stod(tc.substr(0, plus))*1000);
+            config.increment = plus == std::string::npos? 0: static_cast<int64_t>(std::stod(tc.substr(plus+1))*1000);
+            if (comma == std::string::npos) throw std::invalid_argument("--sprt needs \"elo0,elo1\"");
+            config.elo0 = std::stod(sprt.substr(0, comma)), config.elo1 = std::stod(sprt.substr(comma+1));
+
+            auto print = [] (const match::Stats& s) {
+                std::cout<<"Games "<<s.games()<<": +"<<s.wins<<" ="<<s.draws<<" -"<<s.losses
+                         <<std::fixed<<std::setprecision(1)<<", Elo "<<s.elo<<" +/- "<<s.elo_error
+                         <<std::setprecision(2)<<", LLR "<<s.llr<<" ["<<s.lower<<", "<<s.upper<<"]";
+            };
+            match::Stats stats = match::run(config, [&print] (const match::Stats& s) {
+                print(s);
+                std::cout<<'\r'<<std::flush;
+            });
+            print(stats);
+            std::cout<<"\nPairs "<<stats.pairs[0]<<' '<<stats.pairs[1]<<' '<<stats.pairs[2]<<' '<<stats.pairs[3]<<' '<<stats.pairs[4]
+                     <<", adjudicated "<<stats.adjudicated<<", time losses "<<stats.time_losses<<", "<<stats.seconds<<"s\n";
+            if (stats.decided()) std::cout<<(stats.llr >= stats.upper? "H1 accepted": "H0 accepted")<<'\n';
+        }
+
+        void generate_data(const std::string& path, const po::variables_map& vm) {
+
+            datagen::Config config;
+            config.output = path;
+            config.games = vm["games"].as<int>();
+            config.threads = threads;
+            config.depth = vm["datagen-depth"].as<int>();
+            config.nodes = vm["datagen-nodes"].as<uint64_t>();
+
+            auto print = [] (const datagen::Stats& s) {
+                std::cout<<"Games "<<s.games<<" (+"<<s.white_wins<<" ="<<s.draws<<" -"<<s.black_wins<<"), positions "<<s.positions
+                         <<", "<<std::fixed<<std::setprecision(0)<<s.positions/std::max(s.seconds, 1e-3)<<" positions/s";
+            };
+            datagen::Stats stats = datagen::generate(config, [&print] (const datagen::Stats& s) {
+                print(s);
+                std::cout<<'\r'<<std::flush;
+            });
+            print(stats);
+            std::cout<<'\n';
+        }
+
+        void tune_eval(const std::string& data, const std::string& output, const po::variables_map& vm) {
+
+            tune::Config config;
+            config.data = data;
+            config.positions = vm["tune-positions"].as<size_t>();
+            config.epochs = vm["tune-epochs"].as<int>();
+            config.lambda = vm["tune-lambda"].as<double>();
+            config.threads = threads;
+
+            tune::Result result = tune::run(config, [] (int epoch, double error) {
+                if (epoch % 10 == 0) std::cout<<"Epoch "<<epoch<<", error "<<std::setprecision(8)<<error<<'\r'<<std::flush;
+            });
+            eval::save_params(output, result.params);
+            std::cout<<"\n"<<result.positions<<" positions, K "<<std::setprecision(4)<<result.k<<", error "<<std::setprecision(8)
+                     <<result.initial_error<<" -> "<<result.error<<", "<<std::setprecision(4)<<result.seconds<<"s, weights written to "<<output<<'\n';
+        }
+
+        void analyse_batch(const std::string& input, const po::variables_map& vm) {
+
+            batch::Config config;
+            config.input = input;
+            config.output = vm["batch-output"].as<std::string>();
+            config.format = config.output.ends_with(".jsonl")? batch::JSON_LINES: batch::ANNOTATED;
+            config.nodes = vm["batch-nodes"].as<uint64_t>();
+            config.movetime = vm["batch-movetime"].as<int64_t>();
+            config.threads = threads;
+
+            auto print = [] (const batch::Stats& s) {
+                std::cout<<"Games "<<s.games<<", positions "<<s.positions<<", "<<std::fixed<<std::setprecision(1)
+                         <<s.positions/std::max(s.seconds, 1e-3)<<" positions/s, "<<std::setprecision(0)<<s.nodes/std::max(s.seconds, 1e-3)<<" nps";
+            };
+            batch::Stats stats = batch::run(config, [&print] (const batch::Stats& s) {
+                print(s);
+                std::cout<<'\r'<<std::flush;
+            });
+            print(stats);
+            std::cout<<", "<<stats.errors<<" skipped, "<<std::setprecision(1)<<stats.seconds<<"s\n";
+        }
+
+        void run_suite(const std::string& path, const po::variables_map& vm) {
+
+            suite::Config config;
+            config.path = path;
+            config.nodes = vm["suite-nodes"].as<uint64_t>();
+            config.movetime = vm["suite-movetime"].as<int64_t>();
+            config.threads = threads;
+
+            int solved = 0;
+            suite::Result result = suite::run(config, [&solved] (const suite::Test& test, int done, int total) {
+                solved += test.solved;
+                std::cout<<done<<'/'<<total<<", solved "<<solved<<'\r'<<std::flush;
+            });
+            for (const suite::Test& t: result.tests) {
+                std::cout<<std::left<<std::setw(16)<<t.id<<std::right<<(t.solved? " solved ": " failed ")<<std::setw(8)<<t.found
+                         <<"  "<<std::setw(24)<<std::left<<t.expected<<std::right<<" depth "<<std::setw(2)<<t.depth;
+                if (t.solved) std::cout<<", found at depth "<<t.solve_depth<<", "<<t.solve_nodes<<" nodes, "<<t.solve_time<<" ms";
+                std::cout<<'\n';
+            }
+            std::cout<<"Solved "<<result.solved<<" of "<<result.tests.size()<<", skipped "<<result.skipped<<", nodes "<<result.nodes
+                     <<", nodes to solution "<<result.solve_nodes<<", "<<std::fixed<<std::setprecision(1)<<result.seconds<<"s\n";
+        }
+    }
+
+    void add_options(po::options_description& options) {
+
+        options.add_options()
+            ("threads", po::value<unsigned int>(&threads), "worker threads for batch tools, default all cores")
+            ("bench", po::value<int>()->implicit_value(bench::DEFAULT_DEPTH), "search the built in positions to a fixed depth, print the node count and nodes/s")
+            ("pgn-bench", po::value<std::string>(), "replay every game of a PGN file, report games/s and moves/s")
+            ("archive", po::value<std::string>(), "game archive, the server appends every game played")
+            ("import", po::value<std::string>(), "convert a PGN file into the archive set by --archive")
+            ("explorer", po::value<std::string>(), "opening explorer table, shows played moves during the game")
+            ("explorer-build", po::value<std::string>(), "aggregate a PGN file into the table set by --explorer")
+            ("book", po::value<std::string>(), "polyglot opening book used by the engine")
+            ("book-build", po::value<std::string>(), "create the book set by --book from a PGN file")
+            ("tb", po::value<std::string>(), "directory with endgame tablebases used by the engine, Syzygy .rtbw/.rtbz first, the .ctb files of --tb-generate as the fallback")
+            ("tb-generate", po::value<std::string>(), "build tablebases into the --tb directory, e.g. \"KQvK,KRPvKR\"")
+            ("nnue", po::value<std::string>(), "network weights (.nnue) replacing the built in evaluation")
+            ("match", po::value<std::vector<std::string>>()->multitoken(), "play two UCI engines \"<command>[|Option=value...]\" against each other, self - this program")
+            ("games", po::value<int>()->default_value(1000), "games of --match and --datagen, --match openings are played with both colors")
+            ("tc", po::value<std::string>()->default_value("10+0.1"), "time control of --match, \"<seconds>+<increment seconds>\"")
+            ("openings", po::value<std::string>(), "EPD or PGN file with the --match openings")
+            ("sprt", po::value<std::string>()->default_value("0,5"), "\"elo0,elo1\" of the --match SPRT for the first engine")
+            ("datagen", po::value<std::string>(), "append quiet positions of self-play games with scores and results to a training data file")
+            ("datagen-depth", po::value<int>()->default_value(8), "search depth per move of --datagen")
+            ("datagen-nodes", po::value<uint64_t>()->default_value(0), "nodes per move of --datagen instead of the depth")
+            ("tune", po::value<std::string>(), "tune the classical evaluation on a --datagen file, the weights go to --eval-params")
+            ("tune-positions", po::value<size_t>()->default_value(0), "positions of the --tune data used, 0 - all")
+            ("tune-epochs", po::value<int>()->default_value(1000), "gradient steps of --tune")
+            ("tune-lambda", po::value<double>()->default_value(1.0), "weight of game results against search scores in --tune")
+            ("eval-params", po::value<std::string>(), "classical evaluation weights file, written by --tune")
+            ("batch", po::value<std::string>(), "analyse every position of a PGN or EPD file into --batch-output")
+            ("batch-output", po::value<std::string>()->default_value("analysis.pgn"), "annotated PGN or EPD, JSON lines when it ends with .jsonl")
+            ("batch-nodes", po::value<uint64_t>()->default_value(1000000), "nodes per position of --batch, 0 - no limit")
+            ("batch-movetime", po::value<int64_t>()->default_value(0), "ms per position of --batch, 0 - no limit")
+            ("suite", po::value<std::string>(), "run an EPD test suite with bm/am operations, report solved positions")
+            ("suite-nodes", po::value<uint64_t>()->default_value(1000000), "nodes per --suite position, reproducible on any machine")
+            ("suite-movetime", po::value<int64_t>()->default_value(0), "ms per --suite position, 0 - no limit")
+            ("analyse", po::value<std::string>(), "print the best lines of a position \"<FEN>\" at every depth")
+            ("multipv", po::value<int>()->default_value(3), "lines shown by --analyse")
+            ("depth", po::value<int>()->default_value(12), "search depth of --analyse")
+            ("mate", po::value<std::string>(), "find the shortest forced mate in a position \"<FEN>\"")
+            ("mate-moves", po::value<int>()->default_value(5), "longest mate in moves searched by --mate");
+    }
+
+    void load(const po::variables_map& vm) {
+
+        if (vm.count("tb") && !vm.count("tb-generate")) tb::init(vm["tb"].as<std::string>());
+        if (vm.count("nnue")) nnue::load(vm["nnue"].as<std::string>());
+        if (vm.count("eval-params") && !vm.count("tune")) eval::load_params(vm["eval-params"].as<std::string>());
+    }
+
+    bool run(const po::variables_map& vm) {
+
+        if (vm.count("bench")) {
+
+            bench::Result result = bench::run(vm["bench"].as<int>(), [] (int index, int total, const std::string& fen, uint64_t nodes) {
+                std::cerr<<"Position "<<index<<'/'<<total<<": "<<fen<<", "<<nodes<<" nodes\n";
+            });
+            std::cout<<"Total time (ms) : "<<static_cast<int64_t>(result.seconds*1000)<<"\nNodes searched  : "<<result.nodes
+                     <<"\nNodes/second    : "<<result.nps()<<'\n';
+        }
+        else if (vm.count("pgn-bench")) {
+
+            pgn_bench(vm["pgn-bench"].as<std::string>());
+        }
+        else if (vm.count("match")) {
+
+            play_match(vm["match"].as<std::vector<std::string>>(), vm);
+        }
+        else if (vm.count("datagen")) {
+
+            generate_data(vm["datagen"].as<std::string>(), vm);
+        }
+        else if (vm.count("tune")) {
+
+            if (!vm.count("eval-params")) throw std::invalid_argument("--tune needs --eval-params");
+            tune_eval(vm["tune"].as<std::string>(), vm["eval-params"].as<std::string>(), vm);
+        }
+        else if (vm.count("batch")) {
+
+            analyse_batch(vm["batch"].as<std::string>(), vm);
+        }
+        else if (vm.count("suite")) {
+
+            run_suite(vm["suite"].as<std::string>(), vm);
+        }
+        else if (vm.count("analyse")) {
+
+            analyse(vm["analyse"].as<std::string>(), vm["multipv"].as<int>(), vm["depth"].as<int>());
+        }
+        else if (vm.count("mate")) {
+
+            mate_search(vm["mate"].as<std::string>(), vm["mate-moves"].as<int>());
+        }
+        else if (vm.count("import")) {
+
+            if (!vm.count("archive")) throw std::invalid_argument("--import needs --archive");
+            pgn::Stats stats = archive::import(vm["import"].as<std::string>(), vm["archive"].as<std::string>(), threads);
+            std::cout<<"Imported "<<stats.games-stats.errors<<" of "<<stats.games<<" games in "<<stats.seconds<<"s\n";
+        }
+        else if (vm.count("explorer-build")) {
+
+            if (!vm.count("explorer")) throw std::invalid_argument("--explorer-build needs --explorer");
+            pgn::Stats stats = explorer::build(vm["explorer-build"].as<std::string>(), vm["explorer"].as<std::string>(), threads);
+            std::cout<<"Aggregated "<<stats.games<<" games in "<<stats.seconds<<"s\n";
+        }
+        else if (vm.count("book-build")) {
+
+            if (!vm.count("book")) throw std::invalid_argument("--book-build needs --book");
+            pgn::Stats stats = book::build(vm["book-build"].as<std::string>(), vm["book"].as<std::string>(), threads);
+            std::cout<<"Book built from "<<stats.games<<" games in "<<stats.seconds<<"s\n";
+        }
+        else if (vm.count("tb-generate")) {
+
+            if (!vm.count("tb")) throw std::invalid_argument("--tb-generate needs --tb");
+            std::string names = vm["tb-generate"].as<std::string>();
+            for (size_t begin = 0, end; begin < names.size(); begin = end+1) {
+                end = std::min(names.find(',', begin), names.size());
+                for (const tb::GenStats& s: tb::generate(names.substr(begin, end-begin), vm["tb"].as<std::string>(), threads))
+                    std::cout<<s.name<<": "<<s.positions<<" positions, side to move wins "<<s.wins<<", draws "
+                             <<s.draws<<", loses "<<s.losses<<", longest mate "<<(s.longest+1)/2<<" moves, "
+                             <<s.passes<<" passes, "<<s.errors<<" errors, "<<s.seconds<<"s\n";
+            }
+        }
+        else return false;
+        return true;
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <boost/program_options.hpp>
+
+/**
+ * Command line of the engine and the batch tools, shared by the GUI program and chess-engine:
+ * engine files (book, tablebases, network, weights) and one tool per run - bench, match, datagen, tune,
+ * batch, suite, analyse, mate, import and the book, explorer and tablebase builders
+*/
+namespace tools {
+
+    void add_options(boost::program_options::options_description& options);
+
+    /**
+     * Loads the tablebases, the network and the evaluation weights named by the options into the engine
+    */
+    void load(const boost::program_options::variables_map& vm);
+
+    /**
+     * Runs the tool selected by the options, false when there is none.
+     * Throws std::invalid_argument when an option the tool needs is missing
+    */
+    bool run(const boost::program_options::variables_map& vm);
+}
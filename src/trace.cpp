@@ -0,0 +1,141 @@
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace trace {
+
+    namespace {
+
+        constexpr size_t CAPACITY = 1<<16;      // spans per thread
+
+        struct Event {
+            const char* category;
+            const char* name;
+            int64_t begin;                      // ns from start()
+            int64_t duration;
+        };
+
+        /**
+         * Written by its thread only, count publishes the events to stop()
+        */
+        struct Buffer {
+            std::unique_ptr<Event[]> events {new Event[CAPACITY]};
+            std::atomic<size_t> count {0};
+            std::atomic<uint64_t> dropped {0};
+            std::atomic<const char*> name {nullptr};
+            unsigned int tid = 0;
+        };
+
+        std::atomic<bool> recording {false};
+        std::chrono::steady_clock::time_point origin;
+        std::string output;
+        std::mutex mutex;
+        std::vector<std::shared_ptr<Buffer>> buffers;
+
+        int64_t now() {
+
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-origin).count();
+        }
+
+        Buffer& buffer() {
+
+            thread_local std::shared_ptr<Buffer> local = [] {
+                auto b = std::make_shared<Buffer>();
+                std::lock_guard<std::mutex> lock(mutex);
+                b->tid = static_cast<unsigned int>(buffers.size()+1);
+                buffers.push_back(b);
+                return b;
+            }();
+            return *local;
+        }
+
+        // names are literals of this program, only quotes and backslashes need escapes
+        void write_string(std::ostream& out, const char* s) {
+
+            out<<'"';
+            for (; *s; ++s) {
+                if (*s == '"' || *s == '\\') out<<'\\';
+                out<<*s;
+            }
+            out<<'"';
+        }
+    }
+
+    void start(const std::string& path) {
+
+#ifndef CHESS_TRACE
+        throw std::runtime_error("Tracing is not built in, configure with -DCHESS_TRACE=ON");
+#endif
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const std::shared_ptr<Buffer>& b: buffers) b->count = 0, b->dropped = 0;
+        output = path;
+        origin = std::chrono::steady_clock::now();
+        recording = true;
+    }
+
+    void stop() {
+
+        if (!recording.exchange(false)) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ofstream out(output);
+        if (!out) throw std::runtime_error("Can not open " + output);
+
+        uint64_t dropped = 0;
+        bool first = true;
+        out<<"{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+        for (const std::shared_ptr<Buffer>& b: buffers) {
+
+            if (const char* name = b->name.load()) {
+                out<<(first? "": ",")<<"\n{\"ph\": \"M\", \"pid\": 1, \"tid\": "<<b->tid<<", \"name\": \"thread_name\", \"args\": {\"name\": ";
+                write_string(out, name);
+                out<<"}}";
+                first = false;
+            }
+            size_t count = std::min(b->count.load(std::memory_order_acquire), CAPACITY);
+            for (size_t i=0; i<count; ++i) {
+                const Event& e = b->events[i];
+                out<<(first? "": ",")<<"\n{\"ph\": \"X\", \"pid\": 1, \"tid\": "<<b->tid<<", \"cat\": ";
+                write_string(out, e.category);
+                out<<", \"name\": ";
+                write_string(out, e.name);
+                // microseconds
+                out<<", \"ts\": "<<e.begin/1000<<'.'<<std::to_string(1000 + e.begin%1000).substr(1)
+                   <<", \"dur\": "<<e.duration/1000<<'.'<<std::to_string(1000 + e.duration%1000).substr(1)<<'}';
+                first = false;
+            }
+            dropped += b->dropped.load();
+        }
+        out<<"\n], \"otherData\": {\"dropped\": "<<dropped<<"}}\n";
+    }
+
+    void thread_name([[maybe_unused]] const char* name) {
+
+#ifdef CHESS_TRACE
+        buffer().name = name;
+#endif
+    }
+
+    Span::Span(const char* category, const char* name): category {category}, name {nullptr}, begin {0} {
+
+        if (!recording.load(std::memory_order_acquire)) return;
+        this->name = name;
+        begin = now();
+    }
+
+    Span::~Span() {
+
+        if (!name || !recording.load(std::memory_order_relaxed)) return;
+        int64_t end = now();
+        Buffer& b = buffer();
+        size_t i = b.count.load(std::memory_order_relaxed);
+        if (i >= CAPACITY) { b.dropped.fetch_add(1, std::memory_order_relaxed); return; }
+        b.events[i] = {category, name, begin, end-begin};
+        b.count.store(i+1, std::memory_order_release);
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+/**
+ * Scoped spans in the Chrome trace event format, chrome://tracing and Perfetto load the file.
+ * TRACE_SCOPE compiles to nothing unless the build has CHESS_TRACE (cmake -DCHESS_TRACE=ON).
+ * Recording runs between start() and stop(), a span goes to a fixed buffer of its thread without locks,
+ * spans beyond the buffer are dropped and counted
+*/
+namespace trace {
+
+    /**
+     * Throws std::runtime_error when the build has no tracing
+    */
+    void start(const std::string& path);
+
+    /**
+     * Writes the recorded spans to the path of start(), does nothing when not recording
+    */
+    void stop();
+
+    /**
+     * Name of the calling thread in the trace, a string literal
+    */
+    void thread_name(const char* name);
+
+    class Span {
+    private:
+        const char* category;
+        const char* name;
+        int64_t begin;
+
+    public:
+        Span(const char* category, const char* name);
+        ~Span();
+        Span(const Span&) = delete;
+        Span& operator = (const Span&) = delete;
+    };
+}
+
+#ifdef CHESS_TRACE
+    #define TRACE_JOIN2(a, b) a##b
+    #define TRACE_JOIN(a, b) TRACE_JOIN2(a, b)
+    #define TRACE_SCOPE(category, name) trace::Span TRACE_JOIN(trace_span_, __LINE__) (category, name);
+#else
+    #define TRACE_SCOPE(category, name)
+#endif
@@ -0,0 +1,93 @@
+#include "tt.h"
+#include <algorithm>
+
+namespace search {
+
+    namespace {
+
+        // move 16 | score 16 | eval 16 | depth 8 | bound 2 | generation 6
+        constexpr uint64_t pack(engine::Move move, int score, int eval, int depth, Bound bound, uint8_t generation) {
+
+            return static_cast<uint64_t>(move)
+                 | static_cast<uint64_t>(static_cast<uint16_t>(score)) << 16
+                 | static_cast<uint64_t>(static_cast<uint16_t>(eval)) << 32
+                 | static_cast<uint64_t>(static_cast<uint8_t>(depth)) << 48
+                 | static_cast<uint64_t>(bound) << 56
+                 | static_cast<uint64_t>(generation) << 58;
+        }
+
+        constexpr int depth_of(uint64_t data) { return static_cast<int8_t>(data >> 48); }
+        constexpr uint8_t generation_of(uint64_t data) { return data >> 58; }
+    }
+
+    void TranspositionTable::resize(size_t mb) {
+
+        clusters = std::max<size_t>(1, mb*1024*1024/sizeof(Cluster));
+        table = std::make_unique<Cluster[]>(clusters);
+        generation = 0;
+    }
+
+    void TranspositionTable::clear() {
+
+        for (size_t i=0; i<clusters; ++i)
+            for (Entry& e: table[i].entries) {
+                e.check.store(0, std::memory_order_relaxed);
+                e.data.store(0, std::memory_order_relaxed);
+            }
+        generation = 0;
+    }
+
+    bool TranspositionTable::probe(engine::Key key, TTData& out) const {
+
+        for (const Entry& e: cluster(key).entries) {
+
+            uint64_t data = e.data.load(std::memory_order_relaxed);
+            if ((e.check.load(std::memory_order_relaxed) ^ data) != key || !data) continue;
+
+            out.move  = engine::Move(data & 0xFFFF);
+            out.score = static_cast<int16_t>(data >> 16);
+            out.eval  = static_cast<int16_t>(data >> 32);
+            out.depth = depth_of(data);
+            out.bound = Bound((data >> 56) & 3);
+            return true;
+        }
+        return false;
+    }
+
+    void TranspositionTable::store(engine::Key key, engine::Move move, int score, int eval, int depth, Bound bound) {
+
+        Cluster& c = cluster(key);
+        Entry* replace = &c.entries[0];
+        int worst = INT32_MAX;
+
+        for (Entry& e: c.entries) {
+
+            uint64_t data = e.data.load(std::memory_order_relaxed);
+            if ((e.check.load(std::memory_order_relaxed) ^ data) == key) {
+                // keep the old move when storing a bound without one
+                if (move == engine::MOVE_NONE) move = engine::Move(data & 0xFFFF);
+                replace = &e;
+                break;
+            }
+            int age = (generation - generation_of(data)) & 63;
+            int value = data? depth_of(data) - 8*age: INT32_MIN;
+            if (value < worst) { worst = value; replace = &e; }
+        }
+
+        uint64_t data = pack(move, score, eval, depth, bound, generation);
+        replace->check.store(key ^ data, std::memory_order_relaxed);
+        replace->data.store(data, std::memory_order_relaxed);
+    }
+
+    int TranspositionTable::hashfull() const {
+
+        int used = 0;
+        size_t sample = std::min<size_t>(clusters, 250);
+        for (size_t i=0; i<sample; ++i)
+            for (const Entry& e: table[i].entries) {
+                uint64_t data = e.data.load(std::memory_order_relaxed);
+                used += data && generation_of(data) == generation;
+            }
+        return used*1000/(sample*4);
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "move.h"
+
+namespace search {
+
+    enum Bound : uint8_t { BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT };
+
+    struct TTData {
+        engine::Move move;
+        int score;
+        int eval;
+        int depth;
+        Bound bound;
+    };
+
+    /**
+     * Shared between search threads without locks: every entry stores key^data next to data,
+     * a torn write fails the key check and reads as a miss
+    */
+    class TranspositionTable {
+    private:
+        struct Entry {
+            std::atomic<uint64_t> check {0};
+            std::atomic<uint64_t> data {0};
+        };
+        struct alignas(64) Cluster {
+            Entry entries[4];
+        };
+
+        std::unique_ptr<Cluster[]> table;
+        size_t clusters = 0;
+        uint8_t generation = 0;
+
+        Cluster& cluster(engine::Key key) const {
+            return table[static_cast<size_t>((static_cast<unsigned __int128>(key) * clusters) >> 64)];
+        }
+    public:
+        explicit TranspositionTable(size_t mb = 16) { resize(mb); }
+
+        void resize(size_t mb);
+        void clear();
+        void new_search() { generation = (generation+1) & 63; }
+
+        bool probe(engine::Key key, TTData& out) const;
+        void store(engine::Key key, engine::Move move, int score, int eval, int depth, Bound bound);
+        void prefetch(engine::Key key) const { __builtin_prefetch(&cluster(key)); }
+
+        /**
+         * Per mille of sampled entries written during the current search
+        */
+        int hashfull() const;
+    };
+}
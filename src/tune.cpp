@@ -0,0 +1,194 @@
+#include "tune.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "datagen.h"
+#include "pgn.h"
+
+namespace tune {
+
+    using namespace engine;
+
+    namespace {
+
+        constexpr size_t LOAD_BATCH = 65536;
+        constexpr double LN10_400 = 2.302585092994046/400;
+        constexpr double BETA1 = 0.9, BETA2 = 0.999, EPSILON = 1e-8;
+
+        struct Feature {
+            uint16_t index;         // Score of Params
+            int16_t count;
+        };
+
+        /**
+         * Position reduced to its evaluation terms, white point of view. Features of the samples
+         * follow each other in one array
+        */
+        struct Sample {
+            int16_t score;
+            int8_t result;          // 1 white wins, 0 draw, -1 black wins
+            uint8_t phase;
+            uint8_t features;
+        };
+
+        struct Dataset {
+            std::vector<Sample> samples;
+            std::vector<Feature> features;
+            std::vector<size_t> first_sample, first_feature;    // slice of every thread, one extra at the end
+        };
+
+        template<typename F> void parallel(unsigned int threads, F&& work) {
+
+            std::vector<std::thread> pool;
+            for (unsigned int t=1; t<threads; ++t) pool.emplace_back(work, t);
+            work(0);
+            for (std::thread& t: pool) t.join();
+        }
+
+        Dataset load(const Config& config, unsigned int threads) {
+
+            Dataset d;
+            datagen::Reader reader(config.data, LOAD_BATCH, LOAD_BATCH);
+            size_t limit = config.positions? std::min(config.positions, reader.size()): reader.size();
+            d.samples.reserve(limit);
+
+            std::vector<datagen::PackedPosition> batch;
+            std::vector<std::vector<Sample>> samples(threads);
+            std::vector<std::vector<Feature>> features(threads);
+            while (d.samples.size() < limit && reader.next(batch)) {
+
+                batch.resize(std::min(batch.size(), limit - d.samples.size()));
+                parallel(threads, [&] (unsigned int t) {
+
+                    samples[t].clear();
+                    features[t].clear();
+                    for (size_t i = batch.size()*t/threads; i < batch.size()*(t+1)/threads; ++i) {
+
+                        const datagen::PackedPosition& p = batch[i];
+                        eval::Trace trace = eval::trace(p.position());
+                        int sign = p.side_to_move() == WHITE? 1: -1;
+                        size_t first = features[t].size();
+                        for (int s=0; s<eval::SCORE_COUNT; ++s)
+                            if (trace.count[s]) features[t].push_back({static_cast<uint16_t>(s), static_cast<int16_t>(trace.count[s])});
+                        size_t count = features[t].size() - first;
+                        if (count > UINT8_MAX) { features[t].resize(first); continue; }
+                        samples[t].push_back({static_cast<int16_t>(sign*p.score), static_cast<int8_t>(sign*p.result),
+                                              static_cast<uint8_t>(trace.phase), static_cast<uint8_t>(count)});
+                    }
+                });
+                for (unsigned int t=0; t<threads; ++t) {
+                    d.samples.insert(d.samples.end(), samples[t].begin(), samples[t].end());
+                    d.features.insert(d.features.end(), features[t].begin(), features[t].end());
+                }
+            }
+            if (d.samples.empty()) throw std::runtime_error("No positions in " + config.data);
+
+            size_t offset = 0, next = 0;
+            for (unsigned int t=0; t<=threads; ++t) {
+                size_t first = d.samples.size()*t/threads;
+                for (; next < first; ++next) offset += d.samples[next].features;
+                d.first_sample.push_back(first);
+                d.first_feature.push_back(offset);
+            }
+            return d;
+        }
+
+        /**
+         * Mean squared error of the weights, its gradient is added to grad when given
+        */
+        double evaluate(const Dataset& d, const double* weights, double k, double lambda, double* grad, unsigned int threads) {
+
+            std::vector<double> errors(threads);
+            std::vector<std::vector<double>> grads(grad? threads: 0, std::vector<double>(eval::PARAM_COUNT));
+            double scale = k*LN10_400;
+
+            parallel(threads, [&] (unsigned int t) {
+
+                double error = 0;
+                const Feature* f = d.features.data() + d.first_feature[t];
+                for (size_t i = d.first_sample[t]; i < d.first_sample[t+1]; ++i) {
+
+                    const Sample& s = d.samples[i];
+                    double mg = 0, eg = 0;
+                    for (int j=0; j<s.features; ++j) mg += f[j].count*weights[2*f[j].index], eg += f[j].count*weights[2*f[j].index+1];
+                    double mg_weight = s.phase/double(eval::PHASE_MAX), eg_weight = 1 - mg_weight;
+                    double predicted = 1/(1 + std::exp(-scale*(mg*mg_weight + eg*eg_weight)));
+                    double target = lambda*(s.result+1)/2 + (1-lambda)/(1 + std::exp(-scale*s.score));
+                    error += (predicted-target)*(predicted-target);
+
+                    if (grad) {
+                        double g = (predicted-target)*predicted*(1-predicted)*scale;
+                        double* out = grads[t].data();
+                        for (int j=0; j<s.features; ++j) {
+                            out[2*f[j].index] += g*f[j].count*mg_weight;
+                            out[2*f[j].index+1] += g*f[j].count*eg_weight;
+                        }
+                    }
+                    f += s.features;
+                }
+                errors[t] = error;
+            });
+
+            double n = static_cast<double>(d.samples.size()), error = 0;
+            for (unsigned int t=0; t<threads; ++t) {
+                error += errors[t];
+                if (grad) for (int i=0; i<eval::PARAM_COUNT; ++i) grad[i] += 2*grads[t][i]/n;
+            }
+            return error/n;
+        }
+
+        /**
+         * Sigmoid scale that fits the current weights best, golden section search
+        */
+        double fit_k(const Dataset& d, const double* weights, double lambda, unsigned int threads) {
+
+            constexpr double RATIO = 0.6180339887498949;
+            double a = 0.1, b = 4;
+            double c = b - RATIO*(b-a), e = a + RATIO*(b-a);
+            double fc = evaluate(d, weights, c, lambda, nullptr, threads), fe = evaluate(d, weights, e, lambda, nullptr, threads);
+            for (int i=0; i<40; ++i) {
+                if (fc < fe) b = e, e = c, fe = fc, c = b - RATIO*(b-a), fc = evaluate(d, weights, c, lambda, nullptr, threads);
+                else a = c, c = e, fc = fe, e = a + RATIO*(b-a), fe = evaluate(d, weights, e, lambda, nullptr, threads);
+            }
+            return (a+b)/2;
+        }
+    }
+
+    Result run(const Config& config, const on_progress& progress) {
+
+        auto start = std::chrono::steady_clock::now();
+        unsigned int threads = pgn::thread_count(config.threads);
+        Dataset d = load(config, threads);
+
+        Result result;
+        result.positions = d.samples.size();
+        const int* initial = reinterpret_cast<const int*>(&eval::params);
+        std::vector<double> weights(initial, initial + eval::PARAM_COUNT);
+        std::vector<double> grad(eval::PARAM_COUNT), m(eval::PARAM_COUNT), v(eval::PARAM_COUNT);
+
+        result.k = fit_k(d, weights.data(), config.lambda, threads);
+        result.initial_error = result.error = evaluate(d, weights.data(), result.k, config.lambda, nullptr, threads);
+
+        for (int epoch=1; epoch<=config.epochs; ++epoch) {
+
+            std::fill(grad.begin(), grad.end(), 0.0);
+            double error = evaluate(d, weights.data(), result.k, config.lambda, grad.data(), threads);
+            double correction1 = 1 - std::pow(BETA1, epoch), correction2 = 1 - std::pow(BETA2, epoch);
+            for (int i=0; i<eval::PARAM_COUNT; ++i) {
+                m[i] = BETA1*m[i] + (1-BETA1)*grad[i];
+                v[i] = BETA2*v[i] + (1-BETA2)*grad[i]*grad[i];
+                weights[i] -= config.learning_rate * (m[i]/correction1) / (std::sqrt(v[i]/correction2) + EPSILON);
+            }
+            if (progress) progress(epoch, error);
+        }
+
+        int* tuned = reinterpret_cast<int*>(&result.params);
+        for (int i=0; i<eval::PARAM_COUNT; ++i) weights[i] = tuned[i] = static_cast<int>(std::lround(weights[i]));
+        result.error = evaluate(d, weights.data(), result.k, config.lambda, nullptr, threads);
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        return result;
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "eval.h"
+
+/**
+ * Texel tuning of the classical evaluation weights on labelled positions from datagen
+*/
+namespace tune {
+
+    struct Config {
+        std::string data;                   // datagen training data file
+        size_t positions = 0;               // 0 - every position of the file
+        int epochs = 1000;
+        double learning_rate = 1.0;         // cp per step of Adam
+        double lambda = 1.0;                // weight of the game result against the search score in the target
+        unsigned int threads = 0;           // 0 - every hardware thread
+    };
+
+    struct Result {
+        eval::Params params;
+        double k = 1;                       // sigmoid scale fitted to the starting weights
+        double initial_error = 0, error = 0;
+        size_t positions = 0;
+        double seconds = 0;
+    };
+
+    using on_progress = std::function<void (int epoch, double error)>;
+
+    /**
+     * Minimizes the mean squared error between the sigmoid of the evaluation and the targets with Adam,
+     * starting from the weights in use. Throws std::runtime_error when the data can not be read
+    */
+    Result run(const Config& config, const on_progress& progress = nullptr);
+}
@@ -0,0 +1,282 @@
+#include "uci.h"
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "bench.h"
+#include "book.h"
+#include "eval.h"
+#include "mate.h"
+#include "movegen.h"
+#include "nnue.h"
+#include "notation.h"
+#include "search.h"
+#include "tb.h"
+#include "trace.h"
+
+namespace uci {
+
+    using namespace engine;
+
+    namespace {
+
+        std::mutex output;
+        search::TranspositionTable tt;
+        search::Searcher searcher(tt);
+        std::thread worker;
+        std::unique_ptr<book::Book> opening_book {nullptr};
+        std::unique_ptr<mate::Solver> mate_solver {nullptr};
+        int book_depth = 40;
+        int multipv = 1;
+        std::string stats_format = "off";        // off, text or json
+        Position pos;
+
+        void print(const std::string& line) {
+
+            std::lock_guard<std::mutex> lock(output);
+            std::cout<<line<<std::endl;
+        }
+
+        std::string score_to_uci(int score) {
+
+            if (!search::is_mate_score(score)) return "cp " + std::to_string(score);
+            int moves = score > 0? (search::VALUE_MATE-score+1)/2: -(search::VALUE_MATE+score)/2;
+            return "mate " + std::to_string(moves);
+        }
+
+        void print_info(const search::Info& info) {
+
+            std::ostringstream ss;
+            uint64_t nps = info.time? info.nodes*1000/info.time: info.nodes;
+            ss<<"info depth "<<info.depth<<" seldepth "<<info.seldepth<<" multipv "<<info.multipv<<" score "<<score_to_uci(info.score)
+              <<" nodes "<<info.nodes<<" nps "<<nps<<" time "<<info.time<<" hashfull "<<info.hashfull<<" tbhits "<<info.tb_hits<<" pv";
+            for (Move m: info.pv) ss<<' '<<to_uci(m);
+            print(ss.str());
+        }
+
+        void stop_search() {
+
+            searcher.stop();
+            if (mate_solver) mate_solver->stop();
+        }
+
+        void wait_search() {
+
+            if (worker.joinable()) worker.join();
+        }
+
+        void open_book(const std::string& path) {
+
+            opening_book.reset();
+            if (path.empty() || path == "<empty>") return;
+            try {
+                opening_book = std::make_unique<book::Book>(path, book_depth);
+            }
+            catch (std::exception& e) {
+                print(std::string("info string ") + e.what());
+            }
+        }
+
+        void apply_option(const std::string& name, const std::string& value) {
+
+            if (name == "Hash") tt.resize(std::stoul(value));
+            else if (name == "Clear Hash") tt.clear();
+            else if (name == "Book") open_book(value);
+            else if (name == "BookDepth") {
+                book_depth = std::stoi(value);
+                if (opening_book) opening_book->set_max_ply(book_depth);
+            }
+            else if (name == "TablebasePath") {
+                try { tb::init(value == "<empty>"? "": value); }
+                catch (std::exception& e) { print(std::string("info string ") + e.what()); }
+            }
+            else if (name == "EvalFile") {
+                try {
+                    if (value != "<empty>") nnue::load(value);
+                    print(std::string("info string NNUE ") + (nnue::loaded()? "evaluation, ": "not loaded, ") + nnue::simd_name());
+                }
+                catch (std::exception& e) { print(std::string("info string ") + e.what()); }
+            }
+            else if (name == "EvalParams") {
+                try {
+                    if (value != "<empty>") eval::load_params(value);
+                    searcher.clear_pawn_cache();
+                    tt.clear();
+                }
+                catch (std::exception& e) { print(std::string("info string ") + e.what()); }
+            }
+            else if (name == "MultiPV") multipv = std::clamp(std::stoi(value), 1, 256);
+            else if (name == "SearchStats") {
+                if (value == "off" || value == "text" || value == "json") stats_format = value;
+                else print("info string invalid value " + value + " of option SearchStats, off, text or json");
+            }
+            else if (name == "Ponder") {}        // the GUI decides when to send go ponder
+            else print("info string unknown option " + name);
+        }
+
+        void set_option(std::istringstream& is) {
+
+            std::string token, name, value;
+            is>>token;      // "name"
+            while (is>>token && token != "value") name += (name.empty()? "": " ") + token;
+            while (is>>token) value += (value.empty()? "": " ") + token;
+
+            // std::stoi and std::stoul of a value that is not a number
+            try { apply_option(name, value); }
+            catch (std::logic_error&) { print("info string invalid value " + value + " of option " + name); }
+        }
+
+        void set_position(std::istringstream& is) {
+
+            std::string token, fen;
+            is>>token;
+            if (token == "startpos") {
+                fen = Position::START_FEN;
+                is>>token;      // "moves"
+            }
+            else if (token == "fen") while (is>>token && token != "moves") fen += token + ' ';
+            else return;
+
+            pos.set(fen);
+            while (is>>token) {
+                Move m = from_uci(pos, token);
+                if (m == MOVE_NONE) { print("info string illegal move " + token); break; }
+                pos.do_move(m);
+            }
+        }
+
+        void go(std::istringstream& is) {
+
+            search::Limits limits;
+            limits.multipv = multipv;
+            std::string token;
+            int mate_moves = 0;
+            while (is>>token) {
+                if (token == "depth") is>>limits.depth;
+                else if (token == "nodes") is>>limits.nodes;
+                else if (token == "movetime") is>>limits.movetime;
+                else if (token == "wtime") is>>limits.time[WHITE];
+                else if (token == "btime") is>>limits.time[BLACK];
+                else if (token == "winc") is>>limits.inc[WHITE];
+                else if (token == "binc") is>>limits.inc[BLACK];
+                else if (token == "movestogo") is>>limits.movestogo;
+                else if (token == "infinite") limits.infinite = true;
+                else if (token == "ponder") limits.ponder = true;
+                else if (token == "mate") is>>mate_moves;
+            }
+
+            // book moves are answered at once, never while analysing
+            if (opening_book && !limits.infinite && !limits.ponder) {
+                Move m = opening_book->pick(pos);
+                if (m != MOVE_NONE) {
+                    print("info string book move");
+                    print("bestmove " + to_uci(m));
+                    return;
+                }
+            }
+
+            if (mate_moves > 0 && !mate_solver) mate_solver = std::make_unique<mate::Solver>();
+
+            // here and not on the worker, a stop right after go must reach the search
+            searcher.prepare(limits);
+            if (mate_solver) mate_solver->prepare();
+            worker = std::thread([limits, mate_moves] () mutable {
+
+                trace::thread_name("search");
+                // a proven mate is answered without the search, otherwise the search gets its turn
+                if (mate_moves > 0) {
+                    mate::Result mate = mate_solver->solve(pos, mate_moves);
+                    mate_solver->clear();
+                    if (mate.found && !mate.pv.empty()) {
+                        std::ostringstream ss;
+                        uint64_t time = static_cast<uint64_t>(mate.seconds*1000);
+                        ss<<"info depth "<<2*mate.moves-1<<" score mate "<<mate.moves<<" nodes "<<mate.nodes
+                          <<" nps "<<(time? mate.nodes*1000/time: mate.nodes)<<" time "<<time<<" pv";
+                        for (Move m: mate.pv) ss<<' '<<to_uci(m);
+                        print(ss.str());
+                        std::string line = "bestmove " + to_uci(mate.pv[0]);
+                        if (mate.pv.size() > 1) line += " ponder " + to_uci(mate.pv[1]);
+                        print(line);
+                        return;
+                    }
+                    print("info string no mate in " + std::to_string(mate_moves) + " found");
+                    // without other limits the search looks as deep as the mate would have been,
+                    // stopped while proving a shallow search still names a move
+                    bool unlimited = limits.depth == search::Limits().depth && !limits.nodes && !limits.movetime
+                                  && !limits.time[pos.side_to_move()] && !limits.infinite;
+                    if (unlimited) limits.depth = 2*mate_moves-1;
+                    if (mate.stopped) limits.depth = 1;
+                }
+
+                search::Result result = searcher.think(pos, limits, print_info);
+                if (searcher.tb_probe_count())
+                    print("info string tablebase hits " + std::to_string(searcher.tb_hit_count()) + " of "
+                          + std::to_string(searcher.tb_probe_count()) + " probes, "
+                          + std::to_string(100*searcher.tb_hit_count()/searcher.tb_probe_count()) + "%");
+                if (stats_format == "text")
+                    for (const std::string& s: searcher.search_stats().to_lines()) print("info string " + s);
+                else if (stats_format == "json") print("info string " + searcher.search_stats().to_json());
+                std::string line = "bestmove " + to_uci(result.best);
+                if (result.ponder != MOVE_NONE) line += " ponder " + to_uci(result.ponder);
+                print(line);
+            });
+        }
+    }
+
+    void loop(const std::string& book_path) {
+
+        open_book(book_path);
+        std::string line, token;
+
+        while (std::getline(std::cin, line)) {
+
+            std::istringstream is(line);
+            token.clear();
+            is>>token;
+
+            if (token == "quit") break;
+            else if (token == "stop") { stop_search(); wait_search(); }
+            else if (token == "ponderhit") searcher.ponderhit();
+            else if (token == "uci") {
+                print("id name chess\nid author d1ma82\n"
+                      "option name Hash type spin default 16 min 1 max 65536\n"
+                      "option name Clear Hash type button\n"
+                      "option name Book type string default <empty>\n"
+                      "option name BookDepth type spin default 40 min 0 max 1000\n"
+                      "option name TablebasePath type string default <empty>\n"
+                      "option name EvalFile type string default <empty>\n"
+                      "option name EvalParams type string default <empty>\n"
+                      "option name Ponder type check default false\n"
+                      "option name MultiPV type spin default 1 min 1 max 256\n"
+                      "option name SearchStats type combo default off var off var text var json\n"
+                      "uciok");
+            }
+            else if (token == "isready") print("readyok");
+            else if (token == "ucinewgame") { wait_search(); tt.clear(); }
+            else if (token == "setoption") { wait_search(); set_option(is); }
+            else if (token == "position") {
+                wait_search();
+                try { set_position(is); }
+                catch (std::exception& e) { print(std::string("info string ") + e.what()); }
+            }
+            else if (token == "go") { wait_search(); go(is); }
+            else if (token == "d") print(pos.fen());
+            else if (token == "bench") {
+                wait_search();
+                int depth;
+                if (!(is>>depth) || depth < 1) depth = bench::DEFAULT_DEPTH;
+                bench::Result result = bench::run(depth, [] (int index, int total, const std::string& fen, uint64_t nodes) {
+                    print("info string position " + std::to_string(index) + '/' + std::to_string(total) + ' ' + fen + ", " + std::to_string(nodes) + " nodes");
+                });
+                print("info string nodes " + std::to_string(result.nodes) + " nps " + std::to_string(result.nps())
+                      + " time " + std::to_string(static_cast<int64_t>(result.seconds*1000)));
+            }
+            else if (!token.empty()) print("info string unknown command " + token);
+        }
+        stop_search();
+        wait_search();
+    }
+}
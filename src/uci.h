@@ -0,0 +1,11 @@
+#pragma once
+#include <string>
+
+namespace uci {
+
+    /**
+     * Universal Chess Interface on stdin/stdout, returns on "quit" or end of input.
+     * book_path may be empty, the book can also be set with "setoption name Book value <path>"
+    */
+    void loop(const std::string& book_path = "");
+}